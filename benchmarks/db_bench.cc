@@ -4,15 +4,20 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -27,7 +32,10 @@
 //      fillrandom    -- write N values in random key order in async mode
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
+//      fillsyncmt    -- fillsync split across --sync_threads threads
 //      fill100K      -- write N/1000 100K values in random order in async mode
+//      fillingest    -- write N values in sequential key order to tables
+//                       with SstFileWriter and ingest them
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
@@ -39,9 +47,14 @@
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      readseql0     -- readseq over a fresh DB whose keys are dealt out
+//                       to 1, 2, 4, ... --l0_files overlapping level-0
+//                       files, with compactions held off
 //   Meta operations:
 //      compact     -- Compact the entire DB
+//      flush       -- Flush the memtable to a table, see DB::Flush()
 //      stats       -- Print DB stats
+//      compressionstats -- Print how many data blocks were compressed
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
@@ -62,7 +75,9 @@ static const char* FLAGS_benchmarks =
     "snappycomp,"
     "snappyuncomp,"
     "zstdcomp,"
-    "zstduncomp,";
+    "zstduncomp,"
+    "lz4comp,"
+    "lz4uncomp,";
 
 // Number of key/values to place in database
 static int FLAGS_num = 1000000;
@@ -90,6 +105,10 @@ static bool FLAGS_comparisons = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Size of the Bloom filter of each memtable as a fraction of
+// --write_buffer_size, see Options::memtable_bloom_size_ratio.
+static double FLAGS_memtable_bloom_ratio = 0;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -98,10 +117,32 @@ static int FLAGS_max_file_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// Encoding of data blocks, see Options::block_format_version.
+// (initialized to default value by "main")
+static int FLAGS_block_format_version = 0;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// If true, use a CLOCK cache instead of an LRU cache for blocks.
+static bool FLAGS_clock_cache = false;
+
+// Number of bytes to use as a cache of compressed blocks.
+// Zero or negative means no compressed block cache.
+static int FLAGS_compressed_cache_size = 0;
+
+// Number of bytes to use as a row cache.
+// Zero or negative means no row cache.
+static int FLAGS_row_cache_size = 0;
+
+// Directory of a persistent block cache, see leveldb/persistent_cache.h.
+// Null means no persistent cache.
+static const char* FLAGS_persistent_cache_dir = nullptr;
+
+// Number of bytes the persistent block cache may use.
+static int64_t FLAGS_persistent_cache_size = int64_t{1} << 30;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -120,6 +161,25 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// Number of obsolete log files to keep and write new logs over, see
+// Options::recycle_log_file_num.
+static int FLAGS_recycle_log_file_num = 0;
+
+// Number of threads writing in the fillsyncmt benchmark
+static int FLAGS_sync_threads = 16;
+
+// Microseconds a log sync waits for more writers to join it, see
+// Options::sync_delay_micros.
+static int FLAGS_sync_delay_micros = 0;
+
+// If true, keep log records buffered until the log is flushed, see
+// Options::manual_wal_flush.
+static bool FLAGS_manual_wal_flush = false;
+
+// If true, write without the log, see WriteOptions::disable_wal.  Sync
+// benchmarks ignore it.
+static bool FLAGS_disable_wal = false;
+
 // If true, use compression.
 static bool FLAGS_compression = true;
 
@@ -129,6 +189,30 @@ static const char* FLAGS_db = nullptr;
 // ZSTD compression level to try out
 static int FLAGS_zstd_compression_level = 1;
 
+// If non-zero, compress tables with zstd and a dictionary of this many
+// bytes, see Options::zstd_dictionary_size.
+static int FLAGS_zstd_dictionary_size = 0;
+
+// If non-null, comma-separated compression of each level, e.g.
+// "none,lz4,zstd", see Options::compression_per_level.  Names are none,
+// snappy, zstd and lz4.
+static const char* FLAGS_compression_per_level = nullptr;
+
+// Number of threads compressing the data blocks of each table written,
+// see Options::compression_parallel_threads.
+static int FLAGS_compression_threads = 1;
+
+// If true, skip compressing data blocks that keep failing to compress,
+// see Options::adaptive_compression.
+static bool FLAGS_adaptive_compression = false;
+
+// If true, compress the write-ahead log with zstd, see
+// Options::wal_compression.
+static bool FLAGS_wal_compression = false;
+
+// Largest number of level-0 files read by the readseql0 benchmark
+static int FLAGS_l0_files = 16;
+
 namespace leveldb {
 
 namespace {
@@ -423,11 +507,38 @@ void Uncompress(
   }
 }
 
+// Parses a --compression_per_level list.  Exits on unknown names.
+std::vector<CompressionType> ParseCompressionPerLevel(const char* list) {
+  std::vector<CompressionType> result;
+  while (*list != '\0') {
+    const char* sep = strchr(list, ',');
+    const Slice name = sep == nullptr ? Slice(list) : Slice(list, sep - list);
+    if (name == Slice("none")) {
+      result.push_back(kNoCompression);
+    } else if (name == Slice("snappy")) {
+      result.push_back(kSnappyCompression);
+    } else if (name == Slice("zstd")) {
+      result.push_back(kZstdCompression);
+    } else if (name == Slice("lz4")) {
+      result.push_back(kLZ4Compression);
+    } else {
+      std::fprintf(stderr, "unknown compression '%s'\n",
+                   name.ToString().c_str());
+      std::exit(1);
+    }
+    list = sep == nullptr ? list + name.size() : sep + 1;
+  }
+  return result;
+}
+
 }  // namespace
 
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  Cache* row_cache_;
+  PersistentCache* persistent_cache_;
   const FilterPolicy* filter_policy_;
   DB* db_;
   int num_;
@@ -519,7 +630,16 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
+      : cache_(FLAGS_cache_size < 0 ? nullptr
+               : FLAGS_clock_cache   ? NewClockCache(FLAGS_cache_size)
+                                     : NewLRUCache(FLAGS_cache_size)),
+        compressed_cache_(FLAGS_compressed_cache_size > 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
+        row_cache_(FLAGS_row_cache_size > 0
+                       ? NewLRUCache(FLAGS_row_cache_size)
+                       : nullptr),
+        persistent_cache_(nullptr),
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : nullptr),
@@ -540,12 +660,16 @@ class Benchmark {
     }
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
+      DestroyPersistentCache();
     }
   }
 
   ~Benchmark() {
     delete db_;
+    delete persistent_cache_;
     delete cache_;
+    delete compressed_cache_;
+    delete row_cache_;
     delete filter_policy_;
   }
 
@@ -571,6 +695,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      write_options_.disable_wal = FLAGS_disable_wal;
 
       void (Benchmark::*method)(ThreadState*) = nullptr;
       bool fresh_db = false;
@@ -597,7 +722,19 @@ class Benchmark {
         fresh_db = true;
         num_ /= 1000;
         write_options_.sync = true;
+        write_options_.disable_wal = false;
+        method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillsyncmt")) {
+        fresh_db = true;
+        num_threads = FLAGS_sync_threads;
+        num_ /= 1000 * num_threads;
+        if (num_ < 1) num_ = 1;
+        write_options_.sync = true;
+        write_options_.disable_wal = false;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillingest")) {
+        fresh_db = true;
+        method = &Benchmark::IngestSeq;
       } else if (name == Slice("fill100K")) {
         fresh_db = true;
         num_ /= 1000;
@@ -629,8 +766,12 @@ class Benchmark {
         method = &Benchmark::ReadWhileWriting;
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
+      } else if (name == Slice("flush")) {
+        method = &Benchmark::Flush;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("readseql0")) {
+        ReadSequentialLevel0(name);
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -639,12 +780,18 @@ class Benchmark {
         method = &Benchmark::ZstdCompress;
       } else if (name == Slice("zstduncomp")) {
         method = &Benchmark::ZstdUncompress;
+      } else if (name == Slice("lz4comp")) {
+        method = &Benchmark::LZ4Compress;
+      } else if (name == Slice("lz4uncomp")) {
+        method = &Benchmark::LZ4Uncompress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("compressionstats")) {
+        PrintStats("leveldb.compression-stats");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -661,6 +808,7 @@ class Benchmark {
           delete db_;
           db_ = nullptr;
           DestroyDB(FLAGS_db, Options());
+          DestroyPersistentCache();
           Open();
         }
       }
@@ -799,24 +947,83 @@ class Benchmark {
         &port::Zstd_Uncompress);
   }
 
-  void Open() {
-    assert(db_ == nullptr);
+  void LZ4Compress(ThreadState* thread) {
+    Compress(thread, "lz4", &port::Lz4_Compress);
+  }
+
+  void LZ4Uncompress(ThreadState* thread) {
+    Uncompress(thread, "lz4", &port::Lz4_Compress, &port::Lz4_Uncompress);
+  }
+
+  // Closes the persistent cache and removes its files.  Its entries are
+  // keyed by table file number, so they must not outlive the database.
+  void DestroyPersistentCache() {
+    delete persistent_cache_;
+    persistent_cache_ = nullptr;
+    if (FLAGS_persistent_cache_dir == nullptr) {
+      return;
+    }
+    std::vector<std::string> files;
+    g_env->GetChildren(FLAGS_persistent_cache_dir, &files);
+    for (size_t i = 0; i < files.size(); i++) {
+      g_env->RemoveFile(std::string(FLAGS_persistent_cache_dir) + "/" +
+                        files[i]);
+    }
+  }
+
+  Options DBOptions() {
     Options options;
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.compressed_block_cache = compressed_cache_;
+    options.row_cache = row_cache_;
+    if (FLAGS_persistent_cache_dir != nullptr && persistent_cache_ == nullptr) {
+      Status s = NewPersistentCache(g_env, FLAGS_persistent_cache_dir,
+                                    FLAGS_persistent_cache_size,
+                                    &persistent_cache_);
+      if (!s.ok()) {
+        std::fprintf(stderr, "open persistent cache error: %s\n",
+                     s.ToString().c_str());
+        std::exit(1);
+      }
+    }
+    options.persistent_cache = persistent_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.memtable_bloom_size_ratio = FLAGS_memtable_bloom_ratio;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.block_format_version = FLAGS_block_format_version;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.recycle_log_file_num = FLAGS_recycle_log_file_num;
+    options.sync_delay_micros = FLAGS_sync_delay_micros;
+    options.manual_wal_flush = FLAGS_manual_wal_flush;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
-    Status s = DB::Open(options, FLAGS_db, &db_);
+    options.zstd_compression_level = FLAGS_zstd_compression_level;
+    if (FLAGS_zstd_dictionary_size > 0) {
+      options.compression = kZstdCompression;
+      options.zstd_dictionary_size = FLAGS_zstd_dictionary_size;
+    }
+    if (FLAGS_compression_per_level != nullptr) {
+      options.compression_per_level =
+          ParseCompressionPerLevel(FLAGS_compression_per_level);
+    }
+    options.compression_parallel_threads = FLAGS_compression_threads;
+    options.adaptive_compression = FLAGS_adaptive_compression;
+    options.wal_compression =
+        FLAGS_wal_compression ? kZstdCompression : kNoCompression;
+    return options;
+  }
+
+  void Open() {
+    assert(db_ == nullptr);
+    Status s = DB::Open(DBOptions(), FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
       std::exit(1);
@@ -865,6 +1072,45 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  void IngestSeq(ThreadState* thread) {
+    if (num_ != FLAGS_num) {
+      char msg[100];
+      std::snprintf(msg, sizeof(msg), "(%d ops)", num_);
+      thread->stats.AddMessage(msg);
+    }
+
+    const Options options = DBOptions();
+    const std::string fname = std::string(FLAGS_db) + "/ingest.sst";
+    RandomGenerator gen;
+    Status s;
+    int64_t bytes = 0;
+    KeyBuffer key;
+    int i = 0;
+    while (s.ok() && i < num_) {
+      // One table of about max_file_size bytes at a time
+      SstFileWriter writer(options);
+      s = writer.Open(fname);
+      for (; s.ok() && i < num_ && writer.FileSize() < options.max_file_size;
+           i++) {
+        key.Set(i);
+        s = writer.Put(key.slice(), gen.Generate(value_size_));
+        bytes += value_size_ + key.slice().size();
+        thread->stats.FinishedSingleOp();
+      }
+      if (s.ok()) {
+        s = writer.Finish();
+      }
+      if (s.ok()) {
+        s = db_->IngestExternalFile(fname);
+      }
+    }
+    if (!s.ok()) {
+      std::fprintf(stderr, "ingest error: %s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadSequential(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -878,6 +1124,63 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  // Runs readseq over fresh databases whose keys are dealt out in turn to
+  // 1, 2, 4, ... --l0_files level-0 files.  The files overlap completely,
+  // so every step of the iterator moves to a different file.
+  void ReadSequentialLevel0(const Slice& name) {
+    if (FLAGS_use_existing_db) {
+      std::fprintf(stdout, "%-12s : skipped (--use_existing_db is true)\n",
+                   name.ToString().c_str());
+      return;
+    }
+    for (int files = 1; files <= FLAGS_l0_files; files *= 2) {
+      delete db_;
+      db_ = nullptr;
+      DestroyDB(FLAGS_db, Options());
+      DestroyPersistentCache();
+
+      // DB::Flush() places a memtable that overlaps nothing in level 1 or
+      // 2, but recovery always writes level-0 tables.  So each file is
+      // written to the log and turned into a table by the next open.
+      Options options = DBOptions();
+      options.create_if_missing = true;
+      options.reuse_logs = false;
+      options.level0_compaction_trigger = files + 1;
+      options.write_buffer_size =
+          std::max<size_t>(options.write_buffer_size,
+                           2 * (num_ / files + 1) * (value_size_ + 64));
+      RandomGenerator gen;
+      KeyBuffer key;
+      for (int f = 0; f <= files; f++) {
+        Status s = DB::Open(options, FLAGS_db, &db_);
+        for (int i = f; s.ok() && f < files && i < num_; i += files) {
+          key.Set(i);
+          s = db_->Put(WriteOptions(), key.slice(), gen.Generate(value_size_));
+        }
+        if (!s.ok()) {
+          std::fprintf(stderr, "readseql0 error: %s\n", s.ToString().c_str());
+          std::exit(1);
+        }
+        if (f < files) {
+          delete db_;
+          db_ = nullptr;
+        }
+      }
+
+      std::string level0;
+      db_->GetProperty("leveldb.num-files-at-level0", &level0);
+      char label[100];
+      std::snprintf(label, sizeof(label), "%s/%s", name.ToString().c_str(),
+                    level0.c_str());
+      RunBenchmark(FLAGS_threads, label, &Benchmark::ReadSequential);
+    }
+
+    // Later benchmarks get a database with the usual options.
+    delete db_;
+    db_ = nullptr;
+    Open();
+  }
+
   void ReadReverse(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -1030,6 +1333,14 @@ class Benchmark {
 
   void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
 
+  void Flush(ThreadState* thread) {
+    Status s = db_->Flush();
+    if (!s.ok()) {
+      std::fprintf(stderr, "flush error: %s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
@@ -1067,20 +1378,28 @@ int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
   FLAGS_block_size = leveldb::Options().block_size;
+  FLAGS_block_format_version = leveldb::Options().block_format_version;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
     double d;
     int n;
+    long long ll;
     char junk;
     if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
       FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
       FLAGS_compression_ratio = d;
+    } else if (sscanf(argv[i], "--memtable_bloom_ratio=%lf%c", &d, &junk) ==
+               1) {
+      FLAGS_memtable_bloom_ratio = d;
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
     } else if (sscanf(argv[i], "--comparisons=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_comparisons = n;
@@ -1093,6 +1412,34 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--zstd_dictionary_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_zstd_dictionary_size = n;
+    } else if (sscanf(argv[i], "--compression_threads=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compression_threads = n;
+    } else if (sscanf(argv[i], "--adaptive_compression=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_adaptive_compression = n;
+    } else if (sscanf(argv[i], "--wal_compression=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_wal_compression = n;
+    } else if (sscanf(argv[i], "--recycle_log_file_num=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_recycle_log_file_num = n;
+    } else if (sscanf(argv[i], "--sync_threads=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_sync_threads = n;
+    } else if (sscanf(argv[i], "--sync_delay_micros=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_sync_delay_micros = n;
+    } else if (sscanf(argv[i], "--manual_wal_flush=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_manual_wal_flush = n;
+    } else if (sscanf(argv[i], "--disable_wal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_disable_wal = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1107,16 +1454,35 @@ int main(int argc, char** argv) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--block_format_version=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_block_format_version = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--l0_files=%d%c", &n, &junk) == 1) {
+      FLAGS_l0_files = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (leveldb::Slice(argv[i]).starts_with(
+                   "--compression_per_level=")) {
+      FLAGS_compression_per_level =
+          argv[i] + strlen("--compression_per_level=");
+    } else if (strncmp(argv[i], "--persistent_cache_dir=", 23) == 0) {
+      FLAGS_persistent_cache_dir = argv[i] + 23;
+    } else if (sscanf(argv[i], "--persistent_cache_size=%lld%c", &ll, &junk) ==
+               1) {
+      FLAGS_persistent_cache_size = ll;
     } else {
       std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       std::exit(1);
@@ -16,7 +16,9 @@ namespace leveldb {
 
 // 创建 sstable 文件
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  TableBuilder::CompressionStats* compression_stats,
+                  int level) {
   Status s;
   meta->file_size = 0;
   iter->SeekToFirst();
@@ -31,7 +33,7 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     }
 
     //通过 TableBuilder 构造文件内容
-    TableBuilder* builder = new TableBuilder(options, file);
+    TableBuilder* builder = new TableBuilder(options, file, level);
     meta->smallest.DecodeFrom(iter->key()); // 将第一个 key 存入 meta
     Slice key;
     for (; iter->Valid(); iter->Next()) {
@@ -49,6 +51,9 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
     }
+    if (compression_stats != nullptr) {
+      *compression_stats = builder->GetCompressionStats();
+    }
     delete builder;
 
     // fsync 刷一下盘
@@ -66,7 +71,7 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     if (s.ok()) {
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+                                              meta->file_size, nullptr, level);
       s = it->status();
       delete it;
     }
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
 #include "leveldb/status.h"
+#include "leveldb/table_builder.h"
 
 namespace leveldb {
 
@@ -21,9 +22,14 @@ class VersionEdit;
 // will be named according to meta->number.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// zero, and no Table file will be produced.  If "compression_stats" is
+// non-null, the compression counts of the data blocks are stored in it.
+// The table is built for "level", which selects its compression and
+// filter; memtables are normally flushed to level 0.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  TableBuilder::CompressionStats* compression_stats = nullptr,
+                  int level = 0);
 
 }  // namespace leveldb
 
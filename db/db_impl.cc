@@ -42,11 +42,16 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        disable_wal(false),
+        done(false),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
+  bool disable_wal;
   bool done;
   port::CondVar cv;
 };
@@ -83,6 +88,7 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+  CompactionStats block_stats;  // Data blocks of the finished outputs
 };
 
 // Fix user-supplied options to be reasonable
@@ -102,6 +108,9 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.level0_compaction_trigger, 1, 1 << 20);
+  ClipToRange(&result.memtable_bloom_size_ratio, 0.0, 0.25);
+  ClipToRange(&result.compression_parallel_threads, 1, 64);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -118,6 +127,12 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+// Size in bits of the Bloom filter of each memtable.
+static uint32_t MemTableBloomBits(const Options& sanitized_options) {
+  return static_cast<uint32_t>(sanitized_options.write_buffer_size * 8 *
+                               sanitized_options.memtable_bloom_size_ratio);
+}
+
 static int TableCacheSize(const Options& sanitized_options) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
@@ -126,7 +141,8 @@ static int TableCacheSize(const Options& sanitized_options) {
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -139,17 +155,31 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       mem_(nullptr),
       imm_(nullptr),
       has_imm_(false),
+      mem_unlogged_(false),
+      imm_unlogged_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      first_recyclable_log_(0),
       tmp_batch_(new WriteBatch),
       background_compaction_scheduled_(false),
+      bg_compaction_paused_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)) {}
 
 DBImpl::~DBImpl() {
+  // Writes that skipped the log would be lost on reopen
+  bool flush;
+  {
+    MutexLock l(&mutex_);
+    flush = mem_unlogged_ || imm_unlogged_;
+  }
+  if (flush) {
+    Flush();
+  }
+
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
@@ -246,7 +276,8 @@ void DBImpl::RemoveObsoleteFiles() {
       switch (type) {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
-                  (number == versions_->PrevLogNumber()));
+                  (number == versions_->PrevLogNumber()) ||
+                  RecycleLogFile(number));
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -289,6 +320,66 @@ void DBImpl::RemoveObsoleteFiles() {
   mutex_.Lock();
 }
 
+bool DBImpl::RecycleLogFile(uint64_t number) {
+  mutex_.AssertHeld();
+  if (first_recyclable_log_ == 0 || number < first_recyclable_log_) {
+    return false;
+  }
+  if (std::find(recyclable_logs_.begin(), recyclable_logs_.end(), number) !=
+      recyclable_logs_.end()) {
+    return true;
+  }
+  if (recyclable_logs_.size() >= options_.recycle_log_file_num) {
+    return false;
+  }
+  recyclable_logs_.push_back(number);
+  Log(options_.info_log, "Keeping log #%llu for reuse\n",
+      static_cast<unsigned long long>(number));
+  return true;
+}
+
+Status DBImpl::NewLogFile(uint64_t number, WritableFile** file,
+                          log::Writer** writer) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, number);
+  Status s;
+  *file = nullptr;
+  if (!recyclable_logs_.empty()) {
+    const std::string old_fname =
+        LogFileName(dbname_, recyclable_logs_.front());
+    recyclable_logs_.pop_front();
+    s = env_->ReuseWritableFile(fname, old_fname, file);
+    if (s.ok()) {
+      Log(options_.info_log, "Reusing %s as %s\n", old_fname.c_str(),
+          fname.c_str());
+    } else {
+      env_->RemoveFile(old_fname);  // Ignoring errors on purpose
+    }
+  }
+  if (*file == nullptr) {
+    s = env_->NewWritableFile(fname, file);
+    if (s.ok()) {
+      // Ignoring errors: this is only a hint.  The log of a memtable
+      // grows to about the size of the memtable.
+      (*file)->Preallocate(options_.write_buffer_size +
+                           options_.write_buffer_size / 10);
+    }
+  }
+  if (s.ok()) {
+    uint64_t tag = 0;
+    if (options_.recycle_log_file_num > 0) {
+      tag = number;
+      if (first_recyclable_log_ == 0) {
+        first_recyclable_log_ = number;
+      }
+    }
+    *writer = new log::Writer(*file, options_.wal_compression,
+                              options_.zstd_compression_level, tag,
+                              options_.manual_wal_flush);
+  }
+  return s;
+}
+
 Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   mutex_.AssertHeld();
 
@@ -419,7 +510,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   // paranoid_checks==false so that corruptions cause entire commits
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/,
+                     log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
@@ -438,7 +530,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_, MemTableBloomBits(options_));
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -468,8 +560,14 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 
   delete file;
 
-  // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  // See if we should keep reusing the last log file.  A writer without
+  // compression does not announce it, so it cannot append to records that
+  // the reader would take as compressed.  A recyclable log may end with
+  // leftovers of its earlier use, which appended records would follow.
+  if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+      !reader.recyclable() &&
+      (reader.compression() == kNoCompression ||
+       options_.wal_compression == kZstdCompression)) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
@@ -477,14 +575,17 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
-      log_ = new log::Writer(logfile_, lfile_size);
+      log_ = new log::Writer(logfile_, lfile_size, options_.wal_compression,
+                             options_.zstd_compression_level, 0,
+                             options_.manual_wal_flush);
       logfile_number_ = log_number;
       if (mem != nullptr) {
         mem_ = mem;
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ =
+            new MemTable(internal_comparator_, MemTableBloomBits(options_));
         mem_->Ref();
       }
     }
@@ -521,11 +622,13 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number);
 
   Status s;
+  TableBuilder::CompressionStats compression_stats;
   {
     mutex_.Unlock();
     // 以 immutable MemTable 的 iter 作为数据源， 将数据持久化到 level0 
     // 由于要持久化的 MemTable 已经是不可变状态，所以不需要加锁了
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta); 
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                   &compression_stats);
     mutex_.Lock();
   }
 
@@ -553,6 +656,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
+  stats.AddBlocks(compression_stats);
   stats_[level].Add(stats);
   return s;
 }
@@ -585,6 +689,7 @@ void DBImpl::CompactMemTable() {
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
+    imm_unlogged_ = false;
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -647,7 +752,9 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   }
 }
 
-Status DBImpl::TEST_CompactMemTable() {
+Status DBImpl::TEST_CompactMemTable() { return Flush(); }
+
+Status DBImpl::Flush() {
   // nullptr batch means just wait for earlier writes to be done
   Status s = Write(WriteOptions(), nullptr);
   if (s.ok()) {
@@ -677,6 +784,8 @@ void DBImpl::MaybeScheduleCompaction() {
   if (background_compaction_scheduled_) {
     // 已经有 compaction 在运行了，什么都不做
     // Already scheduled
+  } else if (bg_compaction_paused_) {
+    // A file is being ingested; it schedules compactions when done
   } else if (shutting_down_.load(std::memory_order_acquire)) {
     // db 已经关闭
     // DB is being deleted; no more background compactions
@@ -840,7 +949,8 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(options_, compact->outfile,
+                                        compact->compaction->level() + 1);
   }
   return s;
 }
@@ -865,6 +975,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   const uint64_t current_bytes = compact->builder->FileSize();
   compact->current_output()->file_size = current_bytes;
   compact->total_bytes += current_bytes;
+  compact->block_stats.AddBlocks(compact->builder->GetCompressionStats());
   delete compact->builder;
   compact->builder = nullptr;
 
@@ -1065,7 +1176,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   delete input;
   input = nullptr;
 
-  CompactionStats stats;
+  CompactionStats stats = compact->block_stats;
   stats.micros = env_->NowMicros() - start_micros - imm_micros;
   for (int which = 0; which < 2; which++) {
     for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
@@ -1116,7 +1227,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      const PrefixSeekState* prefix_state) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
@@ -1128,7 +1240,7 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
     list.push_back(imm_->NewIterator());
     imm_->Ref();
   }
-  versions_->current()->AddIterators(options, &list);
+  versions_->current()->AddIterators(options, &list, prefix_state);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
@@ -1152,6 +1264,11 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+size_t DBImpl::TEST_QueuedWriters() {
+  MutexLock l(&mutex_);
+  return writers_.size();
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
   Status s;
@@ -1202,13 +1319,21 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? options_.prefix_extractor : nullptr;
+  // 只有写入了前缀过滤器时才能跳过不包含前缀的文件
+  PrefixSeekState* prefix_state = nullptr;
+  if (prefix_extractor != nullptr && options_.filter_policy != nullptr) {
+    prefix_state = new PrefixSeekState;
+  }
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, prefix_state);
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, prefix_extractor, prefix_state);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1239,11 +1364,16 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 
 // 写入一个 WriteBatch
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options.sync && options.disable_wal) {
+    return Status::InvalidArgument("sync writes need the log");
+  }
+
   // Writer 在多线程间协调时代表一个线程
   Writer w(&mutex_);
   w.batch = updates;
   // sync==true 表示写入完成后立即对 log 进行 fsync 刷盘避免丢失
   w.sync = options.sync;
+  w.disable_wal = options.disable_wal;
   w.done = false;
 
   // 每个写线程会将代表的自己的 writer 加入队列，
@@ -1253,6 +1383,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   // 
   // 这种机制将小批量聚合为大批量，在 leveldb 这种写入固定成本很大、批量写入性能远高于单条写入的场景下对性能有很大提升
   MutexLock l(&mutex_); 
+  if (options.no_slowdown && WriteStalled()) {
+    // 不等待，直接失败
+    return Status::Incomplete("Write stall");
+  }
   // 将代表自己线程的 writer 加入到队列
   writers_.push_back(&w);  
   // 如果自己不是队列中第一个 writer 则通过条件变量 w.cv 等待 w.done 变为 true
@@ -1277,59 +1411,137 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   // May temporarily unlock and wait.
   // 循环等待直至数据库状态允许写入
-  Status status = MakeRoomForWrite(updates == nullptr);
+  Status status = MakeRoomForWrite(updates == nullptr, options.no_slowdown);
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
+  size_t logged_writers = 0;  // Writers of the groups logged without error
+  Status log_error;           // Error of a chained group, for its writers
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    // 将队列中所有等待的 writer 打包成一个 write_batch
-    // 此时当前线程持有 mutex_, 其它线程无法入队
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
-    WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
-    last_sequence += WriteBatchInternal::Count(write_batch); 
-
-    // Add to log and apply to memtable.  We can release the lock
-    // during this phase since &w is currently responsible for logging
-    // and protects against concurrent loggers and concurrent writes
-    // into mem_.
-    {
+    if (w.sync && options_.sync_delay_micros > 0) {
+      // 稍等片刻，让更多并发写入加入本次提交，共用一次 Sync
+      // Give concurrent writers a chance to share our log sync.
+      mutex_.Unlock();
+      env_->SleepForMicroseconds(options_.sync_delay_micros);
+      mutex_.Lock();
+    }
+
+    // 第一步：写入 WAL 日志
+    // Log the queued writes a group at a time.  If the group needs a
+    // sync, the groups that queued up behind it are logged as well before
+    // syncing, so that one log sync covers all of them.  These groups skip
+    // MakeRoomForWrite(), so chaining stops once the memtable would
+    // overflow or a write would be stalled.  We can release
+    // the lock while logging since &w is currently responsible for logging
+    // and protects against concurrent loggers and concurrent writes into
+    // mem_.
+    // 将队列中等待的 writer 打包成 write_batch 写入日志，
+    // 需要 sync 时继续写入后面排队的组，最后只 Sync 一次
+    const SequenceNumber first_sequence = last_sequence + 1;
+    std::vector<Writer*> committed;
+    SequenceNumber logged_sequence = last_sequence;
+    size_t next = 0;
+    size_t logged_bytes = 0;
+    bool sync = false;
+    bool unlogged = false;
+    while (true) {
+      const size_t first = next;
+      WriteBatch* write_batch = BuildBatchGroup(&next, &sync);
+      WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+      last_sequence += WriteBatchInternal::Count(write_batch);
+      logged_bytes += WriteBatchInternal::ByteSize(write_batch);
+      committed.insert(committed.end(), writers_.begin() + first,
+                       writers_.begin() + next);
+      const bool more = sync && next < writers_.size() &&
+                        writers_[next]->batch != nullptr &&
+                        mem_->ApproximateMemoryUsage() + logged_bytes <=
+                            options_.write_buffer_size &&
+                        !WriteStalled();
+
+      const bool disable_wal = writers_[first]->disable_wal;
+      unlogged = unlogged || disable_wal;
+
       // 解锁之后，在当前线程写入期间其它线程就可以将自己的 writer 入队了
-      mutex_.Unlock(); 
-      // 第一步：写入 WAL 日志
-      status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
-      bool sync_error = false;
-      if (status.ok() && options.sync) {
-        status = logfile_->Sync();
-        if (!status.ok()) {
-          sync_error = true;
-        }
+      mutex_.Unlock();
+      if (!disable_wal) {
+        status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
       }
-      // 第二步：写入 MemTable
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(write_batch, mem_);
+      if (!status.ok()) {
+        break;
+      }
+      logged_writers = committed.size();
+      logged_sequence = last_sequence;
+      if (!more) {
+        break;
       }
       mutex_.Lock();
-      if (sync_error) {
-        // The state of the log file is indeterminate: the log record we
-        // just added may or may not show up when the DB is re-opened.
-        // So we force the DB into a mode where all future writes fail.
-        RecordBackgroundError(status);
+      if (write_batch == tmp_batch_) tmp_batch_->Clear();
+    }
+    last_writer = committed.back();
+
+    // If a chained group could not be logged, the groups logged before it
+    // are still applied and acknowledged, as a restart would recover them
+    // from the log.  Only the writers from the failed group on get the
+    // error.
+    size_t applied = committed.size();
+    if (!status.ok() && logged_writers > 0) {
+      log_error = status;
+      status = Status::OK();
+      applied = logged_writers;
+      last_sequence = logged_sequence;
+    }
+
+    // Sync the log and apply to memtable, still without the lock.
+    bool sync_error = false;
+    if (status.ok() && sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
       }
     }
-    if (write_batch == tmp_batch_) tmp_batch_->Clear();
+    // 第二步：写入 MemTable
+    SequenceNumber sequence = first_sequence;
+    for (size_t i = 0; i < applied; i++) {
+      if (!status.ok()) break;
+      Writer* writer = committed[i];
+      WriteBatchInternal::SetSequence(writer->batch, sequence);
+      sequence += WriteBatchInternal::Count(writer->batch);
+      status = WriteBatchInternal::InsertInto(writer->batch, mem_);
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+    if (!log_error.ok()) {
+      // The failed record may or may not show up when the DB is
+      // re-opened, so refuse further writes rather than reuse its
+      // sequence numbers.
+      RecordBackgroundError(log_error);
+    }
+    if (unlogged) {
+      mem_unlogged_ = true;
+    }
+    tmp_batch_->Clear();
 
     // 第三步：更新 last_sequence
     versions_->SetLastSequence(last_sequence);
   }
 
   // 写入完成，唤醒前面所有 writer
+  size_t acknowledged = 0;
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
     if (ready != &w) {
-      ready->status = status;
+      ready->status = (!log_error.ok() && acknowledged >= logged_writers)
+                          ? log_error
+                          : status;
       ready->done = true;
       ready->cv.Signal();
     }
+    acknowledged++;
     if (ready == last_writer) break;
   }
   // 唤醒下一个 writer 准备下次写入
@@ -1341,12 +1553,311 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
-// REQUIRES: Writer list must be non-empty
-// REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+Status DBImpl::FlushWAL(bool sync) {
+  // Take a turn at the head of the writer queue, so that no write is
+  // appending to the log meanwhile.
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  Status s = bg_error_;
+  if (s.ok()) {
+    mutex_.Unlock();
+    s = logfile_->Flush();
+    bool sync_error = false;
+    if (s.ok() && sync) {
+      s = logfile_->Sync();
+      sync_error = !s.ok();
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // As in Write(), the state of the log file is indeterminate.
+      RecordBackgroundError(s);
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
+namespace {
+
+// Presents the entries of an ingested table with sequence number
+// "sequence" in place of the 0 they were written with.  Only used to
+// scan the table from start to end.
+class SequenceAssigningIterator : public Iterator {
+ public:
+  SequenceAssigningIterator(Iterator* iter, SequenceNumber sequence)
+      : iter_(iter), sequence_(sequence) {}
+
+  ~SequenceAssigningIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    Update();
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  // Leaves key_ alone once the end is reached: like the keys of a table
+  // iterator, the last key stays readable after Next().
+  void Update() {
+    ParsedInternalKey ikey;
+    if (iter_->Valid() && ParseInternalKey(iter_->key(), &ikey)) {
+      ikey.sequence = sequence_;
+      key_.clear();
+      AppendInternalKey(&key_, ikey);
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber sequence_;
+  std::string key_;
+};
+
+}  // namespace
+
+// Checks that "key" is an entry key of SstFileWriter, which writes every
+// entry at sequence number 0 and in order, and that it comes after
+// *largest unless it is the first key.  Records it as the new *largest,
+// and as *smallest if it is the first key.
+static Status AddExternalKey(const Comparator* ucmp, const Slice& key,
+                             bool first, InternalKey* smallest,
+                             InternalKey* largest) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(key, &ikey) || ikey.sequence != 0) {
+    return Status::InvalidArgument("not a table written by SstFileWriter");
+  }
+  if (!first && ucmp->Compare(ikey.user_key, largest->user_key()) <= 0) {
+    return Status::Corruption("keys out of order in external table");
+  }
+  if (first) {
+    smallest->DecodeFrom(key);
+  }
+  largest->DecodeFrom(key);
+  return Status::OK();
+}
+
+// Checks that "table" looks like a table written by SstFileWriter, and
+// returns the keys of its first and last entries.  Table::Open() has
+// already read its footer and index, so only the first and last entries
+// are read, unless "paranoid" asks to read and check all of them.
+static Status CheckExternalTable(const Comparator* ucmp, Table* table,
+                                 bool paranoid, InternalKey* smallest,
+                                 InternalKey* largest) {
+  ReadOptions read_options;
+  read_options.verify_checksums = paranoid;
+  read_options.fill_cache = false;
+  Iterator* iter = table->NewIterator(read_options);
+  Status s;
+  bool empty = true;
+  iter->SeekToFirst();
+  if (iter->Valid()) {
+    s = AddExternalKey(ucmp, iter->key(), true, smallest, largest);
+    empty = false;
+  }
+  if (s.ok() && !empty) {
+    if (paranoid) {
+      for (iter->Next(); s.ok() && iter->Valid(); iter->Next()) {
+        s = AddExternalKey(ucmp, iter->key(), false, smallest, largest);
+      }
+    } else {
+      iter->SeekToLast();
+      if (iter->Valid() && iter->key() != smallest->Encode()) {
+        s = AddExternalKey(ucmp, iter->key(), false, smallest, largest);
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  if (s.ok() && empty) {
+    s = Status::InvalidArgument("external table has no entries");
+  }
+  delete iter;
+  return s;
+}
+
+// Returns true if "mem" holds an entry for a key in [smallest,largest].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+  Iterator* iter = mem->NewIterator();
+  LookupKey lkey(smallest, kMaxSequenceNumber);
+  iter->Seek(lkey.internal_key());
+  const bool overlaps =
+      iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  return overlaps;
+}
+
+Status DBImpl::IngestExternalFile(const std::string& fname) {
+  // 先在锁外检查外部 sstable 的内容并取得其 key 范围
+  uint64_t file_size = 0;
+  RandomAccessFile* file = nullptr;
+  Table* table = nullptr;
+  FileMetaData meta;
+  Status s = env_->GetFileSize(fname, &file_size);
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  if (s.ok()) {
+    s = Table::Open(options_, file, file_size, &table);
+  }
+  if (s.ok()) {
+    s = CheckExternalTable(user_comparator(), table, options_.paranoid_checks,
+                           &meta.smallest, &meta.largest);
+  }
+  if (!s.ok()) {
+    delete table;
+    delete file;
+    return s;
+  }
+  const Slice smallest_key = meta.smallest.user_key();
+  const Slice largest_key = meta.largest.user_key();
+
+  // Take a turn at the head of the writer queue, so that no write comes
+  // in while the file is added.
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  s = bg_error_;
+  if (s.ok() &&
+      (MemTableOverlaps(mem_, user_comparator(), smallest_key, largest_key) ||
+       (imm_ != nullptr && MemTableOverlaps(imm_, user_comparator(),
+                                            smallest_key, largest_key)))) {
+    // Older entries for the same keys must reach a table before the file
+    // is placed above them.
+    s = MakeRoomForWrite(true /* force compaction */, false);
+    while (s.ok() && imm_ != nullptr) {
+      background_work_finished_signal_.Wait();
+      s = bg_error_;
+    }
+  }
+
+  if (s.ok()) {
+    // Only one thread may call LogAndApply() at a time, so keep
+    // compactions out until the file is added.
+    bg_compaction_paused_ = true;
+    while (background_compaction_scheduled_) {
+      background_work_finished_signal_.Wait();
+    }
+
+    // 放在不与任何文件重叠的最深一层，若与已有数据重叠则分配新的 sequence
+    // Place the file in the deepest level such that neither that level
+    // nor any level above it holds a file overlapping its key range.
+    Version* current = versions_->current();
+    int level = 0;
+    while (level < config::kNumLevels &&
+           !current->OverlapInLevel(level, &smallest_key, &largest_key)) {
+      level++;
+    }
+    SequenceNumber sequence = 0;
+    if (level < config::kNumLevels || !snapshots_.empty()) {
+      // Its entries must hide the older entries for the same keys, and
+      // stay hidden from the snapshots taken before.
+      sequence = versions_->LastSequence() + 1;
+      versions_->SetLastSequence(sequence);
+    }
+    level = std::max(level - 1, 0);
+
+    meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta.number);
+    const std::string table_name = TableFileName(dbname_, meta.number);
+    {
+      mutex_.Unlock();
+      // A file whose entries keep sequence number 0 is linked into the
+      // database as it is.  Otherwise, or if it cannot be linked, it is
+      // copied with its entries at "sequence".  Either way the caller's
+      // file stays in place until the new one is recorded, so a crash
+      // loses neither.
+      if (sequence == 0 && env_->LinkFile(fname, table_name).ok()) {
+        meta.file_size = file_size;
+        Iterator* it = table_cache_->NewIterator(ReadOptions(), meta.number,
+                                                 meta.file_size, nullptr,
+                                                 level);
+        s = it->status();
+        delete it;
+      } else {
+        ReadOptions read_options;
+        read_options.fill_cache = false;
+        Iterator* iter = new SequenceAssigningIterator(
+            table->NewIterator(read_options), sequence);
+        s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                       nullptr, level);
+        delete iter;
+      }
+      mutex_.Lock();
+    }
+
+    if (s.ok()) {
+      VersionEdit edit;
+      edit.AddFile(level, meta.number, meta.file_size, meta.smallest,
+                   meta.largest);
+      s = versions_->LogAndApply(&edit, &mutex_);
+      if (!s.ok()) {
+        RecordBackgroundError(s);
+      }
+    }
+    pending_outputs_.erase(meta.number);
+    if (s.ok()) {
+      env_->RemoveFile(fname);
+    } else {
+      env_->RemoveFile(table_name);
+    }
+    Log(options_.info_log, "Ingested table #%llu: %lld bytes at level %d %s",
+        static_cast<unsigned long long>(meta.number),
+        static_cast<long long>(meta.file_size), level, s.ToString().c_str());
+
+    bg_compaction_paused_ = false;
+    MaybeScheduleCompaction();
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+// REQUIRES: writers_[*next] must exist and have a non-null batch
+// Groups the batches of writers_[*next] and of the writers queued after
+// it into one batch, and advances *next past the group.  Sets *sync if
+// any of them asked for a sync.
+WriteBatch* DBImpl::BuildBatchGroup(size_t* next, bool* sync) {
   mutex_.AssertHeld();
-  assert(!writers_.empty());
-  Writer* first = writers_.front();
+  assert(*next < writers_.size());
+  Writer* first = writers_[*next];
   WriteBatch* result = first->batch;
   assert(result != nullptr);
 
@@ -1360,34 +1871,38 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
     max_size = size + (128 << 10);
   }
 
-  *last_writer = first;
-  std::deque<Writer*>::iterator iter = writers_.begin();
-  ++iter;  // Advance past "first"
-  for (; iter != writers_.end(); ++iter) {
-    Writer* w = *iter;
-    if (w->sync && !first->sync) {
-      // Do not include a sync write into a batch handled by a non-sync write.
+  *sync = *sync || first->sync;
+  size_t i = *next + 1;  // Advance past "first"
+  for (; i < writers_.size(); ++i) {
+    Writer* w = writers_[i];
+    if (w->batch == nullptr) {
+      // Memtable compactions and log flushes take their own turn.
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->disable_wal != first->disable_wal) {
+      // Do not mix logged and unlogged writes in one group.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
-    *last_writer = w;
+    WriteBatchInternal::Append(result, w->batch);
+    // A sync write may join a non-sync group, which then gets synced.
+    *sync = *sync || w->sync;
   }
+  *next = i;
   return result;
 }
 
@@ -1404,7 +1919,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 //   3. 若 Memtable 已经达到最大值，且 immutable Memtable 尚未持久化，则等待 compaction 完成
 //   4. 检查 level0 的 sstable 数量是否达到了 kL0_StopWritesTrigger (默认为12)， 如果是则等待 compaction 完成
 //   5. 若 Memtable 已经达到最大值，且没有 immutable Memtable 则将当前 Memtable 转变为 immutable， 创建一个新的 mutable Memtable，并触发一次 minor compaction
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(bool force, bool no_slowdown) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
@@ -1414,8 +1929,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // Yield previous error
       s = bg_error_;
       break;
+    } else if (no_slowdown && WriteStalled()) {
+      s = Status::Incomplete("Write stall");
+      break;
     } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+                                  config::L0SlowdownWritesTrigger(
+                                      options_.level0_compaction_trigger)) {
       // 检查 level0 的 sstable 数量是否达到了 kL0_SlowdownWritesTrigger (默认为8)， 如果是则 sleep 1ms 以减慢写入速度，给 compaction 留下时间
       // level0 有 4 个 sstable 时开始 compaction, 当有 8 个 sstable 时则会减慢写入速度，当有 12 个 sstable 时则必须停下来等待 compaction 完成
       // 我们认为多次写入延迟 1ms 比单次写入延迟几秒要好，这样不仅使写入耗时比较稳定，也可以让出部分 CPU 给 compaction 使用
@@ -1441,7 +1960,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (versions_->NumLevelFiles(0) >=
+               config::L0StopWritesTrigger(
+                   options_.level0_compaction_trigger)) {
       // level0 的 sstable 数量达到了 kL0_StopWritesTrigger (默认为12)，等待 compaction 完成
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
@@ -1456,7 +1977,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      log::Writer* lwriter = nullptr;
+      s = NewLogFile(new_log_number, &lfile, &lwriter);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1480,14 +2002,16 @@ Status DBImpl::MakeRoomForWrite(bool force) {
 
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
+      log_ = lwriter;
 
       // 将当前 Memtable 置为 immutable, 并创建一个新的 mutable MemTable
       // 由于随后 mem_ 会指向新的 MemTable，由 mem_ 引用变为了 imm_ 引用，引用计数不变， 不需要调用 Unref
       imm_ = mem_; 
       has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      imm_unlogged_ = mem_unlogged_;
+      mem_ = new MemTable(internal_comparator_, MemTableBloomBits(options_));
       mem_->Ref();
+      mem_unlogged_ = false;
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1495,6 +2019,17 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+bool DBImpl::WriteStalled() {
+  mutex_.AssertHeld();
+  // The cases in which MakeRoomForWrite() sleeps or waits
+  if (versions_->NumLevelFiles(0) >=
+      config::L0SlowdownWritesTrigger(options_.level0_compaction_trigger)) {
+    return true;
+  }
+  return mem_->ApproximateMemoryUsage() > options_.write_buffer_size &&
+         imm_ != nullptr;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1552,6 +2087,49 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "compression-stats") {
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Level Compressed   Rejected    Skipped Skipped(%%)\n");
+    value->append(buf);
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const CompactionStats& s = stats_[level];
+      const int64_t blocks =
+          s.blocks_compressed + s.blocks_rejected + s.blocks_skipped;
+      if (blocks > 0) {
+        std::snprintf(buf, sizeof(buf), "%5d %10lld %10lld %10lld %10.1f\n",
+                      level, static_cast<long long>(s.blocks_compressed),
+                      static_cast<long long>(s.blocks_rejected),
+                      static_cast<long long>(s.blocks_skipped),
+                      100.0 * s.blocks_skipped / blocks);
+        value->append(buf);
+      }
+    }
+    return true;
+  } else if (in == "block-cache-shard-stats") {
+    std::vector<Cache::ShardStats> shards;
+    options_.block_cache->GetShardStats(&shards);
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Shard Capacity(MB) Usage(MB)    Lookups       Hits"
+                  "    Inserts  Evictions LockWaits LockWait(ms)\n");
+    value->append(buf);
+    for (size_t i = 0; i < shards.size(); i++) {
+      const Cache::ShardStats& s = shards[i];
+      std::snprintf(buf, sizeof(buf),
+                    "%5d %12.1f %9.1f %10llu %10llu %10llu %10llu %9llu "
+                    "%12.1f\n",
+                    static_cast<int>(i), s.capacity / 1048576.0,
+                    s.usage / 1048576.0,
+                    static_cast<unsigned long long>(s.lookups),
+                    static_cast<unsigned long long>(s.hits),
+                    static_cast<unsigned long long>(s.inserts),
+                    static_cast<unsigned long long>(s.evictions),
+                    static_cast<unsigned long long>(s.lock_waits),
+                    s.lock_wait_nanos / 1e6);
+      value->append(buf);
+    }
+    return true;
   }
 
   return false;
@@ -1604,14 +2182,15 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    log::Writer* lwriter;
+    s = impl->NewLogFile(new_log_number, &lfile, &lwriter);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->log_ = lwriter;
+      impl->mem_ = new MemTable(impl->internal_comparator_,
+                                MemTableBloomBits(impl->options_));
       impl->mem_->Ref();
     }
   }
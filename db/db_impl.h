@@ -15,12 +15,14 @@
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 
 namespace leveldb {
 
 class MemTable;
+struct PrefixSeekState;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -40,6 +42,9 @@ class DBImpl : public DB {
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status FlushWAL(bool sync) override;
+  Status Flush() override;
+  Status IngestExternalFile(const std::string& fname) override;
   
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
@@ -67,6 +72,10 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the number of writers in the write queue, including the one
+  // that is writing.
+  size_t TEST_QueuedWriters();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
@@ -89,22 +98,42 @@ class DBImpl : public DB {
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   struct CompactionStats {
-    CompactionStats() : micros(0), bytes_read(0), bytes_written(0) {}
+    CompactionStats()
+        : micros(0),
+          bytes_read(0),
+          bytes_written(0),
+          blocks_compressed(0),
+          blocks_rejected(0),
+          blocks_skipped(0) {}
 
     void Add(const CompactionStats& c) {
       this->micros += c.micros;
       this->bytes_read += c.bytes_read;
       this->bytes_written += c.bytes_written;
+      this->blocks_compressed += c.blocks_compressed;
+      this->blocks_rejected += c.blocks_rejected;
+      this->blocks_skipped += c.blocks_skipped;
+    }
+
+    void AddBlocks(const TableBuilder::CompressionStats& c) {
+      this->blocks_compressed += c.compressed;
+      this->blocks_rejected += c.rejected;
+      this->blocks_skipped += c.skipped;
     }
 
     int64_t micros;
     int64_t bytes_read;
     int64_t bytes_written;
+    // Data blocks written, see TableBuilder::GetCompressionStats().
+    int64_t blocks_compressed;
+    int64_t blocks_rejected;
+    int64_t blocks_skipped;
   };
 
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                const PrefixSeekState* prefix_state = nullptr);
 
   Status NewDB();
 
@@ -119,6 +148,15 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns true if the obsolete log file "number" is kept to be reused
+  // by a later log.
+  bool RecycleLogFile(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Creates log file "number" and a writer for it, reusing an obsolete
+  // log file if one was kept.
+  Status NewLogFile(uint64_t number, WritableFile** file,
+                    log::Writer** writer) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Compact the in-memory write buffer to disk.  Switches to a new
   // log-file/memtable and writes a new descriptor iff successful.
   // Errors are recorded in bg_error_.
@@ -131,9 +169,12 @@ class DBImpl : public DB {
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */)
-      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  Status MakeRoomForWrite(bool force /* compact even if there is room? */,
+                          bool no_slowdown) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns true if a write would now have to wait for a compaction, or
+  // be delayed to let compactions catch up.
+  bool WriteStalled() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  WriteBatch* BuildBatchGroup(size_t* next, bool* sync)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
@@ -178,11 +219,22 @@ class DBImpl : public DB {
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
   std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Do mem_ and imm_ hold writes made with WriteOptions::disable_wal?
+  // The destructor flushes them, since no log can recover them.
+  bool mem_unlogged_ GUARDED_BY(mutex_);
+  bool imm_unlogged_ GUARDED_BY(mutex_);
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
 
+  // Obsolete log files kept for reuse, oldest first.
+  std::deque<uint64_t> recyclable_logs_ GUARDED_BY(mutex_);
+  // The first log written with recyclable records by this DB, or 0.  Only
+  // logs from then on can be recycled: the leftover records of older ones
+  // could not be told apart from new records.
+  uint64_t first_recyclable_log_ GUARDED_BY(mutex_);
+
   // Queue of writers.
   // writers_ 负责写入操作的并发控制，具体请看 DBImpl::Write() 函数
   std::deque<Writer*> writers_ GUARDED_BY(mutex_); 
@@ -198,6 +250,10 @@ class DBImpl : public DB {
   // Has a background compaction been scheduled or is running?
   bool background_compaction_scheduled_ GUARDED_BY(mutex_);
 
+  // Set while IngestExternalFile() adds a file, so that no background
+  // compaction calls LogAndApply() concurrently.
+  bool bg_compaction_paused_ GUARDED_BY(mutex_);
+
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
   VersionSet* const versions_ GUARDED_BY(mutex_);
@@ -7,8 +7,10 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/version_set.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -46,11 +48,15 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const SliceTransform* prefix_extractor,
+         PrefixSeekState* prefix_state)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        prefix_extractor_(prefix_extractor),
+        prefix_state_(prefix_state),
+        prefix_bounded_(false),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
@@ -59,7 +65,10 @@ class DBIter : public Iterator {
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete prefix_state_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
@@ -88,6 +97,14 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns true if a Seek() bounded iteration to a prefix and
+  // "user_key" lies outside of it.
+  bool OutOfPrefix(const Slice& user_key) const {
+    return prefix_bounded_ &&
+           (!prefix_extractor_->InDomain(user_key) ||
+            prefix_extractor_->Transform(user_key) != Slice(prefix_));
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -110,6 +127,11 @@ class DBIter : public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  // Non-null only for ReadOptions::prefix_same_as_start.
+  const SliceTransform* const prefix_extractor_;
+  PrefixSeekState* const prefix_state_;  // Lets iter_ skip files, or null
+  std::string prefix_;  // Prefix of the last Seek() target
+  bool prefix_bounded_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
@@ -179,6 +201,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(iter_->Valid());
   assert(direction_ == kForward);
   do {
+    if (OutOfPrefix(ExtractUserKey(iter_->key()))) {
+      break;
+    }
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
       switch (ikey.type) {
@@ -213,6 +238,14 @@ void DBIter::Prev() {
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
     assert(iter_->Valid());  // Otherwise valid_ would have been false
+    if (prefix_state_ != nullptr && prefix_state_->bounded) {
+      // Files skipped by the last Seek() may hold smaller keys with the
+      // prefix, so reposition every file on the current entry first.
+      prefix_state_->bounded = false;
+      SaveKey(iter_->key(), &saved_key_);
+      iter_->Seek(saved_key_);
+      assert(iter_->Valid());
+    }
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
     while (true) {
       iter_->Prev();
@@ -239,6 +272,9 @@ void DBIter::FindPrevUserEntry() {
   ValueType value_type = kTypeDeletion;
   if (iter_->Valid()) {
     do {
+      if (OutOfPrefix(ExtractUserKey(iter_->key()))) {
+        break;
+      }
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
@@ -278,6 +314,15 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
+  if (prefix_state_ != nullptr) {
+    prefix_state_->bounded = prefix_bounded_;
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -292,6 +337,10 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
+  prefix_bounded_ = false;
+  if (prefix_state_ != nullptr) {
+    prefix_state_->bounded = false;
+  }
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -303,6 +352,10 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
+  prefix_bounded_ = false;
+  if (prefix_state_ != nullptr) {
+    prefix_state_->bounded = false;
+  }
   iter_->SeekToLast();
   FindPrevUserEntry();
 }
@@ -311,8 +364,11 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor,
+                        PrefixSeekState* prefix_state) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    prefix_extractor, prefix_state);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,21 @@
 namespace leveldb {
 
 class DBImpl;
+struct PrefixSeekState;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
 // into appropriate user keys.
+//
+// If "prefix_extractor" is non-null, iteration after a Seek() to a key in
+// its domain stops at the first key with a different prefix.  The
+// iterator takes ownership of "prefix_state", if non-null, and keeps it
+// up to date for the file iterators under "*internal_iter".
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor = nullptr,
+                        PrefixSeekState* prefix_state = nullptr);
 
 }  // namespace leveldb
 
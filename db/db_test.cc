@@ -4,9 +4,14 @@
 
 #include "leveldb/db.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <cstring>
+#include <map>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "db/db_impl.h"
@@ -16,6 +21,9 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -138,9 +146,16 @@ class SpecialEnv : public EnvWrapper {
   // Force log file close to fail while this bool is true.
   std::atomic<bool> log_file_close_;
 
+  // Once this many more log writes have succeeded, force the following
+  // ones to fail.  Negative while log writes do not fail.
+  std::atomic<int> log_writes_before_error_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of sstable/log Sync() calls.
+  AtomicCounter data_sync_counter_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -150,6 +165,7 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
+        log_writes_before_error_(-1),
         count_random_reads_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
@@ -168,7 +184,15 @@ class SpecialEnv : public EnvWrapper {
         if (env_->no_space_.load(std::memory_order_acquire)) {
           // Drop writes on the floor
           return Status::OK();
+        } else if (IsLogFile(fname_) &&
+                   env_->log_writes_before_error_.load(
+                       std::memory_order_acquire) == 0) {
+          return Status::IOError("simulated log write error");
         } else {
+          if (IsLogFile(fname_) && env_->log_writes_before_error_.load(
+                                       std::memory_order_acquire) > 0) {
+            env_->log_writes_before_error_.fetch_sub(1);
+          }
           return base_->Append(data);
         }
       }
@@ -185,6 +209,7 @@ class SpecialEnv : public EnvWrapper {
         if (env_->data_sync_error_.load(std::memory_order_acquire)) {
           return Status::IOError("simulated data sync error");
         }
+        env_->data_sync_counter_.Increment();
         while (env_->delay_data_sync_.load(std::memory_order_acquire)) {
           DelayMilliseconds(100);
         }
@@ -245,7 +270,14 @@ class SpecialEnv : public EnvWrapper {
       Status Read(uint64_t offset, size_t n, Slice* result,
                   char* scratch) const override {
         counter_->Increment();
-        return target_->Read(offset, n, result, scratch);
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          // Behave like a file that is not memory-mapped, so that the
+          // blocks read through it can be stored in the block cache.
+          std::memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
       }
     };
 
@@ -267,6 +299,7 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    row_cache_ = NewLRUCache(1 << 20);
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -278,6 +311,7 @@ class DBTest : public testing::Test {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete row_cache_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -303,9 +337,49 @@ class DBTest : public testing::Test {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kFullFilter:
+        options.filter_policy = filter_policy_;
+        options.full_filter = true;
+        break;
+      case kPartitionedIndexAndFilter:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 128;
+        break;
+      case kCacheIndexAndFilterBlocks:
+        options.filter_policy = filter_policy_;
+        options.cache_index_and_filter_blocks = true;
+        options.pin_l0_filter_and_index_blocks_in_cache = true;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        options.block_restart_interval = 2;  // Many restart points per block
+        break;
+      case kBlockFormatV2:
+        options.block_format_version = 2;
+        options.data_block_hash_index = true;
+        break;
+      case kRowCache:
+        options.row_cache = row_cache_;
+        break;
+      case kMemTableBloom:
+        options.memtable_bloom_size_ratio = 0.02;
+        break;
+      case kParallelCompression:
+        options.filter_policy = filter_policy_;
+        options.compression_parallel_threads = 2;
+        break;
+      case kZstdDictionary:
+        options.compression = kZstdCompression;
+        options.zstd_dictionary_size = 256;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kWalCompression:
+        options.wal_compression = kZstdCompression;
+        options.reuse_logs = true;
+        break;
       default:
         break;
     }
@@ -562,9 +636,26 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kFullFilter,
+    kPartitionedIndexAndFilter,
+    kCacheIndexAndFilterBlocks,
+    kDataBlockHashIndex,
+    kBlockFormatV2,
+    kRowCache,
+    kMemTableBloom,
+    kParallelCompression,
+    kZstdDictionary,
+    kUncompressed,
+    kWalCompression,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  Cache* row_cache_;
   int option_config_;
 };
 
@@ -656,6 +747,33 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, BlockCacheShardStats) {
+  Options options = CurrentOptions();
+  options.block_cache = NewLRUCache(8 << 20, 0, 2);
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v1", Get("foo"));
+
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-shard-stats", &val));
+  // A header line and one line per shard
+  ASSERT_EQ(5, std::count(val.begin(), val.end(), '\n')) << val;
+
+  std::vector<Cache::ShardStats> shards;
+  options.block_cache->GetShardStats(&shards);
+  uint64_t lookups = 0;
+  for (const Cache::ShardStats& s : shards) {
+    ASSERT_EQ(2 << 20, s.capacity);
+    lookups += s.lookups;
+  }
+  ASSERT_GE(lookups, 2);
+
+  Close();
+  delete options.block_cache;
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -1104,6 +1222,39 @@ TEST_F(DBTest, MinorCompactionsHappen) {
   }
 }
 
+TEST_F(DBTest, CompressionStats) {
+  Options options = CurrentOptions();
+  options.adaptive_compression = true;
+  Reopen(&options);
+  // Random bytes, like already compressed images.  Blocks are counted as
+  // rejected even if the compressor is not available.
+  Random rnd(301);
+  std::string value(1000, '\0');
+  for (int i = 0; i < 200; i++) {
+    for (char& c : value) {
+      c = static_cast<char>(rnd.Uniform(256));
+    }
+    ASSERT_LEVELDB_OK(Put(Key(i), value));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.compression-stats", &val));
+  // A header line and one line for the level the table went to
+  ASSERT_EQ(2, std::count(val.begin(), val.end(), '\n')) << val;
+  int level;
+  long long compressed, rejected, skipped;
+  double skipped_percent;
+  ASSERT_EQ(5, std::sscanf(val.c_str() + val.find('\n') + 1,
+                           "%d %lld %lld %lld %lf", &level, &compressed,
+                           &rejected, &skipped, &skipped_percent))
+      << val;
+  ASSERT_EQ(0, compressed);
+  ASSERT_GE(rejected, 4);
+  ASSERT_GT(skipped, rejected);
+  ASSERT_GT(skipped_percent, 50.0);
+}
+
 TEST_F(DBTest, RecoverWithLargeLog) {
   {
     Options options = CurrentOptions();
@@ -1128,6 +1279,474 @@ TEST_F(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST_F(DBTest, WalCompression) {
+  Options options = CurrentOptions();
+  options.wal_compression = kZstdCompression;
+  options.reuse_logs = true;
+  Reopen(&options);
+
+  // A large, repetitive value, like a batch of JSON documents.
+  Random rnd(301);
+  const std::string unit = RandomString(&rnd, 1000);
+  std::string big;
+  for (int i = 0; i < 1000; i++) {
+    big.append(unit);
+  }
+  WriteOptions sync;
+  sync.sync = true;
+  ASSERT_LEVELDB_OK(db_->Put(sync, "big", big));
+
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t log_bytes = 0;
+  for (const std::string& filename : filenames) {
+    uint64_t number;
+    FileType type;
+    uint64_t size;
+    if (ParseFileName(filename, &number, &type) && type == kLogFile &&
+        env_->GetFileSize(dbname_ + "/" + filename, &size).ok()) {
+      log_bytes += size;
+    }
+  }
+  port::ZstdCompressionStream stream(1);
+  std::string compressed;
+  if (stream.Compress(big.data(), big.size(), &compressed)) {
+    ASSERT_LT(log_bytes, big.size() / 10);
+  }
+
+  // Switching compression off must not append raw records to a log that
+  // ends with compressed ones.
+  options.wal_compression = kNoCompression;
+  Reopen(&options);
+  ASSERT_EQ(big, Get("big"));
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+
+  options.wal_compression = kZstdCompression;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("foo", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(big, Get("big"));
+}
+
+TEST_F(DBTest, GroupCommit) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+  WriteOptions sync_options;
+  sync_options.sync = true;
+
+  // Hold up a sync write in its log sync.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  env_->data_sync_counter_.Reset();
+  std::vector<std::thread> threads;
+  threads.emplace_back(
+      [&]() { ASSERT_LEVELDB_OK(db_->Put(sync_options, "first", "v")); });
+  while (env_->data_sync_counter_.Read() == 0) {
+    DelayMilliseconds(1);
+  }
+
+  // Queue up sync and non-sync writes behind it, too large to be logged
+  // as a single group.
+  const int kThreads = 8;
+  const std::string value(300000, 'x');
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&, i]() {
+      WriteOptions write_options;
+      write_options.sync = (i % 2 == 0);
+      ASSERT_LEVELDB_OK(db_->Put(write_options, Key(i), value));
+    });
+  }
+  while (dbfull()->TEST_QueuedWriters() < kThreads + 1) {
+    DelayMilliseconds(1);
+  }
+
+  // All of them share a single sync.
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(2, env_->data_sync_counter_.Read());
+
+  Reopen(&options);
+  ASSERT_EQ("v", Get("first"));
+  for (int i = 0; i < kThreads; i++) {
+    ASSERT_EQ(value, Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, GroupCommitLogError) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Hold up a sync write in its log sync.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  env_->data_sync_counter_.Reset();
+  std::vector<std::thread> threads;
+  threads.emplace_back([&]() {
+    WriteOptions write_options;
+    write_options.sync = true;
+    ASSERT_LEVELDB_OK(db_->Put(write_options, "first", "v"));
+  });
+  while (env_->data_sync_counter_.Read() == 0) {
+    DelayMilliseconds(1);
+  }
+
+  // Queue a sync write, an unlogged write and a plain write behind it, in
+  // that order.  They form three groups that are logged as one chain.
+  const std::string keys[] = {"a", "b", "c"};
+  Status results[3];
+  for (int i = 0; i < 3; i++) {
+    threads.emplace_back([&, i]() {
+      WriteOptions write_options;
+      write_options.sync = (i == 0);
+      write_options.disable_wal = (i == 1);
+      results[i] = db_->Put(write_options, keys[i], "v");
+    });
+    while (dbfull()->TEST_QueuedWriters() < static_cast<size_t>(i) + 2) {
+      DelayMilliseconds(1);
+    }
+  }
+
+  // Logging the first group takes two writes, for the record header and
+  // its contents.  Logging the last group fails.
+  env_->log_writes_before_error_.store(2, std::memory_order_release);
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  env_->log_writes_before_error_.store(-1, std::memory_order_release);
+
+  // The groups logged before the error are applied, the failed one is
+  // not, and the database refuses further writes.
+  ASSERT_LEVELDB_OK(results[0]);
+  ASSERT_LEVELDB_OK(results[1]);
+  ASSERT_TRUE(results[2].IsIOError());
+  ASSERT_EQ("v", Get("a"));
+  ASSERT_EQ("v", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_TRUE(!Put("d", "v").ok());
+
+  Reopen(&options);
+  ASSERT_EQ("v", Get("first"));
+  ASSERT_EQ("v", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_LEVELDB_OK(Put("d", "v"));
+}
+
+TEST_F(DBTest, ManualWalFlush) {
+  Options options = CurrentOptions();
+  options.manual_wal_flush = true;
+  Reopen(&options);
+
+  // Returns the size of the newest log file.
+  auto log_size = [&]() {
+    std::vector<std::string> filenames;
+    EXPECT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t newest = 0;
+    uint64_t size = 0;
+    for (const std::string& filename : filenames) {
+      uint64_t number;
+      FileType type;
+      if (ParseFileName(filename, &number, &type) && type == kLogFile &&
+          number > newest) {
+        newest = number;
+        EXPECT_LEVELDB_OK(env_->GetFileSize(dbname_ + "/" + filename, &size));
+      }
+    }
+    return size;
+  };
+
+  // Writes stay in the buffer of the log file until it is flushed.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(Put("bar", "v1"));
+  ASSERT_EQ(0, log_size());
+  ASSERT_LEVELDB_OK(db_->FlushWAL(false));
+  const uint64_t flushed = log_size();
+  ASSERT_GT(flushed, 0);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v2"));
+  ASSERT_EQ(flushed, log_size());
+  ASSERT_LEVELDB_OK(db_->FlushWAL(true));
+  ASSERT_GT(log_size(), flushed);
+
+  // Sync writes still reach the log file.
+  WriteOptions sync_options;
+  sync_options.sync = true;
+  const uint64_t synced = log_size();
+  ASSERT_LEVELDB_OK(db_->Put(sync_options, "baz", "v1"));
+  ASSERT_GT(log_size(), synced);
+
+  // So do the writes still buffered when the DB is closed.
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ("v1", Get("baz"));
+}
+
+TEST_F(DBTest, NoSlowdownWrites) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+
+  // Hold up the compaction of the memtable, so that the writes fill up
+  // the next memtable too and then stall.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  WriteOptions write_options;
+  write_options.no_slowdown = true;
+  const std::string value(10000, 'x');
+  Status s;
+  int i = 0;
+  for (; i < 1000; i++) {
+    s = db_->Put(write_options, Key(i), value);
+    if (!s.ok()) break;
+  }
+  ASSERT_TRUE(s.IsIncomplete()) << s.ToString();
+  ASSERT_GT(i, 10);
+  ASSERT_EQ("NOT_FOUND", Get(Key(i)));
+
+  // Writes that may wait go through once the compaction is done.
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Put(Key(i), value));
+  ASSERT_EQ(value, Get(Key(i)));
+}
+
+TEST_F(DBTest, DisableWal) {
+  WriteOptions write_options;
+  write_options.disable_wal = true;
+  ASSERT_LEVELDB_OK(db_->Put(write_options, "foo", "v1"));
+  ASSERT_LEVELDB_OK(Put("bar", "v1"));
+  ASSERT_EQ("v1", Get("foo"));
+
+  // Closing the database flushes unlogged writes.
+  Reopen();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v1", Get("bar"));
+
+  ASSERT_LEVELDB_OK(db_->Put(write_options, "foo", "v2"));
+  ASSERT_LEVELDB_OK(db_->Flush());
+  Reopen();
+  ASSERT_EQ("v2", Get("foo"));
+
+  write_options.sync = true;
+  ASSERT_TRUE(db_->Put(write_options, "foo", "v3").IsInvalidArgument());
+  ASSERT_EQ("v2", Get("foo"));
+}
+
+TEST_F(DBTest, Level0CompactionTrigger) {
+  Options options = CurrentOptions();
+  options.level0_compaction_trigger = 8;
+  Reopen(&options);
+
+  // The first two tables are pushed to levels 2 and 1.
+  for (int i = 0; i < 6; i++) {
+    ASSERT_LEVELDB_OK(Put("a", "v"));
+    ASSERT_LEVELDB_OK(Put("z", "v"));
+    ASSERT_LEVELDB_OK(dbfull()->Flush());
+  }
+  ASSERT_EQ("4,1,1", FilesPerLevel());
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+  const std::string fname = dbname_ + "/external.sst";
+
+  // Writes a table with the given entries, where a missing value stands
+  // for a deletion.
+  auto write_file =
+      [&](const std::vector<std::pair<std::string, const char*>>& entries) {
+        SstFileWriter writer(options);
+        ASSERT_LEVELDB_OK(writer.Open(fname));
+        for (const auto& entry : entries) {
+          if (entry.second == nullptr) {
+            ASSERT_LEVELDB_OK(writer.Delete(entry.first));
+          } else {
+            ASSERT_LEVELDB_OK(writer.Put(entry.first, entry.second));
+          }
+        }
+        ASSERT_LEVELDB_OK(writer.Finish());
+        ASSERT_GT(writer.FileSize(), 0);
+      };
+
+  {
+    SstFileWriter writer(options);
+    ASSERT_LEVELDB_OK(writer.Open(fname));
+    ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+    ASSERT_LEVELDB_OK(writer.Put("b", "v"));
+    ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+    ASSERT_TRUE(writer.Put("b", "v").IsInvalidArgument());
+  }
+  ASSERT_TRUE(!env_->FileExists(fname));
+  ASSERT_TRUE(!db_->IngestExternalFile(fname).ok());
+
+  // Into an empty database, the file is linked into the last level.
+  write_file({{"a", "v1"}, {"b", "v1"}, {"c", "v1"}});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_TRUE(!env_->FileExists(fname));
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("v1", Get("c"));
+
+  // Newer entries hide the older ones, in tables and in the memtable,
+  // but not from snapshots taken before.
+  ASSERT_LEVELDB_OK(Put("b", "v2"));
+  ASSERT_LEVELDB_OK(Put("d", "v2"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  write_file({{"a", "v3"}, {"b", "v3"}, {"c", nullptr}});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ("v3", Get("a"));
+  ASSERT_EQ("v3", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("v2", Get("d"));
+  ASSERT_EQ("v1", Get("a", snapshot));
+  ASSERT_EQ("v2", Get("b", snapshot));
+  ASSERT_EQ("v1", Get("c", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // A file that overlaps nothing goes to the last level as well.
+  write_file({{"x", "v4"}, {"y", "v4"}});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ(2, NumTableFilesAtLevel(config::kNumLevels - 1));
+
+  // Even then its entries are hidden from earlier snapshots.
+  snapshot = db_->GetSnapshot();
+  write_file({{"m", "v4"}});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ(3, NumTableFilesAtLevel(config::kNumLevels - 1));
+  ASSERT_EQ("v4", Get("m"));
+  ASSERT_EQ("NOT_FOUND", Get("m", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  Reopen(&options);
+  ASSERT_EQ("v3", Get("a"));
+  ASSERT_EQ("v3", Get("b"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("v2", Get("d"));
+  ASSERT_EQ("v4", Get("x"));
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("(a->v3)(b->v3)(d->v2)(m->v4)(x->v4)(y->v4)", Contents());
+
+  // If the database cannot record the file, the caller keeps it.
+  write_file({{"z", "v5"}});
+  env_->manifest_write_error_.store(true, std::memory_order_release);
+  ASSERT_TRUE(!db_->IngestExternalFile(fname).ok());
+  env_->manifest_write_error_.store(false, std::memory_order_release);
+  ASSERT_TRUE(env_->FileExists(fname));
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("z"));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ("v5", Get("z"));
+
+  // Paranoid checks read every entry before the file is added.
+  options.paranoid_checks = true;
+  Reopen(&options);
+  write_file({{"n1", "v6"}, {"n2", "v6"}, {"n3", "v6"}});
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ("v6", Get("n2"));
+  ASSERT_EQ("v6", Get("n3"));
+}
+
+TEST_F(DBTest, IngestExternalFileCompression) {
+  std::string compressed;
+  if (!port::Zstd_Compress(/*level=*/1, "aaaaaaaaaaaaaaaa", 16, &compressed)) {
+    GTEST_SKIP() << "skipping compression test: no zstd";
+  }
+  Options options = CurrentOptions();
+  options.compression = kNoCompression;
+  options.compression_per_level = {kNoCompression, kZstdCompression};
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put(Key(0), "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->Flush());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  const std::string fname = dbname_ + "/external.sst";
+  SstFileWriter writer(options);
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(writer.Put(Key(i), std::string(1000, 'v')));
+  }
+  ASSERT_LEVELDB_OK(writer.Finish());
+  uint64_t external_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(fname, &external_size));
+
+  // The file overlaps level 2, so it is copied into level 1 and takes
+  // the compression of that level.
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t largest_table = 0;
+  for (const std::string& filename : filenames) {
+    uint64_t number;
+    FileType type;
+    uint64_t size;
+    if (ParseFileName(filename, &number, &type) && type == kTableFile &&
+        env_->GetFileSize(dbname_ + "/" + filename, &size).ok()) {
+      largest_table = std::max(largest_table, size);
+    }
+  }
+  ASSERT_LT(largest_table, external_size / 2);
+  ASSERT_EQ(std::string(1000, 'v'), Get(Key(0)));
+}
+
+TEST_F(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.recycle_log_file_num = 2;
+  options.paranoid_checks = true;
+  Reopen(&options);
+
+  // Returns the numbers and sizes of the log files, oldest first.
+  auto log_files = [&]() {
+    std::vector<std::string> filenames;
+    EXPECT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+    std::map<uint64_t, uint64_t> logs;
+    for (const std::string& filename : filenames) {
+      uint64_t number;
+      FileType type;
+      uint64_t size;
+      if (ParseFileName(filename, &number, &type) && type == kLogFile &&
+          env_->GetFileSize(dbname_ + "/" + filename, &size).ok()) {
+        logs[number] = size;
+      }
+    }
+    return logs;
+  };
+
+  // The first log holds "k", deleted in the second one.
+  ASSERT_LEVELDB_OK(Put("big", std::string(100000, 'x')));
+  ASSERT_LEVELDB_OK(Put("k", "old"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Delete("k"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  // The first log is kept after its memtable is flushed, and the third
+  // log is written over it.
+  std::map<uint64_t, uint64_t> logs = log_files();
+  ASSERT_EQ(2, logs.size());
+  ASSERT_GT(logs.rbegin()->second, 100000);
+
+  // Its leftovers, including "k", must not be recovered.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("k"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(std::string(100000, 'x'), Get("big"));
+
+  // Logs of an earlier open are not recycled.
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("foo", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(1, log_files().size());
+}
+
 TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;  // Large write buffer
@@ -1381,6 +2000,10 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // Merge the level-0 files now.  Otherwise the background compaction
+    // they trigger may start while the snapshot below is held, and keep
+    // the hidden value.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1393,7 +2016,15 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
     ASSERT_GT(NumTableFilesAtLevel(0), 0);
 
     ASSERT_EQ(big, Get("foo", snapshot));
-    ASSERT_TRUE(Between(Size("", "pastfoo"), 50000, 60000));
+    // Unlike snappy, zstd still shrinks the random printable value.
+    uint64_t stored = big.size();
+    std::string compressed;
+    if (last_options_.compression == kZstdCompression &&
+        port::Zstd_Compress(last_options_.zstd_compression_level, big.data(),
+                            big.size(), &compressed)) {
+      stored = compressed.size();
+    }
+    ASSERT_TRUE(Between(Size("", "pastfoo"), stored, stored + 10000));
     db_->ReleaseSnapshot(snapshot);
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny, " + big + " ]");
     Slice x("x");
@@ -1977,6 +2608,276 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, PersistentCache) {
+  // The cache lives in a second directory next to the database.
+  const std::string cache_dir = dbname_ + "_persistent_cache";
+  PersistentCache* persistent_cache;
+  ASSERT_LEVELDB_OK(NewPersistentCache(Env::Default(), cache_dir, 16 << 20,
+                                       &persistent_cache));
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.persistent_cache = persistent_cache;
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+  ASSERT_GT(persistent_cache->TotalSize(), 0);
+
+  // Restart both the database and the cache.  The blocks are now read
+  // from the cache files instead of the tables.
+  Close();
+  delete persistent_cache;
+  ASSERT_LEVELDB_OK(NewPersistentCache(Env::Default(), cache_dir, 16 << 20,
+                                       &persistent_cache));
+  options.persistent_cache = persistent_cache;
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+  const int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d lookups => %d table reads\n", N, reads);
+  ASSERT_LE(reads, N / 100);
+
+  Close();
+  delete persistent_cache;
+  delete options.block_cache;
+  std::vector<std::string> files;
+  Env::Default()->GetChildren(cache_dir, &files);
+  for (const std::string& f : files) {
+    Env::Default()->RemoveFile(cache_dir + "/" + f);
+  }
+  Env::Default()->RemoveDir(cache_dir);
+}
+
+TEST_F(DBTest, RowCache) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.row_cache = NewLRUCache(1 << 20);
+  Reopen(&options);
+
+  const int N = 100;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v1"));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v2"));
+  }
+  ASSERT_LEVELDB_OK(Delete(Key(0)));
+  Compact("a", "z");
+
+  // Hot keys are read from the row cache after the first lookup.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i == 0 ? "NOT_FOUND" : "v2", Get(Key(i)));
+  }
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i == 0 ? "NOT_FOUND" : "v2", Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  const size_t charge = options.row_cache->TotalCharge();
+  ASSERT_GT(charge, 0);
+
+  // Misses are not cached.
+  ASSERT_EQ("NOT_FOUND", Get(Key(N / 2) + "x"));
+  ASSERT_EQ(charge, options.row_cache->TotalCharge());
+
+  // Older versions kept for a snapshot are still read from the table.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("v1", Get(Key(i), snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  // New tables are cached under their own file numbers.
+  ASSERT_LEVELDB_OK(Put(Key(1), "v3"));
+  Compact("a", "z");
+  ASSERT_EQ("v3", Get(Key(1)));
+  ASSERT_EQ("v2", Get(Key(2)));
+
+  Close();
+  delete options.block_cache;
+  delete options.row_cache;
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(8 << 20);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  // Once the partitions are cached, missing keys should almost never
+  // touch the file.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  env_->count_random_reads_ = true;  // Blocks read from mmaps are not cached
+  for (bool cache_meta_blocks : {false, true}) {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(8 << 20, 0.5);
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.cache_index_and_filter_blocks = cache_meta_blocks;
+    options.pin_l0_filter_and_index_blocks_in_cache = cache_meta_blocks;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    for (int i = 0; i < 1000; i += 10) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    Reopen(&options);
+
+    // Data blocks are not cached with fill_cache == false, so only index
+    // and filter blocks are charged to the cache.
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    std::string value;
+    ASSERT_TRUE(db_->Get(read_options, "missing", &value).IsNotFound());
+    ASSERT_LEVELDB_OK(db_->Get(read_options, Key(10), &value));
+    ASSERT_EQ(Key(10), value);
+    if (cache_meta_blocks) {
+      ASSERT_GT(options.block_cache->TotalCharge(), 0);
+    } else {
+      ASSERT_EQ(0, options.block_cache->TotalCharge());
+    }
+
+    // Tables must release their pinned blocks before the cache goes away.
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
+
+TEST_F(DBTest, PrefixSeek) {
+  const SliceTransform* prefix_extractor = NewDelimitedPrefixTransform('|', 2);
+  ASSERT_TRUE(prefix_extractor->InDomain("user|0001|0000"));
+  ASSERT_FALSE(prefix_extractor->InDomain("user|0001"));
+  ASSERT_EQ("user|0001|", prefix_extractor->Transform("user|0001|0000"));
+
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = prefix_extractor;
+  Reopen(&options);
+
+  // Only even entities exist, spread over a compacted level and level-0.
+  char buf[32];
+  const int kEntities = 200;
+  for (int e = 0; e < kEntities; e += 2) {
+    for (int ts = 0; ts < 10; ts++) {
+      std::snprintf(buf, sizeof(buf), "user|%04d|%04d", e, ts);
+      ASSERT_LEVELDB_OK(Put(buf, buf));
+    }
+  }
+  Compact("a", "z");
+  for (int e = 0; e < kEntities; e += 20) {
+    std::snprintf(buf, sizeof(buf), "user|%04d|%04d", e, 10);
+    ASSERT_LEVELDB_OK(Put(buf, buf));
+  }
+  dbfull()->TEST_CompactMemTable();
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(read_options);
+
+  // Iteration stops at the end of the prefix of the Seek() target.
+  iter->Seek("user|0020|0005");
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(iter->key().starts_with("user|0020|"));
+    count++;
+  }
+  ASSERT_EQ(6, count);
+  iter->Seek("user|0020|0005");
+  iter->Prev();
+  ASSERT_EQ("user|0020|0004->user|0020|0004", IterStatus(iter));
+  iter->Seek("user|0198|");
+  iter->Prev();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+
+  // Seeks into missing prefixes rarely read a data block.
+  env_->random_read_counter_.Reset();
+  for (int e = 1; e < kEntities; e += 2) {
+    std::snprintf(buf, sizeof(buf), "user|%04d|", e);
+    iter->Seek(buf);
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+  }
+  const int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing prefixes => %d reads\n", kEntities / 2,
+               reads);
+  ASSERT_LE(reads, kEntities / 20);
+
+  // Keys outside the domain and SeekToFirst() are not bounded.
+  iter->Seek("user|0001");
+  ASSERT_EQ("user|0002|0000->user|0002|0000", IterStatus(iter));
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(kEntities / 2 * 10 + kEntities / 20, count);
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete prefix_extractor;
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -2158,6 +3059,11 @@ class ModelDB : public DB {
     handler.map_ = &map_;
     return batch->Iterate(&handler);
   }
+  Status FlushWAL(bool sync) override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status IngestExternalFile(const std::string& fname) override {
+    return Status::NotSupported("IngestExternalFile");
+  }
 
   bool GetProperty(const Slice& property, std::string* value) override {
     return false;
@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -100,6 +101,12 @@ const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
+  CreateFilterForLevel(-1, keys, n, dst);
+}
+
+void InternalFilterPolicy::CreateFilterForLevel(int level, const Slice* keys,
+                                                int n,
+                                                std::string* dst) const {
   // We rely on the fact that the code in table.cc does not mind us
   // adjusting keys[].
   Slice* mkey = const_cast<Slice*>(keys);
@@ -107,7 +114,28 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == nullptr) {
+    user_policy_->CreateFilterForLevel(level, keys, n, dst);
+    return;
+  }
+
+  // Keys arrive in sorted order, so equal prefixes are adjacent.
+  std::vector<Slice> all(keys, keys + n);
+  Slice last_prefix;
+  bool have_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (!prefix_extractor_->InDomain(keys[i])) {
+      continue;
+    }
+    Slice prefix = prefix_extractor_->Transform(keys[i]);
+    if (!have_prefix || prefix != last_prefix) {
+      all.push_back(prefix);
+      last_prefix = prefix;
+      have_prefix = true;
+    }
+  }
+  user_policy_->CreateFilterForLevel(level, all.data(),
+                                     static_cast<int>(all.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
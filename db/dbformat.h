@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -33,6 +34,16 @@ static const int kL0_SlowdownWritesTrigger = 8;
 // Maximum number of level-0 files.  We stop writes at this point.
 static const int kL0_StopWritesTrigger = 12;
 
+// The two triggers above, for a database whose level-0 compactions start
+// at "compaction_trigger" files instead (see
+// Options::level0_compaction_trigger).  They keep their distance from it.
+inline int L0SlowdownWritesTrigger(int compaction_trigger) {
+  return compaction_trigger + kL0_SlowdownWritesTrigger - kL0_CompactionTrigger;
+}
+inline int L0StopWritesTrigger(int compaction_trigger) {
+  return compaction_trigger + kL0_StopWritesTrigger - kL0_CompactionTrigger;
+}
+
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -123,11 +134,18 @@ class InternalKeyComparator : public Comparator {
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
 
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
+  // If "prefix_extractor" is non-null, the prefix of every user key in its
+  // domain is added to each filter alongside the user key itself.
+  explicit InternalFilterPolicy(
+      const FilterPolicy* p, const SliceTransform* prefix_extractor = nullptr)
+      : user_policy_(p), prefix_extractor_(prefix_extractor) {}
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
+  void CreateFilterForLevel(int level, const Slice* keys, int n,
+                            std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
 };
 
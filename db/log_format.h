@@ -21,15 +21,36 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // Never fragmented.  Its one-byte payload is the CompressionType of the
+  // records that follow, until the next record of this type.
+  // 之后的记录使用的压缩算法
+  kSetCompressionType = 5,
+
+  // The same as kFullType to kLastType, in log files that may be recycled.
+  // Their header also holds the number of the log file, so that records
+  // left over from an earlier use of the file can be told apart.
+  // 可回收日志文件中的记录，header 中带有日志编号
+  kRecyclableFullType = 6,
+  kRecyclableFirstType = 7,
+  kRecyclableMiddleType = 8,
+  kRecyclableLastType = 9,
+
+  // kSetCompressionType in log files that may be recycled, with the log
+  // number in its header like the other recyclable types.
+  kRecyclableSetCompressionType = 10
 };
-static const int kMaxRecordType = kLastType;
+static const int kMaxRecordType = kRecyclableSetCompressionType;
 
 static const int kBlockSize = 32768; // 32KB
 
 // Header is checksum (4 bytes), length (2 bytes), type (1 byte).
 static const int kHeaderSize = 4 + 2 + 1;
 
+// Header of the recyclable types, followed by the log number (4 bytes).
+static const int kRecyclableHeaderSize = kHeaderSize + 4;
+
 }  // namespace log
 }  // namespace leveldb
 
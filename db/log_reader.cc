@@ -7,6 +7,7 @@
 #include <cstdio>
 
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -16,7 +17,7 @@ namespace log {
 Reader::Reporter::~Reporter() = default;
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
@@ -26,9 +27,16 @@ Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
       last_record_offset_(0),
       end_of_buffer_offset_(0),
       initial_offset_(initial_offset),
-      resyncing_(initial_offset > 0) {}
-
-Reader::~Reader() { delete[] backing_store_; }
+      resyncing_(initial_offset > 0),
+      log_number_(static_cast<uint32_t>(log_number)),
+      recyclable_(false),
+      compression_(kNoCompression),
+      decompressor_(nullptr) {}
+
+Reader::~Reader() {
+  delete[] backing_store_;
+  delete decompressor_;
+}
 
 // 跳转到 initial_offset_ 所在 block 的开头，如果 initial_offset_ 处于结尾填充区则跳到下一个 Block 开头
 bool Reader::SkipToInitialBlock() {
@@ -59,6 +67,50 @@ bool Reader::SkipToInitialBlock() {
 }
 
 bool Reader::ReadRecord(Slice* record, std::string* scratch) {
+  while (ReadRawRecord(record, scratch)) {
+    if (compression_ == kNoCompression) {
+      return true;
+    }
+    if (decompressor_ == nullptr) {
+      ReportCorruption(record->size(), "missing start of compressed records");
+      continue;
+    }
+    uncompressed_.clear();
+    if (!decompressor_->Uncompress(record->data(), record->size(),
+                                   &uncompressed_)) {
+      ReportCorruption(record->size(), "corrupted compressed record");
+      continue;
+    }
+    *record = Slice(uncompressed_);
+    return true;
+  }
+  return false;
+}
+
+void Reader::SetCompression(const Slice& payload) {
+  delete decompressor_;
+  decompressor_ = nullptr;
+  compression_ = kNoCompression;
+  if (payload.size() != 1) {
+    ReportCorruption(payload.size(), "bad compression type record");
+    return;
+  }
+  switch (static_cast<unsigned char>(payload[0])) {
+    case kNoCompression:
+      break;
+    case kZstdCompression:
+      compression_ = kZstdCompression;
+      decompressor_ = new port::ZstdDecompressionStream;
+      break;
+    default:
+      // Records cannot be read until the next kSetCompressionType record.
+      compression_ = static_cast<CompressionType>(payload[0]);
+      ReportCorruption(payload.size(), "unknown log compression type");
+      break;
+  }
+}
+
+bool Reader::ReadRawRecord(Slice* record, std::string* scratch) {
   if (last_record_offset_ < initial_offset_) {
     if (!SkipToInitialBlock()) { // 跳转到 initial_offset_ 指定的 Block 开头
       return false;
@@ -78,13 +130,23 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
   Slice fragment;
   while (true) {
     // 读取一个物理记录
-    const unsigned int record_type = ReadPhysicalRecord(&fragment);
+    unsigned int record_type = ReadPhysicalRecord(&fragment);
+    int header_size = kHeaderSize;
+    if (record_type >= kRecyclableFullType &&
+        record_type <= kRecyclableLastType) {
+      // Handled like the corresponding plain type.
+      header_size = kRecyclableHeaderSize;
+      record_type = record_type - kRecyclableFullType + kFullType;
+    } else if (record_type == kRecyclableSetCompressionType) {
+      header_size = kRecyclableHeaderSize;
+      record_type = kSetCompressionType;
+    }
 
     // ReadPhysicalRecord may have only had an empty trailer remaining in its
     // internal buffer. Calculate the offset of the next physical record now
     // that it has returned, properly accounting for its header size.
     uint64_t physical_record_offset =
-        end_of_buffer_offset_ - buffer_.size() - kHeaderSize - fragment.size();
+        end_of_buffer_offset_ - buffer_.size() - header_size - fragment.size();
 
     if (resyncing_) {
       if (record_type == kMiddleType) {
@@ -150,6 +212,15 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         }
         break;
 
+      case kSetCompressionType:
+        if (in_fragmented_record) {
+          ReportCorruption(scratch->size(), "partial record without end(3)");
+          in_fragmented_record = false;
+          scratch->clear();
+        }
+        SetCompression(fragment);
+        break;
+
       case kEof:
         if (in_fragmented_record) {
           // This can be caused by the writer dying immediately after
@@ -189,6 +260,10 @@ void Reader::ReportCorruption(uint64_t bytes, const char* reason) {
 }
 
 void Reader::ReportDrop(uint64_t bytes, const Status& reason) {
+  // The records after a dropped one may refer back to it, so they cannot
+  // be decompressed.
+  delete decompressor_;
+  decompressor_ = nullptr;
   if (reporter_ != nullptr &&
       end_of_buffer_offset_ - buffer_.size() - bytes >= initial_offset_) {
     reporter_->Corruption(static_cast<size_t>(bytes), reason);
@@ -263,18 +338,26 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
     const unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    int header_size = kHeaderSize;
+    if ((type >= kRecyclableFullType && type <= kRecyclableLastType) ||
+        type == kRecyclableSetCompressionType) {
+      recyclable_ = true;
+      header_size = kRecyclableHeaderSize;
+    }
+    if (header_size + length > buffer_.size()) {
       size_t drop_size = buffer_.size();
       buffer_.clear();
-      if (!eof_) {
+      if (!eof_ && !recyclable_) {
         // record 超出了 block 的大小，报错
         ReportCorruption(drop_size, "bad record length");
         return kBadRecord;
       }
       // If the end of the file has been reached without reading |length| bytes
       // of payload, assume the writer died in the middle of writing the record.
-      // Don't report a corruption.
+      // Don't report a corruption.  In a recyclable log, this may also be
+      // where the records of an earlier use of the file start.
       // 碰到 EOF 说明 writer 写入途中崩溃了，不报错
+      eof_ = true;
       return kEof;
     }
 
@@ -291,7 +374,8 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc =
+          crc32c::Value(header + 6, 1 + (header_size - kHeaderSize) + length);
       if (actual_crc != expected_crc) {
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
@@ -299,23 +383,37 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
         // like a valid log record.
         size_t drop_size = buffer_.size();
         buffer_.clear();
+        if (recyclable_) {
+          // Most likely a leftover of an earlier use of the file.
+          eof_ = true;
+          return kEof;
+        }
         ReportCorruption(drop_size, "checksum mismatch");
         return kBadRecord;
       }
     }
 
+    if (header_size == kRecyclableHeaderSize && log_number_ != 0 &&
+        DecodeFixed32(header + kHeaderSize) != log_number_) {
+      // A record of an earlier use of the file: the log ends here.
+      // 回收前留下的旧记录，日志到此结束
+      buffer_.clear();
+      eof_ = true;
+      return kEof;
+    }
+
     // 从 buffer 中移除已读的 Record
-    buffer_.remove_prefix(kHeaderSize + length);
+    buffer_.remove_prefix(header_size + length);
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
     // Record 内容写入 result
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
     return type;
   }
 }
@@ -6,8 +6,10 @@
 #define STORAGE_LEVELDB_DB_LOG_READER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/log_format.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
@@ -15,6 +17,10 @@ namespace leveldb {
 
 class SequentialFile;
 
+namespace port {
+class ZstdDecompressionStream;
+}  // namespace port
+
 namespace log {
 
 class Reader {
@@ -46,8 +52,12 @@ class Reader {
   // 如果 reporter 不为空，所有数据损坏都会通过 reporter 上报，在 Reader 使用期间 reporter 必须存活
   // checksum 用于控制读取时是否检测 CRC 校验和
   // Reader 从 initial_offset 后第一个 Record 开始读
+  //
+  // If "log_number" is non-zero, the log ends at the first recyclable
+  // record tagged with another log number, which was left over from an
+  // earlier use of the file.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   // 禁止复制
   Reader(const Reader&) = delete;
@@ -59,7 +69,8 @@ class Reader {
   // successfully, false if we hit end of the input.  May use
   // "*scratch" as temporary storage.  The contents filled in *record
   // will only be valid until the next mutating operation on this
-  // reader or the next mutation to *scratch.
+  // reader or the next mutation to *scratch.  Compressed records are
+  // returned uncompressed.
   //
   // 读取记录存储在 record 中，如果正确读取返回 true, 如果遇到文件结尾则返回 false
   // 读取过程中可能临时使用 scratch 缓冲区
@@ -73,6 +84,15 @@ class Reader {
   // 调用 ReadRecord 之前获取 LastRecordOffset 会导致未定义行为
   uint64_t LastRecordOffset();
 
+  // Returns the compression of the records after the last one returned,
+  // as set by the last kSetCompressionType record read.
+  CompressionType compression() const { return compression_; }
+
+  // Returns true if a record of the recyclable types was seen.  Such a log
+  // may hold leftover records past its end, so it cannot be appended to.
+  // A bad record there is taken as the end of the log, not reported.
+  bool recyclable() const { return recyclable_; }
+
  private:
   // Extend record types with the following special values
   enum {
@@ -94,6 +114,12 @@ class Reader {
   // 成功返回 true，内部会上报数据损坏
   bool SkipToInitialBlock();
 
+  // Reads the next record as it was written, i.e. possibly compressed.
+  bool ReadRawRecord(Slice* record, std::string* scratch);
+
+  // Handles the payload of a kSetCompressionType record.
+  void SetCompression(const Slice& payload);
+
   // Return type, or one of the preceding special values
   // 返回记录的类型，包括 kEof 和 kBadRecord 等前面定义的特殊值
   unsigned int ReadPhysicalRecord(Slice* result);
@@ -130,6 +156,17 @@ class Reader {
   // particular, a run of kMiddleType and kLastType records can be silently
   // skipped in this mode
   bool resyncing_;
+
+  // Low 32 bits of the log number, as stored in recyclable records.
+  uint32_t const log_number_;
+  bool recyclable_;
+
+  CompressionType compression_;
+  // Null if records are not compressed, or if a record was dropped since
+  // the last kSetCompressionType record, so that the zstd stream cannot
+  // be followed any more.
+  port::ZstdDecompressionStream* decompressor_;
+  std::string uncompressed_;  // Contents of the last compressed record
 };
 
 }  // namespace log
@@ -6,6 +6,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/random.h"
@@ -36,6 +37,21 @@ static std::string RandomSkewedString(int i, Random* rnd) {
   return BigString(NumberString(i), rnd->Skewed(17));
 }
 
+// Return a string of "n" random bytes, which zstd cannot compress
+static std::string RandomBytes(size_t n, Random* rnd) {
+  std::string result(n, '\0');
+  for (size_t i = 0; i < n; i++) {
+    result[i] = static_cast<char>(rnd->Uniform(256));
+  }
+  return result;
+}
+
+static bool ZstdStreamSupported() {
+  port::ZstdCompressionStream stream(1);
+  std::string output;
+  return stream.Compress("x", 1, &output);
+}
+
 class LogTest : public testing::Test {
  public:
   LogTest()
@@ -49,9 +65,27 @@ class LogTest : public testing::Test {
     delete reader_;
   }
 
-  void ReopenForAppend() {
+  void ReopenForAppend(CompressionType compression = kNoCompression) {
     delete writer_;
-    writer_ = new Writer(&dest_, dest_.contents_.size());
+    writer_ = new Writer(&dest_, dest_.contents_.size(), compression);
+  }
+
+  CompressionType ReaderCompression() const { return reader_->compression(); }
+
+  bool ReaderRecyclable() const { return reader_->recyclable(); }
+
+  // Start writing a log with recyclable records tagged "log_number" over
+  // what has been written so far, like a recycled log file.
+  void RecycleLog(uint64_t log_number,
+                  CompressionType compression = kNoCompression) {
+    ASSERT_TRUE(!reading_) << "RecycleLog() after starting to read";
+    leftovers_ = dest_.contents_;
+    dest_.contents_.clear();
+    delete writer_;
+    writer_ = new Writer(&dest_, compression, 1, log_number);
+    delete reader_;
+    reader_ = new Reader(&source_, &report_, true /*checksum*/,
+                         0 /*initial_offset*/, log_number);
   }
 
   void Write(const std::string& msg) {
@@ -64,6 +98,10 @@ class LogTest : public testing::Test {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (dest_.contents_.size() < leftovers_.size()) {
+        dest_.contents_.append(leftovers_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
@@ -228,6 +266,7 @@ class LogTest : public testing::Test {
   static int num_initial_offset_records_;
 
   StringDest dest_;
+  std::string leftovers_;  // Contents of the log before RecycleLog()
   StringSource source_;
   ReportCollector report_;
   bool reading_;
@@ -361,6 +400,141 @@ TEST_F(LogTest, RandomRead) {
   ASSERT_EQ("EOF", Read());
 }
 
+TEST_F(LogTest, CompressedRandomRead) {
+  ReopenForAppend(kZstdCompression);
+  const int N = 500;
+  size_t raw_bytes = 0;
+  Random write_rnd(301);
+  for (int i = 0; i < N; i++) {
+    std::string record = RandomSkewedString(i, &write_rnd);
+    raw_bytes += kHeaderSize + record.size();
+    Write(record);
+  }
+  if (ZstdStreamSupported()) {
+    ASSERT_LT(WrittenBytes(), raw_bytes / 10);
+  }
+  Random read_rnd(301);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(RandomSkewedString(i, &read_rnd), Read());
+  }
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, CompressedOpenForAppend) {
+  ReopenForAppend(kZstdCompression);
+  Write("hello");
+  Write("hello");
+  ReopenForAppend(kZstdCompression);
+  Write("world");
+  Write(BigString("world", 3 * kBlockSize));
+  ASSERT_EQ("hello", Read());
+  ASSERT_EQ("hello", Read());
+  ASSERT_EQ("world", Read());
+  ASSERT_EQ(BigString("world", 3 * kBlockSize), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+  if (ZstdStreamSupported()) {
+    ASSERT_EQ(kZstdCompression, ReaderCompression());
+  }
+}
+
+TEST_F(LogTest, SetCompressionAtEndOfBlock) {
+  // Leave exactly kHeaderSize bytes in the first block, too few for the
+  // kSetCompressionType record.
+  const std::string first = BigString("foo", kBlockSize - 2 * kHeaderSize);
+  Write(first);
+  ASSERT_EQ(kBlockSize - kHeaderSize, WrittenBytes());
+  ReopenForAppend(kZstdCompression);
+  Write("bar");
+  ASSERT_EQ(first, Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, RecyclableRecords) {
+  RecycleLog(7);
+  Write("foo");
+  ASSERT_EQ(kRecyclableHeaderSize + 3, WrittenBytes());
+  Write(BigString("bar", 3 * kBlockSize));
+  Write("");
+  Write("xxxx");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", 3 * kBlockSize), Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("xxxx", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, RecyclableTrailer) {
+  // Leave ten bytes in the first block, too few for a recyclable header.
+  RecycleLog(7);
+  const int n = kBlockSize - 2 * kRecyclableHeaderSize + 1;
+  Write(BigString("foo", n));
+  ASSERT_EQ(kBlockSize - kRecyclableHeaderSize + 1, WrittenBytes());
+  Write("bar");
+  ASSERT_EQ(kBlockSize + kRecyclableHeaderSize + 3, WrittenBytes());
+  ASSERT_EQ(BigString("foo", n), Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, RecycledLogEndsAtLeftovers) {
+  RecycleLog(1);
+  Random write_rnd(301);
+  for (int i = 0; i < 50; i++) {
+    Write(RandomSkewedString(i, &write_rnd));
+  }
+  // The new records end in the middle of an old one.
+  RecycleLog(2);
+  for (int i = 50; i < 60; i++) {
+    Write(RandomSkewedString(i, &write_rnd));
+  }
+  Random read_rnd(301);
+  for (int i = 0; i < 50; i++) {
+    RandomSkewedString(i, &read_rnd);
+  }
+  for (int i = 50; i < 60; i++) {
+    ASSERT_EQ(RandomSkewedString(i, &read_rnd), Read());
+  }
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+  ASSERT_TRUE(ReaderRecyclable());
+}
+
+TEST_F(LogTest, RecycledLogWithoutRecords) {
+  RecycleLog(1);
+  Write("foo");
+  Write("bar");
+  RecycleLog(2);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+  ASSERT_TRUE(ReaderRecyclable());
+}
+
+TEST_F(LogTest, RecycledCompressedLog) {
+  RecycleLog(1, kZstdCompression);
+  Write("foo");
+  RecycleLog(2, kZstdCompression);
+  Write("bar");
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, RecycledLogIgnoresLeftoverSetCompression) {
+  // The leftovers start with the compression record of the first use.
+  RecycleLog(1, kZstdCompression);
+  Write("foo");
+  RecycleLog(2);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("", ReportMessage());
+  ASSERT_EQ(kNoCompression, ReaderCompression());
+}
+
 // Tests of all the error paths in log_reader.cc follow:
 
 TEST_F(LogTest, ReadError) {
@@ -417,6 +591,23 @@ TEST_F(LogTest, ChecksumMismatch) {
   ASSERT_EQ("OK", MatchError("checksum mismatch"));
 }
 
+TEST_F(LogTest, CompressedRecordsAfterDropAreReported) {
+  if (!ZstdStreamSupported()) {
+    GTEST_SKIP() << "skipping compressed log test: no zstd";
+  }
+  ReopenForAppend(kZstdCompression);
+  Random rnd(301);
+  Write(RandomBytes(40000, &rnd));
+  Write(RandomBytes(40000, &rnd));
+  Write("foo");
+  // Drop the second block, which holds the end of the first record and
+  // the start of the second.  "foo" may refer back to either of them.
+  IncrementByte(kBlockSize + 100, 1);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+  ASSERT_EQ("OK", MatchError("missing start of compressed records"));
+}
+
 TEST_F(LogTest, UnexpectedMiddleType) {
   Write("foo");
   SetByte(6, kMiddleType);
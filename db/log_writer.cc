@@ -7,6 +7,7 @@
 #include <cstdint>
 
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -20,20 +21,107 @@ static void InitTypeCrc(uint32_t* type_crc) {
   }
 }
 
-Writer::Writer(WritableFile* dest) : dest_(dest), block_offset_(0) {
+// Zeros to fill the trailer of a block with.
+static const char kPadding[kRecyclableHeaderSize] = {};
+
+static port::ZstdCompressionStream* NewCompressor(CompressionType type,
+                                                  int level) {
+  if (type != kZstdCompression) {
+    return nullptr;
+  }
+  return new port::ZstdCompressionStream(level);
+}
+
+Writer::Writer(WritableFile* dest, CompressionType compression,
+               int compression_level, uint64_t log_number,
+               bool manual_flush)
+    : dest_(dest),
+      block_offset_(0),
+      log_number_(static_cast<uint32_t>(log_number)),
+      header_size_(log_number != 0 ? kRecyclableHeaderSize : kHeaderSize),
+      manual_flush_(manual_flush),
+      compression_level_(compression_level),
+      compressor_(NewCompressor(compression, compression_level)),
+      need_announcement_(compressor_ != nullptr) {
   InitTypeCrc(type_crc_);
 }
 
-Writer::Writer(WritableFile* dest, uint64_t dest_length)
-    : dest_(dest), block_offset_(dest_length % kBlockSize) {
+Writer::Writer(WritableFile* dest, uint64_t dest_length,
+               CompressionType compression, int compression_level,
+               uint64_t log_number, bool manual_flush)
+    : dest_(dest),
+      block_offset_(dest_length % kBlockSize),
+      log_number_(static_cast<uint32_t>(log_number)),
+      header_size_(log_number != 0 ? kRecyclableHeaderSize : kHeaderSize),
+      manual_flush_(manual_flush),
+      compression_level_(compression_level),
+      compressor_(NewCompressor(compression, compression_level)),
+      need_announcement_(compressor_ != nullptr) {
   InitTypeCrc(type_crc_);
 }
 
-Writer::~Writer() = default;
+Writer::~Writer() { delete compressor_; }
 
 Status Writer::AddRecord(const Slice& slice) {
-  const char* ptr = slice.data();
-  size_t left = slice.size(); // left 表示还有多少用户数据需要写入
+  Slice record = slice;
+  if (compressor_ != nullptr) {
+    compressed_.clear();
+    if (compressor_->Compress(slice.data(), slice.size(), &compressed_)) {
+      record = compressed_;
+    } else {
+      // Write this record and all later ones uncompressed.
+      delete compressor_;
+      compressor_ = nullptr;
+      need_announcement_ = true;
+    }
+  }
+
+  Status s;
+  if (need_announcement_) {
+    s = EmitSetCompression(compressor_ != nullptr ? kZstdCompression
+                                                  : kNoCompression);
+    need_announcement_ = !s.ok();
+  }
+  if (s.ok()) {
+    s = EmitRecord(record.data(), record.size());
+  }
+  if (!s.ok() && compressor_ != nullptr) {
+    // The record may be missing from the log, so the records after it
+    // must not refer back to it: start a new stream.
+    delete compressor_;
+    compressor_ = new port::ZstdCompressionStream(compression_level_);
+    need_announcement_ = true;
+  }
+  return s;
+}
+
+Status Writer::EmitSetCompression(CompressionType type) {
+  const char payload = static_cast<char>(type);
+  // A recycled log tags this record with its log number too, so that the
+  // one left over from an earlier use of the file is not taken for it.
+  const RecordType t =
+      log_number_ != 0 ? kRecyclableSetCompressionType : kSetCompressionType;
+  const int header_size =
+      log_number_ != 0 ? kRecyclableHeaderSize : kHeaderSize;
+  // Unlike other records, this one is never fragmented.
+  const int leftover = kBlockSize - block_offset_;
+  assert(leftover >= 0);
+  if (leftover < header_size + 1) {
+    if (leftover > 0) {
+      // Zero bytes read as an empty kZeroType record, which the reader
+      // skips like a trailer.
+      Status s = dest_->Append(Slice(kPadding, leftover));
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    block_offset_ = 0;
+  }
+  return EmitPhysicalRecord(t, &payload, 1);
+}
+
+Status Writer::EmitRecord(const char* ptr, size_t length) {
+  size_t left = length; // left 表示还有多少用户数据需要写入
 
   // Fragment the record if necessary and emit it.  Note that if slice
   // is empty, we still want to iterate once to emit a single
@@ -44,24 +132,23 @@ Status Writer::AddRecord(const Slice& slice) {
   do {
     const int leftover = kBlockSize - block_offset_; // 计算 Block 中剩余的空间
     assert(leftover >= 0);
-    if (leftover < kHeaderSize) { // 小于 7 个字节，放不下一个 record, 将其填充
+    if (leftover < header_size_) { // 放不下一个 record header, 将其填充
       // Switch to a new block
       if (leftover > 0) {
-        // Fill the trailer (literal below relies on kHeaderSize being 7)
-        static_assert(kHeaderSize == 7, "");
+        // Fill the trailer
         // 填充 0 值
-        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00", leftover));
+        dest_->Append(Slice(kPadding, leftover));
       }
       // 切换到新的 block, 重置 block_offset_
       block_offset_ = 0;
     }
 
-    // Invariant: we never leave < kHeaderSize bytes in a block.
-    // assert: 当前 block 剩余空间大于等于 7 字节
-    assert(kBlockSize - block_offset_ - kHeaderSize >= 0);
+    // Invariant: we never leave < header_size_ bytes in a block.
+    // assert: 当前 block 剩余空间大于等于 header_size_ 字节
+    assert(kBlockSize - block_offset_ - header_size_ >= 0);
   
     // 计算 Block 中剩余多少空间可以存储用户数据
-    const size_t avail = kBlockSize - block_offset_ - kHeaderSize; 
+    const size_t avail = kBlockSize - block_offset_ - header_size_;
     // 判断是否需要分成多个片段，以及当前分段的大小
     const size_t fragment_length = (left < avail) ? left : avail;
 
@@ -77,6 +164,9 @@ Status Writer::AddRecord(const Slice& slice) {
     } else {
       type = kMiddleType;
     }
+    if (log_number_ != 0) {
+      type = static_cast<RecordType>(type - kFullType + kRecyclableFullType);
+    }
     // EmitPhysicalRecord 实际写入 Record 
     s = EmitPhysicalRecord(type, ptr, fragment_length);
     ptr += fragment_length;
@@ -88,33 +178,41 @@ Status Writer::AddRecord(const Slice& slice) {
 
 Status Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
                                   size_t length) {
+  const int header_size =
+      t >= kRecyclableFullType ? kRecyclableHeaderSize : kHeaderSize;
   assert(length <= 0xffff);  // Must fit in two bytes
-  assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+  assert(block_offset_ + header_size + length <= kBlockSize);
 
   // 编码 length 和 type
   // Format the header
-  char buf[kHeaderSize];
+  char buf[kRecyclableHeaderSize];
   buf[4] = static_cast<char>(length & 0xff);
   buf[5] = static_cast<char>(length >> 8);
   buf[6] = static_cast<char>(t);
 
   // 计算 CRC 校验和
-  // Compute the crc of the record type and the payload.
-  uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+  // Compute the crc of the record type, the log number if any, and the
+  // payload.
+  uint32_t crc = type_crc_[t];
+  if (header_size == kRecyclableHeaderSize) {
+    EncodeFixed32(buf + kHeaderSize, log_number_);
+    crc = crc32c::Extend(crc, buf + kHeaderSize, 4);
+  }
+  crc = crc32c::Extend(crc, ptr, length);
   crc = crc32c::Mask(crc);  // Adjust for storage
   EncodeFixed32(buf, crc); // 编码为 uint32
 
   // 写入 header 和数据
   // Write the header and the payload
-  Status s = dest_->Append(Slice(buf, kHeaderSize));
+  Status s = dest_->Append(Slice(buf, header_size));
   if (s.ok()) {
     s = dest_->Append(Slice(ptr, length));
-    if (s.ok()) {
+    if (s.ok() && !manual_flush_) {
       s = dest_->Flush();
     }
   }
   // 更新 block_offset
-  block_offset_ += kHeaderSize + length;
+  block_offset_ += header_size + length;
   return s;
 }
 
@@ -6,8 +6,10 @@
 #define STORAGE_LEVELDB_DB_LOG_WRITER_H_
 
 #include <cstdint>
+#include <string>
 
 #include "db/log_format.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
@@ -15,6 +17,10 @@ namespace leveldb {
 
 class WritableFile;
 
+namespace port {
+class ZstdCompressionStream;
+}  // namespace port
+
 namespace log {
 
 class Writer {
@@ -23,13 +29,29 @@ class Writer {
   // "*dest" must be initially empty.
   // "*dest" must remain live while this Writer is in use.
   // 创建一个向 *dest 追加数据 writer，dest 初始状态必须是空白的，在使用期间 dest 不能关闭
-  explicit Writer(WritableFile* dest);
+  //
+  // If "compression" is kZstdCompression, records are compressed at
+  // "compression_level" as one zstd stream.  Other types are ignored.
+  //
+  // If "log_number" is non-zero, records are written with the recyclable
+  // record types, tagged with it.  "*dest" may then hold records of an
+  // earlier use of the file past the ones written here.
+  //
+  // If "manual_flush" is true, records are left in the buffer of "*dest"
+  // until the caller flushes it, instead of being flushed one by one.
+  explicit Writer(WritableFile* dest,
+                  CompressionType compression = kNoCompression,
+                  int compression_level = 1, uint64_t log_number = 0,
+                  bool manual_flush = false);
 
   // Create a writer that will append data to "*dest".
   // "*dest" must have initial length "dest_length".
   // "*dest" must remain live while this Writer is in use.
   // 创建一个向 *dest 追加数据 writer，dest 必须提前分配好长度为 dest_length 空间
-  Writer(WritableFile* dest, uint64_t dest_length);
+  Writer(WritableFile* dest, uint64_t dest_length,
+         CompressionType compression = kNoCompression,
+         int compression_level = 1, uint64_t log_number = 0,
+         bool manual_flush = false);
 
   Writer(const Writer&) = delete;
   Writer& operator=(const Writer&) = delete;
@@ -40,17 +62,32 @@ class Writer {
   Status AddRecord(const Slice& slice);
 
  private:
+  // Writes "ptr[0,length-1]" as one record, fragmented as needed.
+  Status EmitRecord(const char* ptr, size_t length);
   Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
+  // Writes a kSetCompressionType record announcing "type".
+  Status EmitSetCompression(CompressionType type);
 
   WritableFile* dest_;
   // 记录当前 block 写入了多少字节
   int block_offset_;  // Current offset in block
+  const uint32_t log_number_;  // Zero unless the log is recyclable
+  const int header_size_;      // Header size of the data records
+  const bool manual_flush_;
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
   // record type stored in the header.
   // 由于 type 数量是有限的，提前算好 crc 来减少开销
   uint32_t type_crc_[kMaxRecordType + 1];
+
+  const int compression_level_;
+  // Null unless records are compressed.
+  port::ZstdCompressionStream* compressor_;
+  // True if the next record must be preceded by a kSetCompressionType
+  // record, because the reader does not know the current compression yet.
+  bool need_announcement_;
+  std::string compressed_;  // Compressed form of the current record
 };
 
 }  // namespace log
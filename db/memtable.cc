@@ -18,10 +18,18 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
-
-MemTable::~MemTable() { assert(refs_ == 0); }
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   uint32_t bloom_bits)
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      bloom_(bloom_bits > 0 ? new DynamicBloom(&arena_, bloom_bits)
+                            : nullptr) {}
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete bloom_;
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
@@ -102,10 +110,18 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
+  // The key is in the filter before readers can find it in the skiplist
+  if (bloom_ != nullptr) {
+    bloom_->Add(key);
+  }
   table_.Insert(buf); // 将键值对插入跳表中
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+  // 布隆过滤器判断 key 不存在时跳过跳表搜索
+  if (bloom_ != nullptr && !bloom_->MayContain(key.user_key())) {
+    return false;
+  }
   Slice memkey = key.memtable_key(); // memtable_key 由 user_key + sequence 组成
   Table::Iterator iter(&table_);
   // seek 底层是 SkipList::FindGreaterOrEqual，即第一个 key >= memkey 的元素
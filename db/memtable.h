@@ -11,6 +11,7 @@
 #include "db/skiplist.h"
 #include "leveldb/db.h"
 #include "util/arena.h"
+#include "util/dynamic_bloom.h"
 
 namespace leveldb {
 
@@ -25,7 +26,12 @@ class MemTable {
   // InternalKey 是由 UserKey（就是用户 set 的那个 key）+ SequenceNumber + ValueType 三部分组合而成的
   // LevelDB 通过维护一个全局的自增的 SequenceNumber 来实现快照机制，详情参考 dbformat.h 中的 SequenceNumber 类型
   // InternalKeyComparator 定义跳表中 key 的顺序，首先根据 user_key 升序排列然后根据 sequence 降序排列
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // If "bloom_bits" is non-zero, the memtable keeps a Bloom filter of that
+  // many bits over the user keys added to it, so that Get() of a key that
+  // was never added usually skips the skiplist search.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    uint32_t bloom_bits = 0);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -93,6 +99,7 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  DynamicBloom* bloom_;  // Null if the memtable has no Bloom filter
 };
 
 }  // namespace leveldb
@@ -0,0 +1,122 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// The entries are stored as internal keys with sequence number 0, the
+// way the database's own tables store them.  DB::IngestExternalFile()
+// gives them a newer sequence number when they overlap existing data.
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& opt)
+      : internal_comparator(opt.comparator),
+        internal_filter_policy(opt.filter_policy, opt.prefix_extractor),
+        options(opt),
+        file(nullptr),
+        builder(nullptr),
+        file_size(0),
+        finished(false) {
+    options.comparator = &internal_comparator;
+    if (opt.filter_policy != nullptr) {
+      options.filter_policy = &internal_filter_policy;
+    }
+  }
+
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  Options options;  // options.comparator == &internal_comparator
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // User key of the last entry added
+  std::string ikey;      // Scratch space for internal keys
+  uint64_t file_size;    // Size of the file once the builder is done
+  bool finished;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    rep_->builder->Abandon();
+    delete rep_->builder;
+  }
+  if (rep_->file != nullptr) {
+    delete rep_->file;
+    if (!rep_->finished) {
+      rep_->options.env->RemoveFile(rep_->fname);
+    }
+  }
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  assert(r->file == nullptr);
+  Status s = r->options.env->NewWritableFile(fname, &r->file);
+  if (s.ok()) {
+    r->fname = fname;
+    r->builder = new TableBuilder(r->options, r->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  assert(r->builder != nullptr);
+  if (r->builder->NumEntries() > 0 &&
+      r->internal_comparator.user_comparator()->Compare(key, r->last_key) <=
+          0) {
+    return Status::InvalidArgument("keys must be added in increasing order");
+  }
+  r->last_key.assign(key.data(), key.size());
+  r->ikey.clear();
+  const ValueType type = deletion ? kTypeDeletion : kTypeValue;
+  AppendInternalKey(&r->ikey, ParsedInternalKey(key, 0, type));
+  r->builder->Add(r->ikey, value);
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  assert(r->builder != nullptr);
+  if (r->builder->NumEntries() == 0) {
+    return Status::InvalidArgument("cannot finish a table without entries");
+  }
+  Status s = r->builder->Finish();
+  r->file_size = r->builder->FileSize();
+  delete r->builder;
+  r->builder = nullptr;
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  r->finished = s.ok();
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder == nullptr ? rep_->file_size
+                                  : rep_->builder->FileSize();
+}
+
+}  // namespace leveldb
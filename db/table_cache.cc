@@ -29,17 +29,46 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+// An entry of the row cache holds the newest entry of a user key in a
+// table: the internal key, prefixed with its varint32 length, followed by
+// the value.  An empty row means that the table holds no entry for the
+// user key.
+// 行缓存中保存某个 user key 在 table 中最新的一条记录
+struct RowSaver {
+  const Comparator* ucmp;
+  Slice user_key;
+  std::string* row;
+};
+
+static void SaveRow(void* arg, const Slice& ikey, const Slice& v) {
+  RowSaver* saver = reinterpret_cast<RowSaver*>(arg);
+  if (ikey.size() >= 8 &&
+      saver->ucmp->Compare(ExtractUserKey(ikey), saver->user_key) == 0) {
+    PutLengthPrefixedSlice(saver->row, ikey);
+    saver->row->append(v.data(), v.size());
+  }
+}
+
+static void DeleteRow(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// Entries of the table cache are charged 1 each, so the default shard
+// count, which is chosen for caches measured in bytes, does not apply.
+static const int kTableCacheShardBits = 4;
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(NewLRUCache(entries, 0, kTableCacheShardBits)),
+      row_cache_id_(options.row_cache ? options.row_cache->NewId() : 0) {}
 
 TableCache::~TableCache() { delete cache_; }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             int level, Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -59,6 +88,15 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     if (s.ok()) {
       s = Table::Open(options_, file, file_size, &table);
     }
+    if (s.ok()) {
+      table->SetFileNumber(file_number);
+    }
+    // level 0 的 table 几乎每次读取都会访问
+    // 将其 index 和 filter 固定在 block cache 中
+    if (s.ok() && level == 0 && options_.cache_index_and_filter_blocks &&
+        options_.pin_l0_filter_and_index_blocks_in_cache) {
+      table->PinMetaBlocks();
+    }
 
     if (!s.ok()) {
       assert(table == nullptr);
@@ -77,13 +115,13 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr, int level) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
@@ -98,11 +136,21 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 }
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint64_t file_size, int level, const Slice& k,
+                       void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&)) {
+  if (options_.row_cache != nullptr) {
+    bool answered;
+    Status s = GetFromRowCache(options, file_number, file_size, level, k, arg,
+                               handle_result, &answered);
+    if (!s.ok() || answered) {
+      return s;
+    }
+  }
+
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     s = t->InternalGet(options, k, arg, handle_result);
@@ -111,6 +159,94 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
   return s;
 }
 
+Status TableCache::GetFromRowCache(const ReadOptions& options,
+                                   uint64_t file_number, uint64_t file_size,
+                                   int level, const Slice& k, void* arg,
+                                   void (*handle_result)(void*, const Slice&,
+                                                         const Slice&),
+                                   bool* answered) {
+  *answered = true;
+  Cache* row_cache = options_.row_cache;
+  const Slice user_key = ExtractUserKey(k);
+  std::string row_key;
+  PutFixed64(&row_key, row_cache_id_);
+  PutFixed64(&row_key, file_number);
+  row_key.append(user_key.data(), user_key.size());
+
+  Status s;
+  std::string fetched;
+  const std::string* row;
+  Cache::Handle* row_handle = row_cache->Lookup(row_key);
+  if (row_handle != nullptr) {
+    row = reinterpret_cast<std::string*>(row_cache->Value(row_handle));
+  } else {
+    // Seeking to the largest sequence number finds the newest entry,
+    // which answers every read that is not limited by an older snapshot.
+    Cache::Handle* handle = nullptr;
+    s = FindTable(file_number, file_size, level, &handle);
+    if (!s.ok()) {
+      return s;
+    }
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    InternalKey newest(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+    const InternalKeyComparator* icmp =
+        reinterpret_cast<const InternalKeyComparator*>(options_.comparator);
+    RowSaver saver;
+    saver.ucmp = icmp->user_comparator();
+    saver.user_key = user_key;
+    saver.row = &fetched;
+    s = t->InternalGet(options, newest.Encode(), &saver, &SaveRow);
+    cache_->Release(handle);
+    if (!s.ok()) {
+      return s;
+    }
+    // Misses are not cached: a lookup probes every file that may hold the
+    // key, and only the file that answers it is worth a row.  The filter
+    // already makes a miss cheap.
+    if (options.fill_cache && !fetched.empty()) {
+      std::string* value = new std::string(fetched);
+      row_handle = row_cache->Insert(row_key, value,
+                                     row_key.size() + value->size(),
+                                     &DeleteRow);
+      row = value;
+    } else {
+      row = &fetched;
+    }
+  }
+
+  Slice input(*row);
+  Slice found_key;
+  if (GetLengthPrefixedSlice(&input, &found_key)) {
+    ParsedInternalKey found, target;
+    if (ParseInternalKey(found_key, &found) && ParseInternalKey(k, &target) &&
+        found.sequence > target.sequence) {
+      *answered = false;  // A snapshot read that needs an older entry
+    } else {
+      (*handle_result)(arg, found_key, input);
+    }
+  }
+  if (row_handle != nullptr) {
+    row_cache->Release(row_handle);
+  }
+  return s;
+}
+
+bool TableCache::PrefixMayMatch(const ReadOptions& options,
+                                uint64_t file_number, uint64_t file_size,
+                                int level, const Slice& target,
+                                const Slice& user_prefix) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, level, &handle).ok()) {
+    return true;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  // The filter policy of the table strips the tag off probe keys
+  InternalKey probe(user_prefix, kMaxSequenceNumber, kValueTypeForSeek);
+  const bool result = t->PrefixMayMatch(options, target, probe.Encode());
+  cache_->Release(handle);
+  return result;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -35,25 +35,53 @@ class TableCache {
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // "level" is the level of the file, or -1 if it is not known.  It is
+  // only used when the file has to be opened.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, Table** tableptr = nullptr,
+                        int level = -1);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  With
+  // options.row_cache, the call is only made if the entry has the user
+  // key of "k", and it is usually answered from the row cache without
+  // opening the table.
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
+             uint64_t file_size, int level, const Slice& k, void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
+  // Returns false if the filter of the specified file shows that it holds
+  // no key at or after internal key "target" whose user key has the
+  // prefix "user_prefix" under options.prefix_extractor.  Errors are
+  // treated as potential matches.
+  bool PrefixMayMatch(const ReadOptions& options, uint64_t file_number,
+                      uint64_t file_size, int level, const Slice& target,
+                      const Slice& user_prefix);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
+
+  // Looks up the newest entry for the user key of "k" in the row cache,
+  // or in the table and then adds it to the row cache if it was found.
+  // Sets *answered to false if that entry is too new for the sequence
+  // number of "k", and the lookup has to go to the table.
+  Status GetFromRowCache(const ReadOptions& options, uint64_t file_number,
+                         uint64_t file_size, int level, const Slice& k,
+                         void* arg,
+                         void (*handle_result)(void*, const Slice&,
+                                               const Slice&),
+                         bool* answered);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  uint64_t row_cache_id_;  // Id of this table cache in options_.row_cache
 };
 
 }  // namespace leveldb
@@ -13,6 +13,7 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -226,12 +227,130 @@ Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
       vset_->table_cache_, options);
 }
 
+namespace {
+
+// Wraps the iterator over a single level-0 file or over a whole sorted
+// level.  A bounded Seek() to a key in the domain of the prefix extractor
+// first asks the filter of the file that would hold the target, and
+// leaves the iterator !Valid() without reading any data block if the
+// prefix of the target is ruled out.
+class PrefixSeekIterator : public Iterator {
+ public:
+  // "files" is a sorted level, or "l0_file" is the single level-0 file
+  // under "iter".
+  PrefixSeekIterator(Iterator* iter, const ReadOptions& options,
+                     TableCache* table_cache,
+                     const InternalKeyComparator& icmp,
+                     const SliceTransform* prefix_extractor,
+                     const PrefixSeekState* state, int level,
+                     const std::vector<FileMetaData*>* files,
+                     const FileMetaData* l0_file)
+      : iter_(iter),
+        options_(options),
+        table_cache_(table_cache),
+        icmp_(icmp),
+        prefix_extractor_(prefix_extractor),
+        state_(state),
+        level_(level),
+        files_(files),
+        l0_file_(l0_file),
+        filtered_(false) {}
+
+  ~PrefixSeekIterator() override { delete iter_; }
+
+  bool Valid() const override { return !filtered_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    filtered_ = state_->bounded && !MayMatch(target);
+    if (!filtered_) {
+      iter_->Seek(target);
+    }
+  }
+  void SeekToFirst() override {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return iter_->key();
+  }
+  Slice value() const override {
+    assert(Valid());
+    return iter_->value();
+  }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  bool MayMatch(const Slice& target) {
+    Slice user_key = ExtractUserKey(target);
+    if (!prefix_extractor_->InDomain(user_key)) {
+      return true;
+    }
+    Slice prefix = prefix_extractor_->Transform(user_key);
+
+    const FileMetaData* f = l0_file_;
+    if (f == nullptr) {
+      size_t index = FindFile(icmp_, *files_, target);
+      if (index >= files_->size()) {
+        return true;  // Nothing to read anyway
+      }
+      f = (*files_)[index];
+      // The prefix may continue into the next file of the level
+      if (index + 1 < files_->size()) {
+        Slice next = (*files_)[index + 1]->smallest.user_key();
+        if (prefix_extractor_->InDomain(next) &&
+            prefix_extractor_->Transform(next) == prefix) {
+          return true;
+        }
+      }
+    } else if (icmp_.Compare(f->largest.Encode(), target) < 0) {
+      return true;
+    }
+    return table_cache_->PrefixMayMatch(options_, f->number, f->file_size,
+                                        level_, target, prefix);
+  }
+
+  Iterator* const iter_;
+  const ReadOptions options_;
+  TableCache* const table_cache_;
+  const InternalKeyComparator icmp_;
+  const SliceTransform* const prefix_extractor_;
+  const PrefixSeekState* const state_;
+  const int level_;
+  const std::vector<FileMetaData*>* const files_;
+  const FileMetaData* const l0_file_;
+  bool filtered_;  // Did the last Seek() skip the file(s)?
+};
+
+}  // namespace
+
 void Version::AddIterators(const ReadOptions& options,
-                           std::vector<Iterator*>* iters) {
+                           std::vector<Iterator*>* iters,
+                           const PrefixSeekState* prefix_state) {
+  const SliceTransform* prefix_extractor =
+      (prefix_state != nullptr) ? vset_->options_->prefix_extractor : nullptr;
+
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+    Iterator* iter = vset_->table_cache_->NewIterator(
+        options, files_[0][i]->number, files_[0][i]->file_size, nullptr, 0);
+    if (prefix_extractor != nullptr) {
+      iter = new PrefixSeekIterator(iter, options, vset_->table_cache_,
+                                    vset_->icmp_, prefix_extractor,
+                                    prefix_state, 0, nullptr, files_[0][i]);
+    }
+    iters->push_back(iter);
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -239,7 +358,14 @@ void Version::AddIterators(const ReadOptions& options,
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
     if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+      Iterator* iter = NewConcatenatingIterator(options, level);
+      if (prefix_extractor != nullptr) {
+        iter = new PrefixSeekIterator(iter, options, vset_->table_cache_,
+                                      vset_->icmp_, prefix_extractor,
+                                      prefix_state, level, &files_[level],
+                                      nullptr);
+      }
+      iters->push_back(iter);
     }
   }
 }
@@ -351,9 +477,9 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, level, state->ikey,
+          &state->saver, SaveValue);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -1104,7 +1230,7 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
+              static_cast<double>(options_->level0_compaction_trigger);
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
@@ -1314,8 +1440,8 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) { // level == 0 && which == 0
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewIterator(
+              options, files[i]->number, files[i]->file_size, nullptr, 0);
         }
       } else {
         // Create concatenating iterator for the files from this level
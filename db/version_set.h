@@ -65,6 +65,14 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
                            const Slice* smallest_user_key,
                            const Slice* largest_user_key);
 
+// Shared by a DB iterator created with ReadOptions::prefix_same_as_start
+// and the file iterators beneath it.  Files are only skipped by their
+// prefix filter while "bounded" is true, i.e. while the DB iterator stops
+// at the end of the prefix of its last Seek() target.
+struct PrefixSeekState {
+  bool bounded = false;
+};
+
 // Version 表示数据库的一个版本，Version 记录了各层的 sstable 以及 compaction 信息
 class Version {
  public:
@@ -76,7 +84,12 @@ class Version {
   // Append to *iters a sequence of iterators that will
   // yield the contents of this Version when merged together.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
-  void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
+  //
+  // If "prefix_state" is non-null, the iterators skip files whose prefix
+  // filter rules out the prefix of a Seek() target while
+  // prefix_state->bounded is true.
+  void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters,
+                    const PrefixSeekState* prefix_state = nullptr);
 
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
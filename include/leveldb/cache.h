@@ -19,6 +19,7 @@
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
@@ -28,9 +29,42 @@ namespace leveldb {
 class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a least-recently-used eviction policy with midpoint
+// insertion: a new entry is evicted before any entry that was looked up
+// since it was inserted, so a scan that fills the cache with blocks it
+// reads only once does not flush the working set.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but up to high_pri_pool_ratio * capacity of
+// the cache is set aside for entries inserted with Cache::kHighPriority.
+// Those entries are only evicted once no low-priority entry is left to
+// evict.  High-priority entries that do not fit in the pool are treated
+// like low-priority ones.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
+// Like NewLRUCache(capacity, high_pri_pool_ratio), but the cache is split
+// into 2^num_shard_bits shards, each with its own lock and an equal part of
+// the capacity.  A negative num_shard_bits, which the other versions use,
+// picks about two shards per core, but at most 64 and only as many as
+// keep 512KB of capacity per shard.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                                  int num_shard_bits);
+
+// Create a new cache with a fixed size capacity that uses CLOCK eviction
+// instead of LRU.  Lookup() and Release() do not take any lock, which
+// makes this cache scale better than NewLRUCache() when many threads read
+// cached blocks.  The hash table of the cache has a fixed number of slots,
+// sized so that the cache can hold capacity / estimated_entry_charge
+// entries.  If entries are much smaller than that on average, the cache
+// holds fewer entries than its capacity allows.  Entries inserted with
+// Cache::kHighPriority survive longer than others.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                    size_t estimated_entry_charge);
+
+// Like NewClockCache(capacity, 4096), which suits a block cache for the
+// default block size.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +79,9 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // Eviction priority of an entry, see NewLRUCache().
+  enum Priority { kLowPriority, kHighPriority };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +94,14 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but with a hint about how long the entry should
+  // be kept.  The default implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -96,6 +141,23 @@ class LEVELDB_EXPORT Cache {
   // Return an estimate of the combined charges of all elements stored in the
   // cache.
   virtual size_t TotalCharge() const = 0;
+
+  // Counters of one shard of a cache, see GetShardStats().
+  struct ShardStats {
+    size_t capacity = 0;
+    size_t usage = 0;     // Combined charge of the entries of the shard
+    uint64_t lookups = 0;
+    uint64_t hits = 0;    // Lookups that found an entry
+    uint64_t inserts = 0;
+    uint64_t evictions = 0;  // Entries dropped to stay within capacity
+    uint64_t lock_waits = 0;  // Operations that found the lock held
+    uint64_t lock_wait_nanos = 0;  // Time spent waiting for the lock
+  };
+
+  // Store the counters of each shard of the cache in *stats.  Caches that
+  // do not keep such counters, like the default implementation, leave
+  // *stats empty.
+  virtual void GetShardStats(std::vector<ShardStats>* stats) const;
 };
 
 }  // namespace leveldb
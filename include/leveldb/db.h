@@ -77,6 +77,31 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Write the log records buffered under options.manual_wal_flush to the
+  // log file, and if "sync" is true, sync the log file as well.  Returns
+  // OK on success, non-OK on failure.
+  virtual Status FlushWAL(bool sync) = 0;
+
+  // Write the contents of the memtable to a level-0 table and record the
+  // new table in the (synced) MANIFEST.  Once this returns OK, writes made
+  // with WriteOptions::disable_wal survive a crash.
+  virtual Status Flush() = 0;
+
+  // Add the table file "fname", written by SstFileWriter with the options
+  // of this database, without going through the log and the memtable.
+  // Its entries hide any older entries for the same keys.  The file is
+  // hard-linked into the database, or copied if it cannot be linked, and
+  // deleted once the database has recorded it.  Returns OK on success,
+  // non-OK on failure, in which case the database and "fname" are
+  // unchanged.
+  //
+  // The file goes to the deepest level that has no data in its key range
+  // above it, so a bulk load of non-overlapping files is written once.
+  // Its entries are not visible to snapshots taken before the call.
+  // Only its first and last entries are checked before it is added,
+  // unless options.paranoid_checks asks to read and verify all of them.
+  virtual Status IngestExternalFile(const std::string& fname) = 0;
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -121,6 +146,13 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.compression-stats" - returns a multi-line string with the
+  //     number of data blocks written to each level that were compressed,
+  //     stored uncompressed because compression saved too little, and
+  //     not compressed because Options::adaptive_compression skipped them.
+  //  "leveldb.block-cache-shard-stats" - returns a multi-line string with
+  //     the lookup, hit, insert, eviction and lock wait counters of each
+  //     shard of the block cache, see Cache::GetShardStats().
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -43,6 +43,14 @@ class LEVELDB_EXPORT FilterPolicy {
   virtual void CreateFilter(const Slice* keys, int n,
                             std::string* dst) const = 0;
 
+  // Like CreateFilter(), for a table that will be stored in "level" of
+  // the database, or -1 if the level is not known.  Policies may use it
+  // to choose a different filter format per level; KeyMayMatch() must
+  // accept filters built for any level.  The default implementation
+  // ignores the level.
+  virtual void CreateFilterForLevel(int level, const Slice* keys, int n,
+                                    std::string* dst) const;
+
   // "filter" contains the data appended by a preceding call to
   // CreateFilter() on this class.  This method must return true if
   // the key was in the list of keys passed to CreateFilter().
@@ -67,6 +75,46 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a blocked bloom filter: all the
+// bits probed for a key lie in the same 64-byte cache line, so a lookup
+// costs at most one cache miss instead of up to one per probe, in
+// exchange for a slightly higher false positive rate for the same
+// bits_per_key.  Probing is vectorized when built with AVX2.
+//
+// The filters are readable by policies returned from this function only.
+// They share the name of NewBloomFilterPolicy(), and the policy can still
+// read filters written by NewBloomFilterPolicy(), so existing databases can
+// switch to it.  Older versions of leveldb treat the new filters as
+// matching every key.
+//
+// The same rules as for NewBloomFilterPolicy() apply to the result.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses binary fuse filters, a relative of
+// XOR filters.  A fuse filter stores one short fingerprint per slot and
+// needs about 1.13 slots per key, which makes it about 17% smaller than a
+// bloom filter with the same false positive rate.  Building one is slower
+// than building a bloom filter and takes temporary memory proportional to
+// the number of keys.  Works best with Options::full_filter or
+// Options::partition_index_and_filters, which give it many keys per filter.
+//
+// bloom_equivalent_bits_per_key picks the false positive rate of
+// NewBloomFilterPolicy(bloom_equivalent_bits_per_key).  Tables written to
+// levels below bloom_before_level get blocked bloom filters instead (see
+// NewBlockedBloomFilterPolicy()): upper levels hold few keys and are
+// rewritten often, so they benefit less from smaller filters.  Use 0 for
+// fuse filters everywhere, or 6 to only use them in the last level, where
+// most keys live.
+//
+// The policy reads every filter written by NewBloomFilterPolicy() and
+// NewBlockedBloomFilterPolicy(), and shares their name.  Older versions of
+// leveldb treat fuse filters as matching every key.
+//
+// The same rules as for NewBloomFilterPolicy() apply to the result.
+LEVELDB_EXPORT const FilterPolicy* NewBinaryFuseFilterPolicy(
+    int bloom_equivalent_bits_per_key, int bloom_before_level = 0);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
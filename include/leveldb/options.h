@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -16,6 +17,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class PersistentCache;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -28,6 +31,7 @@ enum CompressionType {
   kNoCompression = 0x0,
   kSnappyCompression = 0x1,
   kZstdCompression = 0x2,
+  kLZ4Compression = 0x3,
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -82,6 +86,17 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // If positive, each memtable keeps a Bloom filter of the user keys
+  // written to it, sized as this fraction of write_buffer_size.  Gets of
+  // keys that are not in the memtable (or in the memtable being
+  // compacted) then usually skip its skiplist search.  The filter counts
+  // towards write_buffer_size.  0.01 to 0.02 works well for small values.
+  // Values above 0.25 are treated as 0.25.
+  //
+  // Like filter_policy, the filter assumes that keys which compare equal
+  // under the comparator are identical strings.
+  double memtable_bloom_size_ratio = 0;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -94,6 +109,45 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, blocks that are stored compressed are also kept, still
+  // compressed, in this cache.  A block_cache miss that hits here only
+  // pays for decompression instead of a file read, and the compressed
+  // form lets the same memory hold several times more blocks.  Charges
+  // are the compressed sizes.  The client owns the cache.
+  // 压缩块的二级缓存，在 block_cache 未命中时先于文件读取查询
+  Cache* compressed_block_cache = nullptr;
+
+  // If non-null, blocks are also kept in this cache of files on a fast
+  // local device (see leveldb/persistent_cache.h).  It is consulted after
+  // block_cache and compressed_block_cache and before the table file, and
+  // its contents survive a restart.  Blocks read from table files are
+  // added to it.  The client owns the cache, which must not be shared with
+  // another database.
+  PersistentCache* persistent_cache = nullptr;
+
+  // If non-null, use the specified cache for rows: the newest entry of a
+  // user key in a table, keyed by table file number and user key.  A Get
+  // of a key found in this cache does not touch the table, its filter or
+  // its blocks.  Charges are the key and value sizes.  This is most useful
+  // when a small set of hot keys takes most point lookups.  The client
+  // owns the cache.
+  // 行缓存，热点 key 的点查只需要一次哈希查找
+  Cache* row_cache = nullptr;
+
+  // If true, the index block and the filter of each table are stored in
+  // block_cache with Cache::kHighPriority and charged against its
+  // capacity, instead of being held by the open table until it is
+  // closed.  This bounds the memory used for metadata by the cache
+  // capacity, at the cost of re-reading evicted index and filter blocks.
+  // Create block_cache with NewLRUCache(capacity, high_pri_pool_ratio) to
+  // keep data blocks from evicting them.
+  bool cache_index_and_filter_blocks = false;
+
+  // If true and cache_index_and_filter_blocks is set, the index and filter
+  // blocks of level-0 tables stay pinned in block_cache while the table
+  // is open.  Level-0 tables are probed by nearly every read.
+  bool pin_l0_filter_and_index_blocks_in_cache = false;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -116,6 +170,13 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // Number of level-0 files that starts a compaction of level 0.  Writes
+  // are slowed down once 4 more files have accumulated, and stopped at 8
+  // more.  Every read merges all level-0 files, so raising this trades
+  // read speed for less compaction work.
+  // Most clients should leave this parameter alone.
+  int level0_compaction_trigger = 4;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -132,20 +193,152 @@ struct LEVELDB_EXPORT Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression = kSnappyCompression;
 
+  // If non-empty, the compression used for tables written to each level:
+  // tables of level L use compression_per_level[L], and levels past the
+  // end of the vector use its last entry.  For example
+  // {kNoCompression, kLZ4Compression, kZstdCompression} keeps flushes to
+  // level 0 cheap and spends more CPU on the deeper levels, where most of
+  // the data lives.  Memtables are compressed with the entry for level 0
+  // even when the table is placed in a deeper level.  Tables whose level
+  // is not known, e.g. those written by RepairDB, use "compression".
+  // This parameter can be changed dynamically.
+  //
+  // Default: empty, i.e. "compression" for every level.
+  std::vector<CompressionType> compression_per_level;
+
+  // If true, a table stops trying to compress its data blocks once several
+  // in a row have been stored uncompressed because compression saved less
+  // than 12.5%.  It then tries again on a single block every so often:
+  // after 16 skipped blocks, and after twice as many each time the try
+  // fails, up to 256.  Saves most of the compression CPU on values that
+  // are already compressed, such as images, at the cost of storing a few
+  // compressible blocks uncompressed when the data changes.  The
+  // "leveldb.compression-stats" property of the DB reports how many blocks
+  // are skipped.
+  bool adaptive_compression = false;
+
   // Compression level for zstd.
   // Currently only the range [-5,22] is supported. Default is 1.
   int zstd_compression_level = 1;
 
+  // If non-zero, each table compressed with kZstdCompression trains a
+  // zstd dictionary of up to this many bytes on its first data blocks
+  // (about 100 times the dictionary size) and compresses all its data
+  // blocks with it.  The dictionary is stored in the table.  Helps most
+  // when the data blocks are small and similar to each other, e.g. small
+  // JSON values; 16KB is a good starting point.  The sampled blocks are
+  // held in memory until the dictionary is trained.
+  //
+  // Tables written with this option cannot be opened by leveldb versions
+  // that do not support zstd dictionaries.
+  size_t zstd_dictionary_size = 0;
+
+  // Number of threads that compress the data blocks of a table while it is
+  // being written.  With 1, blocks are compressed inline by the thread
+  // that builds the table.  With more, each table builder starts this many
+  // worker threads that compress full data blocks while the builder keeps
+  // adding keys; blocks are still written in order, so the table is the
+  // same as with 1.  Worth raising when compaction is bound by compression,
+  // e.g. with a high zstd_compression_level.
+  int compression_parallel_threads = 1;
+
+  // Compress the records of the write-ahead log with this algorithm.  Only
+  // kZstdCompression is supported, at zstd_compression_level; any other
+  // value leaves the log uncompressed.  The records of a log file form
+  // one zstd stream, so small writes benefit from the ones before them,
+  // and large ones cost less log I/O and less time in each sync.
+  //
+  // Log files written with this option cannot be recovered by leveldb
+  // versions that do not support compressed logs.
+  CompressionType wal_compression = kNoCompression;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If non-zero, up to this many obsolete log files are kept and written
+  // over by later logs instead of being deleted.  Overwriting a file
+  // spares the file system from allocating blocks and updating the file
+  // size on every sync, so a sync write costs little more than syncing
+  // its data.  The records of such logs carry the log number, so that
+  // the leftovers of a file's earlier use are ignored on recovery.  A bad
+  // record in them is taken as the end of the log instead of reported.
+  //
+  // Log files written with this option cannot be recovered by leveldb
+  // versions that do not support recycled logs.
+  size_t recycle_log_file_num = 0;
+
+  // Concurrent writes are logged together, and a sync write also logs
+  // the writes queued behind it before syncing, so that they all share
+  // one log sync.  If non-zero, a sync write first waits this many
+  // microseconds for more writes to queue up, trading latency for fewer
+  // syncs when there are many concurrent sync writers.
+  int sync_delay_micros = 0;
+
+  // If true, log records are kept in the log file's write buffer (64KB
+  // for the default Env) until it fills up, the log is synced by a sync
+  // write, or DB::FlushWAL() is called, instead of being handed to the
+  // operating system by every write.  Writes then never wait on log I/O
+  // for buffers that are not full, but a crash of the process loses the
+  // writes still buffered.  Calling DB::FlushWAL() on a timer bounds that
+  // loss.
+  bool manual_wal_flush = false;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, each table stores a single filter over all of its keys
+  // instead of one filter per 2KB of data.  A lookup then probes one
+  // filter without first mapping the data block offset to a filter.
+  // Only has an effect when filter_policy is set.
+  bool full_filter = false;
+
+  // If true, the index block and the filter of each table are split into
+  // partitions of roughly metadata_block_size bytes and a small top-level
+  // index over them is stored instead.  Opening a table only loads the
+  // top-level indexes; partitions are read on demand through block_cache,
+  // so the memory they use is bounded by the cache capacity.  Implies
+  // full_filter for the filter partitions.
+  //
+  // Tables written with this option cannot be opened by leveldb versions
+  // that do not support partitioned indexes.
+  bool partition_index_and_filters = false;
+
+  // Approximate size of an index or filter partition when
+  // partition_index_and_filters is true.
+  size_t metadata_block_size = 4 * 1024;
+
+  // If true, each data block ends in a small hash index from user keys to
+  // restart points, so that a Get() that hits a cached block jumps to the
+  // right restart point instead of binary-searching the restart array.
+  // Costs about one byte per key.  Only meant for tables written by the
+  // database; seeks by iterators are not affected.
+  //
+  // Tables written with this option cannot be opened by leveldb versions
+  // that do not support data block hash indexes.
+  bool data_block_hash_index = false;
+
+  // Encoding of data blocks.  Version 1 is the original format.  Version 2
+  // keeps the keys and values of a block in separate sections and replaces
+  // the varint entry headers with fixed-width ones (16-bit in blocks under
+  // 64KiB), which makes searching and scanning cached blocks cheaper at the
+  // cost of a few bytes per entry.  Index and meta blocks always use
+  // version 1.
+  //
+  // Tables written with version 2 cannot be opened by leveldb versions
+  // that do not support it.
+  int block_format_version = 1;
+
+  // If non-null, the prefix of each key in the domain of this transform
+  // is added to the table filters next to the key itself.  Iterators
+  // created with ReadOptions::prefix_same_as_start then skip the tables
+  // whose filter rules out the prefix of a Seek() target.  Only has an
+  // effect when filter_policy is set.  See leveldb/slice_transform.h.
+  const SliceTransform* prefix_extractor = nullptr;
 };
 
 // Options that control read operations
@@ -163,6 +356,14 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and Options::prefix_extractor is set, an iterator positioned
+  // by Seek() only returns keys with the same prefix as the Seek()
+  // target and becomes !Valid() past them, and tables that cannot hold
+  // the prefix are not read.  SeekToFirst() and SeekToLast() are not
+  // bounded.  A Seek() target outside the domain of the prefix extractor
+  // is not bounded either.
+  bool prefix_same_as_start = false;
 };
 
 // Options that control write operations
@@ -184,6 +385,18 @@ struct LEVELDB_EXPORT WriteOptions {
   // with sync==true has similar crash semantics to a "write()"
   // system call followed by "fsync()".
   bool sync = false;
+
+  // If true, and the write would have to wait for a compaction to make
+  // room for it, or be delayed to let compactions catch up, the write
+  // fails with a Status::Incomplete() error instead of waiting.
+  bool no_slowdown = false;
+
+  // If true, the write is not recorded in the log, so it is lost if the
+  // process crashes before the memtable holding it reaches a table.  Call
+  // DB::Flush() to make such writes durable; deleting the DB also flushes
+  // them.  Cannot be combined with sync, which fails with an
+  // InvalidArgument error.
+  bool disable_wal = false;
 };
 
 }  // namespace leveldb
@@ -0,0 +1,71 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache keeps copies of table blocks in files on a fast local
+// device, typically an SSD, for databases whose tables live on slower
+// storage such as network block devices or disks.  A block that misses
+// the in-memory caches is looked up here before it is read from the
+// table file.  Unlike a Cache, the contents survive a restart of the
+// process.
+//
+// A PersistentCache has internal synchronization and may be safely
+// accessed concurrently from multiple threads.  A directory must not be
+// used by more than one PersistentCache, and a PersistentCache must not
+// be shared by more than one database: entries are keyed by table file
+// number.  Remove the directory together with the database (for example
+// after DestroyDB) so that a new database does not find stale blocks.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT PersistentCache {
+ public:
+  PersistentCache() = default;
+
+  PersistentCache(const PersistentCache&) = delete;
+  PersistentCache& operator=(const PersistentCache&) = delete;
+
+  // Writes out entries that are still buffered in memory, so that they
+  // are found again when the cache is reopened.
+  virtual ~PersistentCache();
+
+  // Store a copy of "data" under "key".  Entries are immutable: if "key"
+  // is already present the call has no effect.  Storing is best effort;
+  // errors writing the cache files only cause later lookups to miss.
+  virtual void Insert(const Slice& key, const Slice& data) = 0;
+
+  // If the cache holds an entry for "key", store its data in *data and
+  // return true.  Otherwise return false.
+  virtual bool Lookup(const Slice& key, std::string* data) = 0;
+
+  // Return the number of bytes used by the entries in the cache.
+  virtual uint64_t TotalSize() const = 0;
+};
+
+// Open the persistent cache stored in directory "dir", creating the
+// directory if it does not exist.  Entries left there by an earlier
+// instance are found again.  The cache holds up to about "capacity" bytes
+// and drops its oldest entries first when it is full.
+//
+// On success, stores a pointer to the new cache in *result and returns
+// OK.  The caller should delete *result when it is no longer needed.
+// On failure stores nullptr in *result and returns a non-OK status.
+LEVELDB_EXPORT Status NewPersistentCache(Env* env, const std::string& dir,
+                                         uint64_t capacity,
+                                         PersistentCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
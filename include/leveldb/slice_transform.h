@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps keys to a prefix.  A database configured with a
+// prefix extractor (see Options::prefix_extractor) adds the prefix of each
+// key to its filters, so that a Seek() can skip tables that hold no key
+// with the prefix of the target, and iterators can be limited to the keys
+// that share the prefix of the Seek() target.
+//
+// SliceTransform 用于提取 key 的前缀
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transformation.  The name is stored in the
+  // tables written with it, and prefix filtering is only used on tables
+  // whose name matches.  If the prefixes change in any way, the name must
+  // change too.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if "key" has a prefix.  Keys outside the domain are not
+  // added to prefix filters, and Seek() to such a key does not use them.
+  //
+  // The keys that share a prefix must form a contiguous range under the
+  // comparator; this always holds when the prefix is a leading part of
+  // the key and the comparator is BytewiseComparator().
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of
+// a key.  Shorter keys are not in its domain.
+//
+// The caller must delete the result after any database that is using it
+// has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+// Return a new transform whose prefix is a key up to and including the
+// "count"-th occurrence of "delimiter".  Keys with fewer occurrences are
+// not in its domain.  For example, with delimiter '|' and count 2 the
+// prefix of "tenant|entity|ts" is "tenant|entity|".
+//
+// The caller must delete the result after any database that is using it
+// has been closed.
+LEVELDB_EXPORT const SliceTransform* NewDelimitedPrefixTransform(
+    char delimiter, int count);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, to be added
+// to one later with DB::IngestExternalFile().  This loads sorted data into
+// a database without going through its log, memtable and compactions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // "options" must have the comparator, filter policy and prefix extractor
+  // of the database the file is ingested into.  The file is written with
+  // the other table options of "options", such as its block size and
+  // compression.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Deletes the file if it was opened but not finished.
+  ~SstFileWriter();
+
+  // Create the file "fname" and prepare to write entries to it.
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value", or that deletes "key".
+  // Keys must be added in strictly increasing order of the comparator,
+  // otherwise an InvalidArgument error is returned.
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  Status Put(const Slice& key, const Slice& value);
+  Status Delete(const Slice& key);
+
+  // Write the rest of the table and sync and close the file.  A file
+  // without any entry cannot be finished.
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  Status Finish();
+
+  // Size of the file written so far.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -73,7 +74,36 @@ class LEVELDB_EXPORT Table {
   friend class TableCache;
   struct Rep;
 
+  // Filter layouts a table can carry, see doc/table_format.md.
+  enum FilterType { kBlockBasedFilter, kFullFilter, kPartitionedFilter };
+
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* MetaBlockReader(void*, const ReadOptions&, const Slice&);
+
+  // Returns an iterator over the block at "handle", read through the block
+  // cache if there is one.  If "get_target" is non-null, the iterator is
+  // positioned for a point lookup of *get_target (see
+  // Block::NewIteratorForGet).
+  Iterator* NewBlockIterator(const ReadOptions&, const BlockHandle& handle,
+                             Cache::Priority priority,
+                             const Slice* get_target = nullptr) const;
+
+  // Returns an iterator over the index entries of every data block.  For a
+  // partitioned index this reads the index partitions on demand.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Returns false if the filter shows that "key", which would be stored in
+  // the data block at "block_offset", is not present in the table.
+  // "target" locates the filter partition of a partitioned filter.
+  bool KeyMayMatch(const ReadOptions&, uint64_t block_offset,
+                   const Slice& target, const Slice& key);
+
+  // Returns false if the filter shows that the table holds no key at or
+  // after "target" whose prefix is "probe", encoded like the keys of the
+  // table.  Always true unless the table was written with the prefix
+  // extractor in options.
+  bool PrefixMayMatch(const ReadOptions&, const Slice& target,
+                      const Slice& probe);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
@@ -85,7 +115,17 @@ class LEVELDB_EXPORT Table {
                                            const Slice& v));
 
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, FilterType type);
+
+  // Holds the index and filter blocks in the block cache until the table
+  // is closed.  Called by TableCache right after Open().
+  void PinMetaBlocks();
+
+  // Enables options.persistent_cache for the blocks of this table, which
+  // is stored in the file numbered "file_number".  Entries of the
+  // persistent cache are keyed by file number so that they can be found
+  // again after a restart.  Called by TableCache right after Open().
+  void SetFileNumber(uint64_t file_number);
 
   Rep* const rep_;
 };
@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_TABLE_BUILDER_H_
 #define STORAGE_LEVELDB_INCLUDE_TABLE_BUILDER_H_
 
+#include <cstddef>
 #include <cstdint>
 
 #include "leveldb/export.h"
@@ -32,9 +33,12 @@ class LEVELDB_EXPORT TableBuilder {
   // Create a builder that will store the contents of the table it is
   // building in *file.  Does not close the file.  It is up to the
   // caller to close the file after calling Finish().
+  //
+  // "level" is the level of the database the table is written to, or -1
+  // if not known.  It is passed on to the filter policy.
   // 创建 TableBuilder 在 *file 上构建 sstable
   // TableBuilder 不会关闭 *file，需要调用方来关闭
-  TableBuilder(const Options& options, WritableFile* file);
+  TableBuilder(const Options& options, WritableFile* file, int level = -1);
 
   TableBuilder(const TableBuilder&) = delete;
   TableBuilder& operator=(const TableBuilder&) = delete;
@@ -96,10 +100,25 @@ class LEVELDB_EXPORT TableBuilder {
   // Finish() call, returns the size of the final generated file.
   uint64_t FileSize() const;
 
+  // Counts of the data blocks written so far by how they were compressed.
+  // Blocks of a table that is not compressed are not counted.
+  struct CompressionStats {
+    uint64_t compressed = 0;
+    uint64_t rejected = 0;  // Saved too little and stored uncompressed
+    uint64_t skipped = 0;   // Not tried, see Options::adaptive_compression
+  };
+  CompressionStats GetCompressionStats() const;
+
  private:
   bool ok() const { return status().ok(); }
-  void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteBlock(BlockBuilder* block, BlockHandle* handle,
+                  bool data_block = false);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void AddIndexEntry(const std::string& separator);
+  void AddPendingIndexEntry(const std::string& separator);
+  void QueueBlock();
+  void WriteReadyBlocks(size_t max_pending);
+  void FinishPartition(const std::string& separator);
 
   struct Rep;
   Rep* rep_; // TableBuilder 实际的字段都在 Rep 中
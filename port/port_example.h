@@ -34,6 +34,10 @@ class LOCKABLE Mutex {
   // REQUIRES: This mutex was locked by this thread.
   void Unlock() UNLOCK_FUNCTION();
 
+  // Lock the mutex if no other thread holds it, without waiting.
+  // Returns true iff the mutex was locked.
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true);
+
   // Optionally crash if this thread does not hold this mutex.
   // The implementation must be fast, especially if NDEBUG is
   // defined.  The implementation is allowed to skip all checks.
@@ -101,6 +105,85 @@ bool Zstd_GetUncompressedLength(const char* input, size_t length,
 // Zstd_GetUncompressedLength.
 bool Zstd_Uncompress(const char* input_data, size_t input_length, char* output);
 
+// Store in *dictionary a zstd dictionary of at most "max_length" bytes
+// trained on "num_samples" samples, which are stored back to back in
+// samples[] with their lengths in sample_lengths[].  Returns false if
+// zstd is not supported by this port or the samples are too few to
+// train on.
+bool Zstd_TrainDictionary(const char* samples, const size_t* sample_lengths,
+                          size_t num_samples, size_t max_length,
+                          std::string* dictionary);
+
+// A zstd dictionary, as built by Zstd_TrainDictionary, prepared once for
+// compressing many inputs at "level".  Compress() behaves like
+// Zstd_Compress and may be called by several threads at once.
+class ZstdCompressionDictionary {
+ public:
+  ZstdCompressionDictionary(int level, const char* dictionary, size_t length);
+  ~ZstdCompressionDictionary();
+
+  bool Compress(const char* input, size_t input_length,
+                std::string* output) const;
+};
+
+// The same for decompression.  Uncompress() behaves like Zstd_Uncompress
+// for data compressed with the dictionary.
+class ZstdDecompressionDictionary {
+ public:
+  ZstdDecompressionDictionary(const char* dictionary, size_t length);
+  ~ZstdDecompressionDictionary();
+
+  bool Uncompress(const char* input_data, size_t input_length,
+                  char* output) const;
+};
+
+// Compresses a sequence of inputs as one zstd stream at "level", so an
+// input can refer back to the ones before it.  Each Compress() call
+// appends the compressed form of its input to *output and flushes it,
+// so it can be decompressed before the next input arrives.  Returns
+// false if zstd is not supported by this port or on error; the stream
+// must not be used after a failure.
+class ZstdCompressionStream {
+ public:
+  explicit ZstdCompressionStream(int level);
+  ~ZstdCompressionStream();
+
+  bool Compress(const char* input, size_t input_length, std::string* output);
+};
+
+// Decompresses the output of a ZstdCompressionStream, one Compress() call
+// at a time and in the same order.  Uncompress() appends the original
+// input to *output, or returns false if the data is not a valid
+// continuation of the stream.
+class ZstdDecompressionStream {
+ public:
+  ZstdDecompressionStream();
+  ~ZstdDecompressionStream();
+
+  bool Uncompress(const char* input, size_t input_length,
+                  std::string* output);
+};
+
+// Store the lz4 compression of "input[0,input_length-1]" in *output.
+// Returns false if lz4 is not supported by this port.
+bool Lz4_Compress(const char* input, size_t input_length,
+                  std::string* output);
+
+// If input[0,input_length-1] looks like a valid lz4 compressed
+// buffer, store the size of the uncompressed data in *result and
+// return true.  Else return false.
+bool Lz4_GetUncompressedLength(const char* input, size_t length,
+                               size_t* result);
+
+// Attempt to lz4 uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid lz4
+// compressed data.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Lz4_GetUncompressedLength.
+bool Lz4_Uncompress(const char* input_data, size_t input_length, char* output);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
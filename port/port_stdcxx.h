@@ -30,8 +30,13 @@
 #endif  // HAVE_SNAPPY
 #if HAVE_ZSTD
 #define ZSTD_STATIC_LINKING_ONLY  // For ZSTD_compressionParameters.
+#define ZDICT_STATIC_LINKING_ONLY  // For ZDICT_trainFromBuffer_fastCover.
+#include <zdict.h>
 #include <zstd.h>
 #endif  // HAVE_ZSTD
+#if HAVE_LZ4
+#include <lz4.h>
+#endif  // HAVE_LZ4
 
 #include <cassert>
 #include <condition_variable>  // NOLINT
@@ -58,6 +63,7 @@ class LOCKABLE Mutex {
 
   void Lock() EXCLUSIVE_LOCK_FUNCTION() { mu_.lock(); }
   void Unlock() UNLOCK_FUNCTION() { mu_.unlock(); }
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true) { return mu_.try_lock(); }
   void AssertHeld() ASSERT_EXCLUSIVE_LOCK() {}
 
  private:
@@ -198,6 +204,328 @@ inline bool Zstd_Uncompress(const char* input, size_t length, char* output) {
 #endif  // HAVE_ZSTD
 }
 
+inline bool Zstd_TrainDictionary(const char* samples,
+                                 const size_t* sample_lengths,
+                                 size_t num_samples, size_t max_length,
+                                 std::string* dictionary) {
+#if HAVE_ZSTD
+  // Fixed parameters; letting zstd search for the best segment size costs
+  // several times as much for a barely better dictionary.
+  ZDICT_fastCover_params_t params = {};
+  params.k = 200;
+  params.d = 8;
+  dictionary->resize(max_length);
+  size_t length = ZDICT_trainFromBuffer_fastCover(
+      &(*dictionary)[0], max_length, samples, sample_lengths,
+      static_cast<unsigned>(num_samples), params);
+  if (ZDICT_isError(length)) {
+    dictionary->clear();
+    return false;
+  }
+  dictionary->resize(length);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)samples;
+  (void)sample_lengths;
+  (void)num_samples;
+  (void)max_length;
+  (void)dictionary;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// A zstd dictionary prepared once for compressing many inputs with it.
+class ZstdCompressionDictionary {
+ public:
+  ZstdCompressionDictionary(int level, const char* dictionary, size_t length) {
+#if HAVE_ZSTD
+    cdict_ = ZSTD_createCDict(dictionary, length, level);
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)level;
+    (void)dictionary;
+    (void)length;
+#endif  // HAVE_ZSTD
+  }
+  ~ZstdCompressionDictionary() {
+#if HAVE_ZSTD
+    ZSTD_freeCDict(cdict_);
+#endif  // HAVE_ZSTD
+  }
+
+  ZstdCompressionDictionary(const ZstdCompressionDictionary&) = delete;
+  ZstdCompressionDictionary& operator=(const ZstdCompressionDictionary&) =
+      delete;
+
+  bool Compress(const char* input, size_t length, std::string* output) const {
+#if HAVE_ZSTD
+    if (cdict_ == nullptr) {
+      return false;
+    }
+    size_t outlen = ZSTD_compressBound(length);
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    output->resize(outlen);
+    ZSTD_CCtx* ctx = ZSTD_createCCtx();
+    outlen = ZSTD_compress_usingCDict(ctx, &(*output)[0], output->size(),
+                                      input, length, cdict_);
+    ZSTD_freeCCtx(ctx);
+    if (ZSTD_isError(outlen)) {
+      return false;
+    }
+    output->resize(outlen);
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_CDict* cdict_;
+#endif  // HAVE_ZSTD
+};
+
+// A zstd dictionary prepared once for decompressing many inputs with it.
+class ZstdDecompressionDictionary {
+ public:
+  ZstdDecompressionDictionary(const char* dictionary, size_t length) {
+#if HAVE_ZSTD
+    ddict_ = ZSTD_createDDict(dictionary, length);
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)dictionary;
+    (void)length;
+#endif  // HAVE_ZSTD
+  }
+  ~ZstdDecompressionDictionary() {
+#if HAVE_ZSTD
+    ZSTD_freeDDict(ddict_);
+#endif  // HAVE_ZSTD
+  }
+
+  ZstdDecompressionDictionary(const ZstdDecompressionDictionary&) = delete;
+  ZstdDecompressionDictionary& operator=(const ZstdDecompressionDictionary&) =
+      delete;
+
+  bool Uncompress(const char* input, size_t length, char* output) const {
+#if HAVE_ZSTD
+    size_t outlen;
+    if (ddict_ == nullptr ||
+        !Zstd_GetUncompressedLength(input, length, &outlen)) {
+      return false;
+    }
+    ZSTD_DCtx* ctx = ZSTD_createDCtx();
+    outlen = ZSTD_decompress_usingDDict(ctx, output, outlen, input, length,
+                                        ddict_);
+    ZSTD_freeDCtx(ctx);
+    return !ZSTD_isError(outlen);
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_DDict* ddict_;
+#endif  // HAVE_ZSTD
+};
+
+// One zstd stream spanning many inputs, each flushed as it is compressed.
+class ZstdCompressionStream {
+ public:
+  explicit ZstdCompressionStream(int level) {
+#if HAVE_ZSTD
+    cctx_ = ZSTD_createCCtx();
+    if (cctx_ != nullptr) {
+      ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level);
+    }
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)level;
+#endif  // HAVE_ZSTD
+  }
+  ~ZstdCompressionStream() {
+#if HAVE_ZSTD
+    ZSTD_freeCCtx(cctx_);
+#endif  // HAVE_ZSTD
+  }
+
+  ZstdCompressionStream(const ZstdCompressionStream&) = delete;
+  ZstdCompressionStream& operator=(const ZstdCompressionStream&) = delete;
+
+  bool Compress(const char* input, size_t length, std::string* output) {
+#if HAVE_ZSTD
+    if (cctx_ == nullptr) {
+      return false;
+    }
+    ZSTD_inBuffer in = {input, length, 0};
+    size_t written = output->size();
+    size_t remaining;
+    do {
+      output->resize(written + ZSTD_compressBound(length - in.pos) + 32);
+      ZSTD_outBuffer out = {&(*output)[written], output->size() - written, 0};
+      remaining = ZSTD_compressStream2(cctx_, &out, &in, ZSTD_e_flush);
+      if (ZSTD_isError(remaining)) {
+        return false;
+      }
+      written += out.pos;
+    } while (remaining != 0);
+    output->resize(written);
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_CCtx* cctx_;
+#endif  // HAVE_ZSTD
+};
+
+// Reads back the output of a ZstdCompressionStream.
+class ZstdDecompressionStream {
+ public:
+  ZstdDecompressionStream() {
+#if HAVE_ZSTD
+    dctx_ = ZSTD_createDCtx();
+#endif  // HAVE_ZSTD
+  }
+  ~ZstdDecompressionStream() {
+#if HAVE_ZSTD
+    ZSTD_freeDCtx(dctx_);
+#endif  // HAVE_ZSTD
+  }
+
+  ZstdDecompressionStream(const ZstdDecompressionStream&) = delete;
+  ZstdDecompressionStream& operator=(const ZstdDecompressionStream&) = delete;
+
+  bool Uncompress(const char* input, size_t length, std::string* output) {
+#if HAVE_ZSTD
+    if (dctx_ == nullptr) {
+      return false;
+    }
+    ZSTD_inBuffer in = {input, length, 0};
+    size_t written = output->size();
+    bool full;
+    do {
+      output->resize(written + ZSTD_DStreamOutSize());
+      ZSTD_outBuffer out = {&(*output)[written], output->size() - written, 0};
+      size_t result = ZSTD_decompressStream(dctx_, &out, &in);
+      if (ZSTD_isError(result)) {
+        return false;
+      }
+      written += out.pos;
+      // A full output buffer may leave decompressed bytes behind in zstd.
+      full = (out.pos == out.size);
+    } while (in.pos < in.size || full);
+    output->resize(written);
+    return true;
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)input;
+    (void)length;
+    (void)output;
+    return false;
+#endif  // HAVE_ZSTD
+  }
+
+ private:
+#if HAVE_ZSTD
+  ZSTD_DCtx* dctx_;
+#endif  // HAVE_ZSTD
+};
+
+// LZ4 blocks do not record their uncompressed length, so the compressed
+// form starts with it as a 32-bit little-endian integer.
+// LZ4 压缩数据前 4 字节为小端序的原始长度
+inline bool Lz4_Compress(const char* input, size_t length,
+                         std::string* output) {
+#if HAVE_LZ4
+  if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(4 + bound);
+  char* header = &(*output)[0];
+  for (int i = 0; i < 4; i++) {
+    header[i] = static_cast<char>((length >> (8 * i)) & 0xff);
+  }
+  const int outlen = LZ4_compress_default(input, header + 4,
+                                          static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(4 + outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool Lz4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result) {
+#if HAVE_LZ4
+  if (length < 4) {
+    return false;
+  }
+  size_t size = 0;
+  for (int i = 0; i < 4; i++) {
+    size |= static_cast<size_t>(static_cast<unsigned char>(input[i]))
+            << (8 * i);
+  }
+  if (size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  *result = size;
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool Lz4_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_LZ4
+  size_t outlen;
+  if (!Lz4_GetUncompressedLength(input, length, &outlen)) {
+    return false;
+  }
+  const int n =
+      LZ4_decompress_safe(input + 4, output, static_cast<int>(length - 4),
+                          static_cast<int>(outlen));
+  return n >= 0 && static_cast<size_t>(n) == outlen;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
@@ -20,22 +20,65 @@ namespace leveldb {
 // DataBlock 尾部的 4 个字节以 fixed_uint32 格式存储重启点的个数 NumRestarts
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & ~kBlockRestartFlags;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
-      owned_(contents.heap_allocated) {
+      owned_(contents.heap_allocated),
+      hash_buckets_(nullptr),
+      num_hash_buckets_(0),
+      format_v2_(false),
+      wide_fields_(false),
+      keys_size_(0) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
+    return;
+  }
+  const uint32_t flags =
+      DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kBlockRestartFlags;
+  size_t trailer_size = sizeof(uint32_t);
+  size_t restart_size = sizeof(uint32_t);
+  if ((flags & kBlockFormatV2Flag) != 0) {
+    if (size_ < 2 * sizeof(uint32_t)) {
+      size_ = 0;
+      return;
+    }
+    format_v2_ = true;
+    wide_fields_ = (flags & kBlockWideFieldsFlag) != 0;
+    keys_size_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+    trailer_size += sizeof(uint32_t);
+    restart_size = 2 * (wide_fields_ ? sizeof(uint32_t) : sizeof(uint16_t));
+  }
+  // The hash index, if any, sits between the restart array and the
+  // fixed-size trailer
+  size_t hash_index_size = 0;
+  if ((flags & kBlockHashIndexFlag) != 0) {
+    if (size_ < trailer_size + sizeof(uint16_t)) {
+      size_ = 0;
+      return;
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data_) + size_ -
+                       trailer_size - sizeof(uint16_t);
+    num_hash_buckets_ = p[0] | (static_cast<uint32_t>(p[1]) << 8);
+    hash_index_size = num_hash_buckets_ + sizeof(uint16_t);
+    if (num_hash_buckets_ == 0 || size_ < trailer_size + hash_index_size) {
+      size_ = 0;
+      return;
+    }
+    hash_buckets_ = p - num_hash_buckets_;
+  }
+  size_t max_restarts_allowed =
+      (size_ - trailer_size - hash_index_size) / restart_size;
+  if (NumRestarts() > max_restarts_allowed) {
+    // The size is too small for NumRestarts()
+    size_ = 0;
   } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    restart_offset_ = size_ - trailer_size - hash_index_size -
+                      NumRestarts() * restart_size;
+    if (format_v2_ && keys_size_ > restart_offset_) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
     }
   }
 }
@@ -245,6 +288,15 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // Positions the iterator at the first entry >= target at or after
+  // restart point "index", which must not be past that entry.
+  void SeekFromRestartPoint(uint32_t index, const Slice& target) {
+    SeekToRestartPoint(index);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -298,6 +350,246 @@ class Block::Iter : public Iterator {
   }
 };
 
+// Iterator over a block in the second format.  It mirrors Block::Iter,
+// but entries are read from fixed-width headers and the value of an
+// entry is found by summing the value lengths since its restart point.
+class Block::IterV2 : public Iterator {
+ private:
+  const Comparator* const comparator_;
+  const char* const data_;        // Key section, followed by the values
+  const char* const values_;      // Value section
+  uint32_t const keys_size_;      // Size of the key section
+  uint32_t const values_size_;    // Size of the value section
+  const char* const restarts_;    // Restart array
+  uint32_t const num_restarts_;   // Number of restart points
+  bool const wide_;               // Fields are uint32 instead of uint16
+  uint32_t const field_size_;
+  uint32_t const header_size_;    // Size of the header of an entry
+
+  // current_ is offset in the key section of current entry.
+  // >= keys_size_ if !Valid
+  uint32_t current_;
+  uint32_t restart_index_;  // Index of restart block in which current_ falls
+  uint32_t next_key_offset_;    // Offset of the entry after current_
+  uint32_t next_value_offset_;  // Offset of the value of that entry
+  std::string key_;
+  Slice value_;
+  Status status_;
+
+  inline int Compare(const Slice& a, const Slice& b) const {
+    return comparator_->Compare(a, b);
+  }
+
+  inline uint32_t DecodeField(const char* p) const {
+    if (wide_) {
+      return DecodeFixed32(p);
+    }
+    const uint8_t* const q = reinterpret_cast<const uint8_t*>(p);
+    return q[0] | (static_cast<uint32_t>(q[1]) << 8);
+  }
+
+  uint32_t GetRestartKeyOffset(uint32_t index) const {
+    assert(index < num_restarts_);
+    return DecodeField(restarts_ + 2 * index * field_size_);
+  }
+
+  uint32_t GetRestartValueOffset(uint32_t index) const {
+    assert(index < num_restarts_);
+    return DecodeField(restarts_ + (2 * index + 1) * field_size_);
+  }
+
+  void SeekToRestartPoint(uint32_t index) {
+    key_.clear();
+    restart_index_ = index;
+    // current_ will be fixed by ParseNextKey();
+    next_key_offset_ = GetRestartKeyOffset(index);
+    next_value_offset_ = GetRestartValueOffset(index);
+  }
+
+ public:
+  IterV2(const Comparator* comparator, const char* data, uint32_t keys_size,
+         uint32_t restarts, uint32_t num_restarts, bool wide)
+      : comparator_(comparator),
+        data_(data),
+        values_(data + keys_size),
+        keys_size_(keys_size),
+        values_size_(restarts - keys_size),
+        restarts_(data + restarts),
+        num_restarts_(num_restarts),
+        wide_(wide),
+        field_size_(wide ? sizeof(uint32_t) : sizeof(uint16_t)),
+        header_size_(3 * field_size_),
+        current_(keys_size_),
+        restart_index_(num_restarts_),
+        next_key_offset_(keys_size_),
+        next_value_offset_(0) {
+    assert(num_restarts_ > 0);
+  }
+
+  bool Valid() const override { return current_ < keys_size_; }
+  Status status() const override { return status_; }
+  Slice key() const override {
+    assert(Valid());
+    return key_;
+  }
+  Slice value() const override {
+    assert(Valid());
+    return value_;
+  }
+
+  void Next() override {
+    assert(Valid());
+    ParseNextKey();
+  }
+
+  void Prev() override {
+    assert(Valid());
+
+    // Scan backwards to a restart point before current_
+    const uint32_t original = current_;
+    while (GetRestartKeyOffset(restart_index_) >= original) {
+      if (restart_index_ == 0) {
+        // No more entries
+        current_ = keys_size_;
+        restart_index_ = num_restarts_;
+        return;
+      }
+      restart_index_--;
+    }
+
+    SeekToRestartPoint(restart_index_);
+    do {
+      // Loop until end of current entry hits the start of original entry
+    } while (ParseNextKey() && next_key_offset_ < original);
+  }
+
+  void Seek(const Slice& target) override {
+    // Binary search in restart array to find the last restart point
+    // with a key < target
+    uint32_t left = 0;
+    uint32_t right = num_restarts_ - 1;
+    int current_key_compare = 0;
+
+    if (Valid()) {
+      // If we're already scanning, use the current position as a starting
+      // point.
+      current_key_compare = Compare(key_, target);
+      if (current_key_compare < 0) {
+        left = restart_index_;
+      } else if (current_key_compare > 0) {
+        right = restart_index_;
+      } else {
+        return;
+      }
+    }
+
+    while (left < right) {
+      uint32_t mid = (left + right + 1) / 2;
+      // 重启点的 key 是完整的, 头部定长, 无需解码 varint 即可直接比较
+      uint32_t region_offset = GetRestartKeyOffset(mid);
+      if (region_offset > keys_size_ ||
+          keys_size_ - region_offset < header_size_) {
+        CorruptionError();
+        return;
+      }
+      const char* header = data_ + region_offset;
+      const uint32_t shared = DecodeField(header);
+      const uint32_t non_shared = DecodeField(header + field_size_);
+      if (shared != 0 ||
+          keys_size_ - region_offset - header_size_ < non_shared) {
+        CorruptionError();
+        return;
+      }
+      Slice mid_key(header + header_size_, non_shared);
+      if (Compare(mid_key, target) < 0) {
+        left = mid;
+      } else {
+        right = mid - 1;
+      }
+    }
+
+    assert(current_key_compare == 0 || Valid());
+    bool skip_seek = left == restart_index_ && current_key_compare < 0;
+    if (!skip_seek) {
+      SeekToRestartPoint(left);
+    }
+    // Linear search (within restart block) for first key >= target
+    while (true) {
+      if (!ParseNextKey()) {
+        return;
+      }
+      if (Compare(key_, target) >= 0) {
+        return;
+      }
+    }
+  }
+
+  // Same as Block::Iter::SeekFromRestartPoint().
+  void SeekFromRestartPoint(uint32_t index, const Slice& target) {
+    SeekToRestartPoint(index);
+    while (ParseNextKey() && Compare(key_, target) < 0) {
+      // Keep skipping
+    }
+  }
+
+  void SeekToFirst() override {
+    SeekToRestartPoint(0);
+    ParseNextKey();
+  }
+
+  void SeekToLast() override {
+    SeekToRestartPoint(num_restarts_ - 1);
+    while (ParseNextKey() && next_key_offset_ < keys_size_) {
+      // Keep skipping
+    }
+  }
+
+ private:
+  void CorruptionError() {
+    current_ = keys_size_;
+    restart_index_ = num_restarts_;
+    status_ = Status::Corruption("bad entry in block");
+    key_.clear();
+    value_.clear();
+  }
+
+  bool ParseNextKey() {
+    current_ = next_key_offset_;
+    if (current_ >= keys_size_) {
+      // No more entries to return.  Mark as invalid.
+      current_ = keys_size_;
+      restart_index_ = num_restarts_;
+      return false;
+    }
+    if (keys_size_ - current_ < header_size_) {
+      CorruptionError();
+      return false;
+    }
+
+    const char* p = data_ + current_;
+    const uint32_t shared = DecodeField(p);
+    const uint32_t non_shared = DecodeField(p + field_size_);
+    const uint32_t value_length = DecodeField(p + 2 * field_size_);
+    if (key_.size() < shared ||
+        keys_size_ - current_ - header_size_ < non_shared ||
+        next_value_offset_ > values_size_ ||
+        values_size_ - next_value_offset_ < value_length) {
+      CorruptionError();
+      return false;
+    }
+    key_.resize(shared);
+    key_.append(p + header_size_, non_shared);
+    value_ = Slice(values_ + next_value_offset_, value_length);
+    next_key_offset_ = current_ + header_size_ + non_shared;
+    next_value_offset_ += value_length;
+    while (restart_index_ + 1 < num_restarts_ &&
+           GetRestartKeyOffset(restart_index_ + 1) < current_) {
+      ++restart_index_;
+    }
+    return true;
+  }
+};
+
 Iterator* Block::NewIterator(const Comparator* comparator) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
@@ -305,9 +597,48 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   const uint32_t num_restarts = NumRestarts();
   if (num_restarts == 0) {
     return NewEmptyIterator();
+  } else if (format_v2_) {
+    return new IterV2(comparator, data_, keys_size_, restart_offset_,
+                      num_restarts, wide_fields_);
   } else {
     return new Iter(comparator, data_, restart_offset_, num_restarts);
   }
 }
 
+Iterator* Block::NewIteratorForGet(const Comparator* comparator,
+                                   const Slice& target) {
+  uint32_t hash;
+  if (hash_buckets_ == nullptr || size_ < sizeof(uint32_t) ||
+      NumRestarts() == 0 || !BlockHashIndexHash(target, &hash)) {
+    Iterator* iter = NewIterator(comparator);
+    iter->Seek(target);
+    return iter;
+  }
+
+  // 通过哈希索引直接定位到 key 所在的重启点，跳过二分查找
+  const uint8_t bucket = hash_buckets_[hash % num_hash_buckets_];
+  if (bucket == kBlockHashIndexNoEntry) {
+    return NewEmptyIterator();
+  }
+  const bool use_bucket =
+      bucket != kBlockHashIndexCollision && bucket < NumRestarts();
+  if (format_v2_) {
+    IterV2* iter = new IterV2(comparator, data_, keys_size_, restart_offset_,
+                              NumRestarts(), wide_fields_);
+    if (use_bucket) {
+      iter->SeekFromRestartPoint(bucket, target);
+    } else {
+      iter->Seek(target);
+    }
+    return iter;
+  }
+  Iter* iter = new Iter(comparator, data_, restart_offset_, NumRestarts());
+  if (use_bucket) {
+    iter->SeekFromRestartPoint(bucket, target);
+  } else {
+    iter->Seek(target);
+  }
+  return iter;
+}
+
 }  // namespace leveldb
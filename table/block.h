@@ -29,8 +29,16 @@ class Block {
   // 主要的查找逻辑在 iterator 中实现
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Returns an iterator positioned like Seek(target) for a point lookup.
+  // If the block has a hash index and no entry has the user key of
+  // "target", the iterator may instead be !Valid() or at a later entry.
+  // Only for table keys written by the database.
+  Iterator* NewIteratorForGet(const Comparator* comparator,
+                              const Slice& target);
+
  private:
   class Iter;
+  class IterV2;
 
   // 解析 content 获得重启点的个数
   uint32_t NumRestarts() const;
@@ -39,6 +47,11 @@ class Block {
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
   bool owned_;               // Block owns data_[]
+  const uint8_t* hash_buckets_;  // Hash index, or null if there is none
+  uint32_t num_hash_buckets_;
+  bool format_v2_;      // Block uses the second format
+  bool wide_fields_;    // Fields of a second format block are 32-bit
+  uint32_t keys_size_;  // Size of the key section of a second format block
 };
 
 }  // namespace leveldb
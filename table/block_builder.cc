@@ -25,6 +25,13 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+// Data blocks built with a hash index carry it between the restart array
+// and num_restarts, see kBlockHashIndexFlag in table/format.h.
+//
+// The second block format is described next to kBlockFormatV2Flag in
+// table/format.h.  Its fixed-width entry headers let a reader step over
+// entries without decoding varints, and keeping the values apart means a
+// search touches only the cache lines that hold keys.
 
 #include "table/block_builder.h"
 
@@ -33,12 +40,20 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index,
+                           int format_version)
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      format_v2_(format_version == 2),
+      hash_index_(hash_index),
+      hash_index_ok_(true) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -50,30 +65,147 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_index_ok_ = true;
+  hash_entries_.clear();
+  entries_.clear();
+  values_.clear();
+}
+
+// The hash index uses about 4 buckets for every 3 user keys.
+static size_t NumHashBuckets(size_t num_keys) {
+  return std::min<size_t>(num_keys * 4 / 3 + 1, 65535);
+}
+
+static void PutField(std::string* dst, uint32_t value, bool wide) {
+  if (wide) {
+    PutFixed32(dst, value);
+  } else {
+    assert(value <= 0xffff);
+    dst->push_back(static_cast<char>(value & 0xff));
+    dst->push_back(static_cast<char>(value >> 8));
+  }
+}
+
+// A second format block needs 32-bit fields if its key section, laid out
+// with 16-bit fields, and its values do not fit in 64KiB.
+static inline size_t FieldWidth(size_t num_entries, size_t deltas_size,
+                                size_t values_size) {
+  return num_entries * 3 * sizeof(uint16_t) + deltas_size + values_size >
+                 0xffff
+             ? sizeof(uint32_t)
+             : sizeof(uint16_t);
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  if (format_v2_) {
+    const size_t width =
+        FieldWidth(entries_.size(), buffer_.size(), values_.size());
+    size_t estimate = (entries_.size() * 3 * width + buffer_.size() +  // Keys
+                       values_.size() +                      // Value section
+                       restarts_.size() * 2 * width +        // Restart array
+                       2 * sizeof(uint32_t));  // keys_size and num_restarts
+    if (hash_index_) {
+      estimate += NumHashBuckets(hash_entries_.size()) + sizeof(uint16_t);
+    }
+    return estimate;
+  }
+  size_t estimate = (buffer_.size() +                       // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));  // Restart array length
+  if (hash_index_) {
+    estimate += NumHashBuckets(hash_entries_.size()) + sizeof(uint16_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
+  if (format_v2_) {
+    return FinishV2();
+  }
   // 在 Data Block 的结尾存储重启点的 offset 和数量，便于查找(查找代码在 block.cc)。
   // Append restart array
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  num_restarts |= AppendHashIndex(num_restarts);
+  PutFixed32(&buffer_, num_restarts);
+  finished_ = true;
+  return Slice(buffer_);
+}
+
+Slice BlockBuilder::FinishV2() {
+  const size_t width =
+      FieldWidth(entries_.size(), buffer_.size(), values_.size());
+  const bool wide = width == sizeof(uint32_t);
+
+  // 把 key delta 和定长的 entry 头部交错写入 key 区, 并记录重启点的位置
+  std::string block;
+  block.reserve(CurrentSizeEstimate());
+  std::string restarts;
+  size_t restart = 0;
+  size_t delta_offset = 0;
+  uint32_t value_offset = 0;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    const Entry& entry = entries_[i];
+    if (restart < restarts_.size() && restarts_[restart] == i) {
+      PutField(&restarts, block.size(), wide);
+      PutField(&restarts, value_offset, wide);
+      restart++;
+    }
+    PutField(&block, entry.shared, wide);
+    PutField(&block, entry.non_shared, wide);
+    PutField(&block, entry.value_length, wide);
+    block.append(buffer_, delta_offset, entry.non_shared);
+    delta_offset += entry.non_shared;
+    value_offset += entry.value_length;
+  }
+  assert(restart == restarts_.size() || entries_.empty());
+  const uint32_t keys_size = block.size();
+  block.append(values_);
+  block.append(restarts);
+
+  buffer_.swap(block);
+  uint32_t num_restarts = entries_.empty() ? 0 : restarts_.size();
+  num_restarts |= AppendHashIndex(num_restarts);
+  PutFixed32(&buffer_, keys_size);
+  num_restarts |= kBlockFormatV2Flag;
+  if (wide) {
+    num_restarts |= kBlockWideFieldsFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
 
+uint32_t BlockBuilder::AppendHashIndex(uint32_t num_restarts) {
+  if (!hash_index_ || !hash_index_ok_ || hash_entries_.empty() ||
+      num_restarts > kBlockHashIndexMaxRestarts) {
+    return 0;
+  }
+  // 每个 bucket 记录 key 所在的重启点下标，冲突时退回二分查找
+  const size_t num_buckets = NumHashBuckets(hash_entries_.size());
+  std::string buckets(num_buckets, static_cast<char>(kBlockHashIndexNoEntry));
+  for (const auto& entry : hash_entries_) {
+    char* bucket = &buckets[entry.first % num_buckets];
+    const uint8_t restart_index = static_cast<uint8_t>(entry.second);
+    if (static_cast<uint8_t>(*bucket) == kBlockHashIndexNoEntry) {
+      *bucket = static_cast<char>(restart_index);
+    } else if (static_cast<uint8_t>(*bucket) != restart_index) {
+      *bucket = static_cast<char>(kBlockHashIndexCollision);
+    }
+  }
+  buffer_.append(buckets);
+  buffer_.push_back(static_cast<char>(num_buckets & 0xff));
+  buffer_.push_back(static_cast<char>(num_buckets >> 8));
+  return kBlockHashIndexFlag;
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
   assert(counter_ <= options_->block_restart_interval);
-  assert(buffer_.empty()  // No values yet?
+  assert(empty()  // No values yet?
          || options_->comparator->Compare(key, last_key_piece) > 0);
   size_t shared = 0;
   // 检测上个重启点之后的键值对数量是否超出了限制
@@ -87,21 +219,41 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   } else {
     // Restart compression
     // 超出限制，当前键值对作为新的重启点
-    restarts_.push_back(buffer_.size());
+    restarts_.push_back(format_v2_ ? entries_.size() : buffer_.size());
     counter_ = 0;
   }
   const size_t non_shared = key.size() - shared;
 
-  // 向 buffer 写入当前键值对的 shared_bytes, non_shared_bytes, value_size 三个字段
-  // Add "<shared><non_shared><value_size>" to buffer_
-  PutVarint32(&buffer_, shared);
-  PutVarint32(&buffer_, non_shared);
-  PutVarint32(&buffer_, value.size());
+  if (hash_index_ && hash_index_ok_) {
+    // Entries of one user key are adjacent; index the first of them
+    uint32_t hash;
+    if (!BlockHashIndexHash(key, &hash)) {
+      hash_index_ok_ = false;
+    } else if (empty() ||
+               Slice(key.data(), key.size() - 8) !=
+                   Slice(last_key_.data(), last_key_.size() - 8)) {
+      hash_entries_.emplace_back(hash, restarts_.size() - 1);
+    }
+  }
+
+  if (format_v2_) {
+    entries_.push_back({static_cast<uint32_t>(shared),
+                        static_cast<uint32_t>(non_shared),
+                        static_cast<uint32_t>(value.size())});
+    buffer_.append(key.data() + shared, non_shared);
+    values_.append(value.data(), value.size());
+  } else {
+    // 向 buffer 写入当前键值对的 shared_bytes, non_shared_bytes, value_size 三个字段
+    // Add "<shared><non_shared><value_size>" to buffer_
+    PutVarint32(&buffer_, shared);
+    PutVarint32(&buffer_, non_shared);
+    PutVarint32(&buffer_, value.size());
 
-  // 写入 key_delta 和 value
-  // Add string delta to buffer_ followed by value
-  buffer_.append(key.data() + shared, non_shared);
-  buffer_.append(value.data(), value.size());
+    // 写入 key_delta 和 value
+    // Add string delta to buffer_ followed by value
+    buffer_.append(key.data() + shared, non_shared);
+    buffer_.append(value.data(), value.size());
+  }
 
   // 更新统计信息
   // Update state
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -16,7 +17,13 @@ struct Options; // 具体定义在 options.h
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // If "hash_index" is true, Finish() appends a hash index over the keys,
+  // which must be table keys written by the database (see
+  // BlockHashIndexHash() in table/format.h).  "format_version" selects
+  // the original block format (1) or the second one (2, see
+  // kBlockFormatV2Flag in table/format.h).
+  explicit BlockBuilder(const Options* options, bool hash_index = false,
+                        int format_version = 1);
 
   // 禁止复制
   BlockBuilder(const BlockBuilder&) = delete;
@@ -43,7 +50,7 @@ class BlockBuilder {
 
   // Return true iff no entries have been added since the last Reset()
   // 判断正在构建的 Block 是否为空白
-  bool empty() const { return buffer_.empty(); }
+  bool empty() const { return buffer_.empty() && entries_.empty(); }
 
  private:
   const Options* options_;
@@ -52,6 +59,27 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart 从上个重启点开始键值对的数量
   bool finished_;                   // Has Finish() been called? 是否调用过 finished
   std::string last_key_;            // 上一条记录的 key， 用于复用公共前缀
+
+  // Appends the hash index, if one should be written, and returns
+  // the flag to store next to num_restarts.
+  uint32_t AppendHashIndex(uint32_t num_restarts);
+  Slice FinishV2();
+
+  // In the second format buffer_ only collects the key deltas until
+  // Finish(), and restarts_ holds entry numbers instead of offsets.
+  struct Entry {
+    uint32_t shared;
+    uint32_t non_shared;
+    uint32_t value_length;
+  };
+  const bool format_v2_;
+  std::vector<Entry> entries_;
+  std::string values_;
+
+  const bool hash_index_;
+  bool hash_index_ok_;  // False if a key cannot be hashed
+  // (hash, restart index) of the first entry of every user key
+  std::vector<std::pair<uint32_t, uint32_t>> hash_entries_;
 };
 
 }  // namespace leveldb
@@ -16,8 +16,8 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, int level)
+    : policy_(policy), level_(level) {}
 
 // 参数 block_offset 是 DataBlock 结束的 offset
 // StartBlock 会构造 block_offset 之前所有数据的 filter 
@@ -80,7 +80,8 @@ void FilterBlockBuilder::GenerateFilter() {
   // Generate filter for current set of keys and append to result_.
   filter_offsets_.push_back(result_.size());
   // 调用 FilterPolicy 构造过滤器
-  policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+  policy_->CreateFilterForLevel(level_, &tmp_keys_[0],
+                                static_cast<int>(num_keys), &result_);
 
   // 重置状态
   tmp_keys_.clear();
@@ -101,7 +102,8 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
   num_ = (n - 5 - last_word) / 4;
 }
 
-bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+bool FilterBlockReader::KeyMayMatch(uint64_t block_offset,
+                                    const Slice& key) const {
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
@@ -117,4 +119,45 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy,
+                                               int level)
+    : policy_(policy), level_(level) {}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  result_.clear();
+  const size_t num_keys = start_.size();
+  if (num_keys == 0) {
+    // An empty filter does not match any key
+    return Slice(result_);
+  }
+
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i + 1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+  policy_->CreateFilterForLevel(level_, &tmp_keys_[0],
+                                static_cast<int>(num_keys), &result_);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+  return Slice(result_);
+}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) const {
+  if (contents_.empty()) {
+    // Empty filters do not match any keys
+    return false;
+  }
+  return policy_->KeyMayMatch(key, contents_);
+}
+
 }  // namespace leveldb
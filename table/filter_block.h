@@ -43,7 +43,8 @@ class FilterPolicy;
 //
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  // "level" is passed on to FilterPolicy::CreateFilterForLevel().
+  explicit FilterBlockBuilder(const FilterPolicy*, int level = -1);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -56,6 +57,7 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const int level_;
   // keys_ 是把所有 key join 成的长字符串，start_ 是每个 key 在 keys_ 中的开始地址
   // 比如 keys_="abcdef" start_=[0,3] 表示两个 key: abc 和 def
   std::string keys_;             // Flattened key contents;
@@ -66,12 +68,45 @@ class FilterBlockBuilder {
   std::vector<uint32_t> filter_offsets_;
 };
 
+// A FullFilterBlockBuilder builds one filter over every key added to it,
+// instead of one filter per kFilterBase bytes of data.  It is used both for
+// whole-table filters and for the partitions of a partitioned filter, in
+// which case Finish() is called once per partition.
+//
+// FullFilterBlockBuilder 为加入的所有 key 构建一个过滤器，而不是每 2KB 数据一个
+// 分区过滤器的每个分区也用它来构建，每个分区结束时调用一次 Finish()
+class FullFilterBlockBuilder {
+ public:
+  // "level" is passed on to FilterPolicy::CreateFilterForLevel().
+  explicit FullFilterBlockBuilder(const FilterPolicy*, int level = -1);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+
+  // Number of keys added since the last call to Finish().
+  size_t num_keys() const { return start_.size(); }
+
+  // Returns a filter over the keys added since the last call to Finish()
+  // and resets the key set.  The result stays valid until the next call.
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  const int level_;
+  std::string keys_;             // Flattened key contents
+  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string result_;           // Filter returned by the last Finish()
+  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+};
+
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
   // 在 FilterBlockReader 使用期间 "contents" 和 *policy 必须保持存活
   FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
-  bool KeyMayMatch(uint64_t block_offset, const Slice& key);
+  bool KeyMayMatch(uint64_t block_offset, const Slice& key) const;
 
  private:
   const FilterPolicy* policy_;
@@ -81,6 +116,22 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// Reader for a filter produced by FullFilterBlockBuilder.
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents)
+      : policy_(policy), contents_(contents) {}
+
+  bool KeyMayMatch(const Slice& key) const;
+
+  size_t size() const { return contents_.size(); }
+
+ private:
+  const FilterPolicy* policy_;
+  Slice contents_;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -119,4 +119,36 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullFilterEmpty) {
+  FullFilterBlockBuilder builder(&policy_);
+  Slice block = builder.Finish();
+  ASSERT_TRUE(block.empty());
+  FullFilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(!reader.KeyMayMatch("foo"));
+}
+
+TEST_F(FilterBlockTest, FullFilterPartitions) {
+  FullFilterBlockBuilder builder(&policy_);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  ASSERT_EQ(2, builder.num_keys());
+  std::string first = builder.Finish().ToString();
+  ASSERT_EQ(0, builder.num_keys());
+  builder.AddKey("box");
+  builder.AddKey("hello");
+  std::string second = builder.Finish().ToString();
+
+  FullFilterBlockReader first_reader(&policy_, first);
+  ASSERT_TRUE(first_reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(first_reader.KeyMayMatch("bar"));
+  ASSERT_TRUE(!first_reader.KeyMayMatch("box"));
+  ASSERT_TRUE(!first_reader.KeyMayMatch("hello"));
+
+  FullFilterBlockReader second_reader(&policy_, second);
+  ASSERT_TRUE(second_reader.KeyMayMatch("box"));
+  ASSERT_TRUE(second_reader.KeyMayMatch("hello"));
+  ASSERT_TRUE(!second_reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(!second_reader.KeyMayMatch("bar"));
+}
+
 }  // namespace leveldb
@@ -4,15 +4,26 @@
 
 #include "table/format.h"
 
+#include <cstring>
+
 #include "leveldb/env.h"
 #include "leveldb/options.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
+bool BlockHashIndexHash(const Slice& key, uint32_t* hash) {
+  if (key.size() < 8) {
+    return false;
+  }
+  *hash = Hash(key.data(), key.size() - 8, 0x7a3c9e1b);
+  return true;
+}
+
 void BlockHandle::EncodeTo(std::string* dst) const {
   // Sanity check that all fields have been set
   assert(offset_ != ~static_cast<uint64_t>(0));
@@ -33,9 +44,20 @@ void Footer::EncodeTo(std::string* dst) const {
   const size_t original_size = dst->size();
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
-  dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  uint64_t magic = kTableMagicNumber;
+  if (features_ != 0) {
+    // The two handles never need more than 36 bytes for files smaller than
+    // 2^63 bytes, which leaves room for the feature bitmask.
+    assert(dst->size() - original_size <=
+           2 * BlockHandle::kMaxEncodedLength - 4);
+    dst->resize(original_size + 2 * BlockHandle::kMaxEncodedLength - 4);
+    PutFixed32(dst, features_);
+    magic = kExtendedTableMagicNumber;
+  } else {
+    dst->resize(original_size + 2 * BlockHandle::kMaxEncodedLength);  // Padding
+  }
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -50,7 +72,13 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  features_ = 0;
+  if (magic == kExtendedTableMagicNumber) {
+    features_ = DecodeFixed32(magic_ptr - 4);
+    if ((features_ & ~kKnownTableFeatures) != 0) {
+      return Status::NotSupported("sstable uses unknown format features");
+    }
+  } else if (magic != kTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
 
@@ -66,9 +94,82 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
+// 将带类型字节的原始 block 解压到 *result
+Status UncompressBlock(
+    const Slice& raw, BlockContents* result,
+    const port::ZstdDecompressionDictionary* zstd_dictionary) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+  if (raw.empty()) {
+    return Status::Corruption("bad block type");
+  }
+  const char* data = raw.data();
+  const size_t n = raw.size() - 1;
+
+  switch (data[n]) {
+    case kNoCompression: {
+      char* ubuf = new char[n];
+      std::memcpy(ubuf, data, n);
+      result->data = Slice(ubuf, n);
+      break;
+    }
+    case kSnappyCompression: {
+      size_t ulength = 0;
+      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted snappy compressed block length");
+      }
+      char* ubuf = new char[ulength];
+      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted snappy compressed block contents");
+      }
+      result->data = Slice(ubuf, ulength);
+      break;
+    }
+    case kLZ4Compression: {
+      size_t ulength = 0;
+      if (!port::Lz4_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted lz4 compressed block length");
+      }
+      char* ubuf = new char[ulength];
+      if (!port::Lz4_Uncompress(data, n, ubuf)) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted lz4 compressed block contents");
+      }
+      result->data = Slice(ubuf, ulength);
+      break;
+    }
+    case kZstdCompression: {
+      size_t ulength = 0;
+      if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+        return Status::Corruption("corrupted zstd compressed block length");
+      }
+      char* ubuf = new char[ulength];
+      const bool ok = zstd_dictionary != nullptr
+                          ? zstd_dictionary->Uncompress(data, n, ubuf)
+                          : port::Zstd_Uncompress(data, n, ubuf);
+      if (!ok) {
+        delete[] ubuf;
+        return Status::Corruption("corrupted zstd compressed block contents");
+      }
+      result->data = Slice(ubuf, ulength);
+      break;
+    }
+    default:
+      return Status::Corruption("bad block type");
+  }
+
+  result->heap_allocated = true;
+  result->cachable = true;
+  return Status::OK();
+}
+
 // 从 *file 中读取 BlockHandle 指向的 Block
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+                 const BlockHandle& handle, BlockContents* result,
+                 std::string* raw,
+                 const port::ZstdDecompressionDictionary* zstd_dictionary) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
@@ -105,66 +206,32 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   }
 
   // 解压缩
-  switch (data[n]) {
-    case kNoCompression:
-      if (data != buf) {
-        // File implementation gave us pointer to some other data.
-        // Use it directly under the assumption that it will be live
-        // while the file is open.
-        delete[] buf;
-        result->data = Slice(data, n);
-        result->heap_allocated = false;
-        result->cachable = false;  // Do not double-cache
-      } else {
-        result->data = Slice(buf, n);
-        result->heap_allocated = true;
-        result->cachable = true;
-      }
-
-      // Ok
-      break;
-    case kSnappyCompression: {
-      size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
-        delete[] buf;
-        return Status::Corruption("corrupted snappy compressed block length");
-      }
-      char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
-        delete[] buf;
-        delete[] ubuf;
-        return Status::Corruption("corrupted snappy compressed block contents");
-      }
+  if (data[n] == kNoCompression) {
+    if (data != buf) {
+      // File implementation gave us pointer to some other data.
+      // Use it directly under the assumption that it will be live
+      // while the file is open.
       delete[] buf;
-      result->data = Slice(ubuf, ulength);
+      result->data = Slice(data, n);
+      result->heap_allocated = false;
+      result->cachable = false;  // Do not double-cache
+    } else {
+      result->data = Slice(buf, n);
       result->heap_allocated = true;
       result->cachable = true;
-      break;
     }
-    case kZstdCompression: {
-      size_t ulength = 0;
-      if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
-        delete[] buf;
-        return Status::Corruption("corrupted zstd compressed block length");
-      }
-      char* ubuf = new char[ulength];
-      if (!port::Zstd_Uncompress(data, n, ubuf)) {
-        delete[] buf;
-        delete[] ubuf;
-        return Status::Corruption("corrupted zstd compressed block contents");
-      }
-      delete[] buf;
-      result->data = Slice(ubuf, ulength);
-      result->heap_allocated = true;
-      result->cachable = true;
-      break;
+    if (raw != nullptr) {
+      raw->assign(data, n + 1);
     }
-    default:
-      delete[] buf;
-      return Status::Corruption("bad block type");
+    return Status::OK();
   }
 
-  return Status::OK();
+  if (raw != nullptr) {
+    raw->assign(data, n + 1);
+  }
+  s = UncompressBlock(Slice(data, n + 1), result, zstd_dictionary);
+  delete[] buf;
+  return s;
 }
 
 }  // namespace leveldb
@@ -18,6 +18,10 @@ class Block;
 class RandomAccessFile;
 struct ReadOptions;
 
+namespace port {
+class ZstdDecompressionDictionary;
+}  // namespace port
+
 // BlockHandle is a pointer to the extent of a file that stores a data
 // block or a meta block.
 class BlockHandle {
@@ -43,6 +47,30 @@ class BlockHandle {
   uint64_t size_;
 };
 
+// Bits of Footer::features().  A table that uses any of these features
+// cannot be interpreted correctly by a reader that does not know about
+// them, so such tables are written with kExtendedTableMagicNumber and
+// older readers reject them instead of returning wrong results.
+enum TableFeature : uint32_t {
+  // The index block is a top-level index over index partitions.
+  kTableFeaturePartitionedIndex = 1u << 0,
+  // Data blocks may end in a hash index, see kBlockHashIndexFlag.
+  kTableFeatureDataBlockHashIndex = 1u << 1,
+  // Data blocks use the second block format, see kBlockFormatV2Flag.
+  kTableFeatureBlockFormatV2 = 1u << 2,
+  // Zstd data blocks are compressed with the dictionary stored in the
+  // meta block named by kZstdDictionaryMetaKey.
+  kTableFeatureZstdDictionary = 1u << 3,
+};
+
+// All feature bits understood by this version of the code.
+static const uint32_t kKnownTableFeatures =
+    kTableFeaturePartitionedIndex | kTableFeatureDataBlockHashIndex |
+    kTableFeatureBlockFormatV2 | kTableFeatureZstdDictionary;
+
+// Key of the zstd dictionary in the metaindex block.
+static const char kZstdDictionaryMetaKey[] = "zstd.dictionary";
+
 // Footer encapsulates the fixed information stored at the tail
 // end of every table file.
 class Footer {
@@ -52,7 +80,12 @@ class Footer {
   // of two block handles and a magic number.
   enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
 
-  Footer() = default;
+  Footer() : features_(0) {}
+
+  // Bitmask of TableFeature values used by the table.  Zero for tables
+  // in the original format.
+  uint32_t features() const { return features_; }
+  void set_features(uint32_t features) { features_ = features; }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -68,6 +101,7 @@ class Footer {
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  uint32_t features_;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,9 +109,52 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables whose footer carries a feature bitmask.  The
+// bitmask occupies the last 4 bytes of the footer padding.
+static const uint64_t kExtendedTableMagicNumber = 0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// A data block with a hash index ends in
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint16
+//     num_restarts | kBlockHashIndexFlag: uint32
+// Each bucket holds the index of the restart interval in which the first
+// entry of the keys hashing to it is stored, or one of the markers below.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kBlockHashIndexNoEntry = 255;
+static const uint8_t kBlockHashIndexCollision = 254;
+// Blocks with more restart points are written without a hash index.
+static const uint32_t kBlockHashIndexMaxRestarts = 253;
+
+// A block in the second format stores keys and values in separate sections
+// and uses fixed-width fields instead of varints:
+//     keys: entry[num_entries]
+//         entry: shared_bytes, unshared_bytes, value_length: uintW
+//                key_delta: char[unshared_bytes]
+//     values: char[] -- the values of all entries, in order
+//     restarts: (key_offset, value_offset: uintW)[num_restarts]
+//     [buckets and num_buckets of the hash index, as above]
+//     keys_size: uint32
+//     num_restarts | kBlockFormatV2Flag [| kBlockWideFieldsFlag]: uint32
+// uintW is a little-endian uint16, or a uint32 if kBlockWideFieldsFlag is
+// set because the keys and values of the block do not fit in 64KiB.
+// Offsets are relative to the start of their section.
+static const uint32_t kBlockFormatV2Flag = 1u << 30;
+static const uint32_t kBlockWideFieldsFlag = 1u << 29;
+
+// All flags that may be stored next to num_restarts.
+static const uint32_t kBlockRestartFlags =
+    kBlockHashIndexFlag | kBlockFormatV2Flag | kBlockWideFieldsFlag;
+
+// Sets "*hash" to the hash index value of "key", a table key that ends in
+// an 8-byte sequence number and type as written by the database.  All
+// entries of a user key share one hash.  Returns false if "key" is too
+// short to carry the tag.
+bool BlockHashIndexHash(const Slice& key, uint32_t* hash);
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -86,8 +163,22 @@ struct BlockContents {
 
 // Read the block identified by "handle" from "file".  On failure
 // return non-OK.  On success fill *result and return OK.
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result);
+//
+// If "raw" is non-null, the block as stored in the file, followed by its
+// one-byte compression type, is copied into *raw.  Zstd blocks are
+// decompressed with "zstd_dictionary" if it is non-null.
+Status ReadBlock(
+    RandomAccessFile* file, const ReadOptions& options,
+    const BlockHandle& handle, BlockContents* result,
+    std::string* raw = nullptr,
+    const port::ZstdDecompressionDictionary* zstd_dictionary = nullptr);
+
+// Decompress "raw" (stored block bytes followed by the one-byte
+// compression type, as returned through ReadBlock's "raw" argument)
+// into *result.  On success result->data is heap allocated.
+Status UncompressBlock(
+    const Slice& raw, BlockContents* result,
+    const port::ZstdDecompressionDictionary* zstd_dictionary = nullptr);
 
 // Implementation details follow.  Clients should ignore,
 
@@ -4,11 +4,16 @@
 
 #include "leveldb/table.h"
 
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/persistent_cache.h"
+#include "leveldb/slice_transform.h"
+#include "port/port.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -17,24 +22,283 @@
 
 namespace leveldb {
 
+namespace {
+
+// A whole-table filter or a filter partition, together with the memory it
+// reads from, so that it can be stored in the block cache.
+class TableFilter {
+ public:
+  TableFilter(const FilterPolicy* policy, const BlockContents& contents,
+              bool block_based)
+      : contents_(contents),
+        block_based_(block_based ? new FilterBlockReader(policy, contents.data)
+                                 : nullptr),
+        full_(policy, contents.data) {}
+
+  TableFilter(const TableFilter&) = delete;
+  TableFilter& operator=(const TableFilter&) = delete;
+
+  ~TableFilter() {
+    delete block_based_;
+    if (contents_.heap_allocated) {
+      delete[] contents_.data.data();
+    }
+  }
+
+  bool KeyMayMatch(uint64_t block_offset, const Slice& key) const {
+    if (block_based_ != nullptr) {
+      return block_based_->KeyMayMatch(block_offset, key);
+    }
+    return full_.KeyMayMatch(key);
+  }
+
+ private:
+  BlockContents contents_;
+  FilterBlockReader* block_based_;  // Null for full filters
+  FullFilterBlockReader full_;
+};
+
+// The caches a table reads its blocks through, with the ids that identify
+// the table in each of them, and the dictionary its zstd data blocks are
+// compressed with.
+struct BlockCaches {
+  Cache* block_cache;
+  uint64_t cache_id;
+  Cache* compressed_cache;
+  uint64_t compressed_cache_id;
+  // Null until the table knows its file number, see Table::SetFileNumber.
+  PersistentCache* persistent_cache;
+  char persistent_key_prefix[16];  // File number and file size
+  const port::ZstdDecompressionDictionary* zstd_dictionary;  // May be null
+};
+
+}  // namespace
+
 struct Table::Rep {
   ~Rep() {
-    delete filter;
-    delete[] filter_data;
-    delete index_block;
+    if (index_cache_handle != nullptr) {
+      options.block_cache->Release(index_cache_handle);
+    } else {
+      delete index_block;
+    }
+    if (filter_cache_handle != nullptr) {
+      options.block_cache->Release(filter_cache_handle);
+    } else {
+      delete filter;
+      delete filter_index;
+    }
+    delete caches.zstd_dictionary;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
-  uint64_t cache_id;
-  FilterBlockReader* filter;
-  const char* filter_data;
+  BlockCaches caches;
+
+  // filter 和 filter_index 都为空时，过滤器只保存在 block cache 中
+  bool has_filter;
+  FilterType filter_type;
+  BlockHandle filter_handle;
+  TableFilter* filter;  // Whole-table filter, unless only in block cache
+  // 分区过滤器的顶层索引，每一项指向一个 filter 分区
+  Block* filter_index;  // Top-level index of a partitioned filter, likewise
+  // Non-null if *filter or *filter_index is pinned in block cache
+  Cache::Handle* filter_cache_handle;
+  // True if the filter also holds the key prefixes of
+  // options.prefix_extractor
+  bool prefix_filtered;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  BlockHandle index_handle;
+  // 分区索引时存储的是指向各个 index 分区的顶层索引
+  // 为空时 index block 只保存在 block cache 中
+  Block* index_block;  // Top-level index if partitioned_index is true
+  Cache::Handle* index_cache_handle;  // Non-null if *index_block is pinned
+  bool partitioned_index;
 };
 
+namespace {
+
+// Turns the contents of a block into the object stored in the block cache
+// for it.
+typedef void* (*BlockLoader)(const FilterPolicy* policy,
+                             const BlockContents& contents);
+
+void* LoadBlock(const FilterPolicy* policy, const BlockContents& contents) {
+  return new Block(contents);
+}
+
+void* LoadBlockBasedFilter(const FilterPolicy* policy,
+                           const BlockContents& contents) {
+  return new TableFilter(policy, contents, true);
+}
+
+void* LoadFullFilter(const FilterPolicy* policy,
+                     const BlockContents& contents) {
+  return new TableFilter(policy, contents, false);
+}
+
+void DeleteBlock(void* arg, void* ignored) {
+  delete reinterpret_cast<Block*>(arg);
+}
+
+void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<TableFilter*>(value);
+}
+
+void DeleteCompressedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
+// cache key 的格式为 table.cache_id + offset
+Slice BlockCacheKey(uint64_t cache_id, const BlockHandle& handle,
+                    char (*buf)[16]) {
+  EncodeFixed64(*buf, cache_id);
+  EncodeFixed64(*buf + 8, handle.offset());
+  return Slice(*buf, sizeof(*buf));
+}
+
+// Builds the key of the block at "handle" in caches.persistent_cache.
+// Unlike cache ids, file numbers stay the same across restarts.
+Slice PersistentCacheKey(const BlockCaches& caches, const BlockHandle& handle,
+                         char (*buf)[24]) {
+  std::memcpy(*buf, caches.persistent_key_prefix, 16);
+  EncodeFixed64(*buf + 16, handle.offset());
+  return Slice(*buf, sizeof(*buf));
+}
+
+// Sets *value to the object built by "load" for the block at "handle".
+// The block is looked up in the caches of "caches" that are non-null,
+// fastest first: the block cache, the cache of compressed blocks and the
+// persistent cache.  Only if all of them miss is the block read from the
+// file.  A block found in a slower tier or read from the file is inserted
+// into the faster ones if "fill_cache" is true.  If *cache_handle is
+// non-null on return, *value belongs to the block cache and the caller
+// must release the handle; otherwise the caller owns *value.
+// 依次查询 block cache、压缩块缓存和持久化缓存，都未命中时才从文件中读取
+Status ReadThroughCache(RandomAccessFile* file, const BlockCaches& caches,
+                        const ReadOptions& options, const BlockHandle& handle,
+                        bool fill_cache, Cache::Priority priority,
+                        const FilterPolicy* policy, BlockLoader load,
+                        void (*deleter)(const Slice&, void*), void** value,
+                        Cache::Handle** cache_handle) {
+  *value = nullptr;
+  *cache_handle = nullptr;
+  Cache* cache = caches.block_cache;
+  char buf[16];
+  Slice key = BlockCacheKey(caches.cache_id, handle, &buf);
+  if (cache != nullptr) {
+    *cache_handle = cache->Lookup(key);
+    if (*cache_handle != nullptr) {
+      *value = cache->Value(*cache_handle);
+      return Status::OK();
+    }
+  }
+
+  BlockContents contents;
+  Status s;
+  bool found = false;
+  Cache* compressed_cache = caches.compressed_cache;
+  char compressed_buf[16];
+  Slice compressed_key;
+  if (compressed_cache != nullptr) {
+    compressed_key =
+        BlockCacheKey(caches.compressed_cache_id, handle, &compressed_buf);
+    Cache::Handle* h = compressed_cache->Lookup(compressed_key);
+    if (h != nullptr) {
+      const std::string* raw =
+          reinterpret_cast<std::string*>(compressed_cache->Value(h));
+      s = UncompressBlock(*raw, &contents, caches.zstd_dictionary);
+      compressed_cache->Release(h);
+      found = true;
+    }
+  }
+
+  // The stored form of the block, for the tiers that missed.
+  std::string raw;
+  PersistentCache* persistent_cache = caches.persistent_cache;
+  char persistent_buf[24];
+  Slice persistent_key;
+  if (persistent_cache != nullptr) {
+    persistent_key = PersistentCacheKey(caches, handle, &persistent_buf);
+  }
+  if (!found && persistent_cache != nullptr &&
+      persistent_cache->Lookup(persistent_key, &raw)) {
+    s = UncompressBlock(raw, &contents, caches.zstd_dictionary);
+    found = true;
+  } else if (!found) {
+    const bool want_raw = fill_cache && (compressed_cache != nullptr ||
+                                         persistent_cache != nullptr);
+    s = ReadBlock(file, options, handle, &contents,
+                  want_raw ? &raw : nullptr, caches.zstd_dictionary);
+    if (s.ok() && want_raw && persistent_cache != nullptr) {
+      persistent_cache->Insert(persistent_key, raw);
+    }
+  }
+  if (s.ok() && fill_cache && compressed_cache != nullptr && !raw.empty() &&
+      raw.back() != kNoCompression) {
+    compressed_cache->Release(compressed_cache->Insert(
+        compressed_key, new std::string(raw), raw.size(),
+        &DeleteCompressedBlock));
+  }
+
+  if (s.ok()) {
+    *value = (*load)(policy, contents);
+    if (cache != nullptr && contents.cachable && fill_cache) {
+      *cache_handle = cache->Insert(key, *value, contents.data.size(), deleter,
+                                    priority);
+    }
+  }
+  return s;
+}
+
+// Reads the zstd dictionary that the metaindex block at "metaindex_handle"
+// points to into *dictionary.
+Status ReadZstdDictionary(RandomAccessFile* file, const ReadOptions& options,
+                          const BlockHandle& metaindex_handle,
+                          std::string* dictionary) {
+  BlockContents contents;
+  Status s = ReadBlock(file, options, metaindex_handle, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  Block* meta = new Block(contents);
+  Iterator* iter = meta->NewIterator(BytewiseComparator());
+  iter->Seek(kZstdDictionaryMetaKey);
+  BlockHandle handle;
+  if (!iter->Valid() || iter->key() != Slice(kZstdDictionaryMetaKey)) {
+    s = Status::Corruption("missing zstd dictionary");
+  } else {
+    Slice v = iter->value();
+    s = handle.DecodeFrom(&v);
+  }
+  delete iter;
+  delete meta;
+  if (s.ok()) {
+    s = ReadBlock(file, options, handle, &contents);
+  }
+  if (s.ok()) {
+    dictionary->assign(contents.data.data(), contents.data.size());
+    if (contents.heap_allocated) {
+      delete[] contents.data.data();
+    }
+  }
+  return s;
+}
+
+}  // namespace
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -60,6 +324,12 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   if (options.paranoid_checks) {
     opt.verify_checksums = true;
   }
+  std::string zstd_dictionary;
+  if ((footer.features() & kTableFeatureZstdDictionary) != 0) {
+    s = ReadZstdDictionary(file, opt, footer.metaindex_handle(),
+                           &zstd_dictionary);
+    if (!s.ok()) return s;
+  }
   s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
 
   if (s.ok()) {
@@ -71,12 +341,46 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
+    rep->index_handle = footer.index_handle();
     rep->index_block = index_block;
-    rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
+    rep->index_cache_handle = nullptr;
+    rep->partitioned_index =
+        (footer.features() & kTableFeaturePartitionedIndex) != 0;
+    rep->caches.block_cache = options.block_cache;
+    rep->caches.cache_id =
+        (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->caches.compressed_cache = options.compressed_block_cache;
+    rep->caches.compressed_cache_id =
+        (options.compressed_block_cache
+             ? options.compressed_block_cache->NewId()
+             : 0);
+    rep->caches.persistent_cache = nullptr;
+    rep->caches.zstd_dictionary =
+        zstd_dictionary.empty()
+            ? nullptr
+            : new port::ZstdDecompressionDictionary(zstd_dictionary.data(),
+                                                    zstd_dictionary.size());
+    EncodeFixed64(rep->caches.persistent_key_prefix, 0);
+    EncodeFixed64(rep->caches.persistent_key_prefix + 8, size);
+    rep->has_filter = false;
     rep->filter = nullptr;
+    rep->filter_index = nullptr;
+    rep->filter_cache_handle = nullptr;
+    rep->prefix_filtered = false;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
+
+    // 将 index block 交给 block cache 管理，占用的内存计入 cache 的容量
+    Cache* block_cache = options.block_cache;
+    if (options.cache_index_and_filter_blocks && block_cache != nullptr &&
+        index_block_contents.cachable) {
+      char buf[16];
+      block_cache->Release(block_cache->Insert(
+          BlockCacheKey(rep->caches.cache_id, rep->index_handle, &buf),
+          index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::kHighPriority));
+      rep->index_block = nullptr;
+    }
   }
 
   return s;
@@ -103,18 +407,36 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   // 根据 MetaIndex 找到 FilterBlock
+  // 一个 table 最多只有一种格式的过滤器
+  static const struct {
+    const char* prefix;
+    FilterType type;
+  } kFilterPrefixes[] = {
+      {"filter.", kBlockBasedFilter},
+      {"fullfilter.", kFullFilter},
+      {"partitionedfilter.", kPartitionedFilter},
+  };
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  for (const auto& filter_prefix : kFilterPrefixes) {
+    std::string key = filter_prefix.prefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), filter_prefix.type);
+      break;
+    }
+  }
+  if (rep_->has_filter && rep_->options.prefix_extractor != nullptr) {
+    std::string key = "prefixextractor.";
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    rep_->prefix_filtered = iter->Valid() && iter->key() == Slice(key);
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, FilterType type) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -131,38 +453,125 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
-  if (block.heap_allocated) {
-    rep_->filter_data = block.data.data();  // Will need to delete later
+  rep_->has_filter = true;
+  rep_->filter_type = type;
+  rep_->filter_handle = filter_handle;
+  if (type == kPartitionedFilter) {
+    // Only the top-level index is kept; partitions go through the cache.
+    rep_->filter_index = new Block(block);
+  } else {
+    rep_->filter = new TableFilter(rep_->options.filter_policy, block,
+                                   type == kBlockBasedFilter);
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
-}
 
-Table::~Table() { delete rep_; }
+  Cache* block_cache = rep_->options.block_cache;
+  if (rep_->options.cache_index_and_filter_blocks && block_cache != nullptr &&
+      block.cachable) {
+    char buf[16];
+    Slice key = BlockCacheKey(rep_->caches.cache_id, filter_handle, &buf);
+    if (type == kPartitionedFilter) {
+      block_cache->Release(block_cache->Insert(
+          key, rep_->filter_index, block.data.size(), &DeleteCachedBlock,
+          Cache::kHighPriority));
+      rep_->filter_index = nullptr;
+    } else {
+      block_cache->Release(block_cache->Insert(key, rep_->filter,
+                                               block.data.size(),
+                                               &DeleteCachedFilter,
+                                               Cache::kHighPriority));
+      rep_->filter = nullptr;
+    }
+  }
+}
 
-static void DeleteBlock(void* arg, void* ignored) {
-  delete reinterpret_cast<Block*>(arg);
+void Table::SetFileNumber(uint64_t file_number) {
+  rep_->caches.persistent_cache = rep_->options.persistent_cache;
+  EncodeFixed64(rep_->caches.persistent_key_prefix, file_number);
 }
 
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+void Table::PinMetaBlocks() {
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  const FilterPolicy* policy = rep_->options.filter_policy;
+  void* value;
+  Cache::Handle* handle;
+  if (rep_->index_block == nullptr &&
+      ReadThroughCache(rep_->file, rep_->caches, opt, rep_->index_handle,
+                       true, Cache::kHighPriority, policy, &LoadBlock,
+                       &DeleteCachedBlock, &value, &handle)
+          .ok()) {
+    rep_->index_block = reinterpret_cast<Block*>(value);
+    rep_->index_cache_handle = handle;
+  }
+  if (!rep_->has_filter || rep_->filter != nullptr ||
+      rep_->filter_index != nullptr) {
+    return;
+  }
+  if (rep_->filter_type == kPartitionedFilter) {
+    if (ReadThroughCache(rep_->file, rep_->caches, opt, rep_->filter_handle,
+                         true, Cache::kHighPriority, policy, &LoadBlock,
+                         &DeleteCachedBlock, &value, &handle)
+            .ok()) {
+      rep_->filter_index = reinterpret_cast<Block*>(value);
+      rep_->filter_cache_handle = handle;
+    }
+  } else {
+    BlockLoader load = (rep_->filter_type == kBlockBasedFilter)
+                           ? &LoadBlockBasedFilter
+                           : &LoadFullFilter;
+    if (ReadThroughCache(rep_->file, rep_->caches, opt, rep_->filter_handle,
+                         true, Cache::kHighPriority, policy, load,
+                         &DeleteCachedFilter, &value, &handle)
+            .ok()) {
+      rep_->filter = reinterpret_cast<TableFilter*>(value);
+      rep_->filter_cache_handle = handle;
+    }
+  }
 }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
+Table::~Table() { delete rep_; }
+
+// 打开 handle 指向的 Block，返回这个 Block 上的 Block::Iterator
+// 启用了 block cache 时先从 cache 中读取 Block
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const BlockHandle& handle,
+                                  Cache::Priority priority,
+                                  const Slice* get_target) const {
+  Cache* block_cache = rep_->options.block_cache;
+  void* value;
+  Cache::Handle* cache_handle;
+  Status s = ReadThroughCache(rep_->file, rep_->caches, options, handle,
+                              options.fill_cache, priority, nullptr,
+                              &LoadBlock, &DeleteCachedBlock, &value,
+                              &cache_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  // 创建 iter
+  Block* block = reinterpret_cast<Block*>(value);
+  Iterator* iter =
+      (get_target == nullptr)
+          ? block->NewIterator(rep_->options.comparator)
+          : block->NewIteratorForGet(rep_->options.comparator, *get_target);
+  if (cache_handle == nullptr) {
+    // 未写入缓存，delete 掉 Block 指针就可以了
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  } else {
+    // 启用了缓存，释放掉 cache 的引用计数
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  }
+  return iter;
 }
 
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
-// 打开 BlockHandle 指向的 Block，返回这个 Block 上的 Block::Iterator
+// 打开 BlockHandle 指向的 DataBlock，返回这个 Block 上的 Block::Iterator
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = nullptr;
-  Cache::Handle* cache_handle = nullptr;
 
   // 解码 BlockHandle
   BlockHandle handle;
@@ -170,63 +579,110 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   Status s = handle.DecodeFrom(&input);
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return table->NewBlockIterator(options, handle, Cache::kLowPriority);
+}
 
-  if (s.ok()) {
-    BlockContents contents;
-    if (block_cache != nullptr) {
-      // table 启用了 cache，尝试从 cache 中读取 Block 的内容
-      // cache key 的格式为 table.cache_id + offset，value 为 Block
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != nullptr) {
-        // 缓存中有对应 Block
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        // 缓存中没有对应 Block，从文件中读取并写入缓存
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
-          }
-        }
-      }
-    } else {
-      // 未启用缓存，直接从文件读取
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
-      }
-    }
+// Like BlockReader(), but for index partitions, which are cached with high
+// priority.
+Iterator* Table::MetaBlockReader(void* arg, const ReadOptions& options,
+                                 const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
   }
+  return table->NewBlockIterator(options, handle, Cache::kHighPriority);
+}
 
-  // 创建 iter
+// 创建迭代器，table 的迭代器为 TwoLevelIterator
+// TwoLevelIterator 第一层遍历所有 DataBlock, 第二层使用 Block:Iter 遍历数据块内部
+Iterator* Table::NewIterator(const ReadOptions& options) const {
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
   Iterator* iter;
-  if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == nullptr) {
-      // 未启用缓存，delete 掉 Block 指针就可以了
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      // 启用了缓存，释放掉 cache 的引用计数
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
-    }
+  if (rep_->index_block != nullptr) {
+    iter = rep_->index_block->NewIterator(rep_->options.comparator);
   } else {
-    iter = NewErrorIterator(s);
+    // index block 保存在 block cache 中，被淘汰后重新读取并写入缓存
+    ReadOptions index_options = options;
+    index_options.fill_cache = true;
+    iter = NewBlockIterator(index_options, rep_->index_handle,
+                            Cache::kHighPriority);
+  }
+  if (rep_->partitioned_index) {
+    // 顶层索引的每一项指向一个 index 分区，index 分区和 DataBlock 一样
+    // 经 block cache 按需读取
+    iter = NewTwoLevelIterator(iter, &Table::MetaBlockReader,
+                               const_cast<Table*>(this), options);
   }
   return iter;
 }
 
-// 创建迭代器，table 的迭代器为 TwoLevelIterator
-// TwoLevelIterator 第一层遍历所有 DataBlock, 第二层使用 Block:Iter 遍历数据块内部
-Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+bool Table::KeyMayMatch(const ReadOptions& options, uint64_t block_offset,
+                        const Slice& target, const Slice& key) {
+  if (!rep_->has_filter) {
+    return true;
+  }
+  if (rep_->filter != nullptr) {
+    return rep_->filter->KeyMayMatch(block_offset, key);
+  }
+
+  // 过滤器保存在 block cache 中，被淘汰后重新读取并写入缓存
+  BlockHandle handle = rep_->filter_handle;
+  bool fill_cache = true;
+  if (rep_->filter_type == kPartitionedFilter) {
+    // 在顶层索引中找到 key 所在的 filter 分区
+    Iterator* iter;
+    if (rep_->filter_index != nullptr) {
+      iter = rep_->filter_index->NewIterator(rep_->options.comparator);
+    } else {
+      ReadOptions index_options = options;
+      index_options.fill_cache = true;
+      iter = NewBlockIterator(index_options, rep_->filter_handle,
+                              Cache::kHighPriority);
+    }
+    iter->Seek(target);
+    bool found = false;
+    if (iter->Valid()) {
+      Slice input = iter->value();
+      found = handle.DecodeFrom(&input).ok();
+    }
+    delete iter;
+    if (!found) {
+      return true;  // Errors are treated as potential matches
+    }
+    fill_cache = options.fill_cache;
+  }
+
+  BlockLoader load = (rep_->filter_type == kBlockBasedFilter)
+                         ? &LoadBlockBasedFilter
+                         : &LoadFullFilter;
+  Cache* block_cache = rep_->options.block_cache;
+  void* value;
+  Cache::Handle* cache_handle;
+  if (!ReadThroughCache(rep_->file, rep_->caches, options, handle, fill_cache,
+                        Cache::kHighPriority, rep_->options.filter_policy, load,
+                        &DeleteCachedFilter, &value, &cache_handle)
+           .ok()) {
+    return true;
+  }
+
+  TableFilter* filter = reinterpret_cast<TableFilter*>(value);
+  const bool result = filter->KeyMayMatch(block_offset, key);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete filter;
+  }
+  return result;
 }
 
 // 在 Table 中寻找 k, 如果找到则回调 handle_result 函数
@@ -234,23 +690,22 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
   // 在 index_block 中寻找对应的 DataBlock
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
     // 如果有 filter 尝试从 filter 中判断键值对是否存在
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (s.ok() && !KeyMayMatch(options, handle.offset(), k, k)) {
         // 通过 filter 判断键值对不存在，跳过搜索
         // Not found
-    } else {
+    } else if (s.ok()) {
       // 没有 filter 或者 filter 判断键值对存在
-      // 打开 Block 尝试搜索键值对
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k); // Seek 的实现在 block.cc 的 Block::Iter::Seek 中
+      // 打开 Block 尝试搜索键值对，有哈希索引时不需要二分查找
+      Iterator* block_iter =
+          NewBlockIterator(options, handle, Cache::kLowPriority, &k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
       }
@@ -265,10 +720,37 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+bool Table::PrefixMayMatch(const ReadOptions& options, const Slice& target,
+                           const Slice& probe) {
+  if (!rep_->prefix_filtered) {
+    return true;
+  }
+  // Keys with the prefix of target that are >= target start in the data
+  // block holding target, so only the filter covering it is consulted.
+  uint64_t block_offset = 0;
+  if (rep_->filter_type == kBlockBasedFilter) {
+    Iterator* iiter = NewIndexIterator(options);
+    iiter->Seek(target);
+    bool found = false;
+    if (iiter->Valid()) {
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      if (handle.DecodeFrom(&handle_value).ok()) {
+        block_offset = handle.offset();
+        found = true;
+      }
+    }
+    delete iiter;
+    if (!found) {
+      return true;
+    }
+  }
+  return KeyMayMatch(options, block_offset, target, probe);
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   // 打开 index_block 的迭代器
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   // 在 index_block 中返回第一个大于等于 key 的 DataBlock 索引项
   index_iter->Seek(key);
   uint64_t result;
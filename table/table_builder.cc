@@ -4,39 +4,163 @@
 
 #include "leveldb/table_builder.h"
 
+#include <algorithm>
 #include <cassert>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+namespace {
+
+// Returns the compression of tables written to "level", or of tables of
+// unknown level if it is negative.
+CompressionType CompressionForLevel(const Options& options, int level) {
+  const std::vector<CompressionType>& per_level = options.compression_per_level;
+  if (level < 0 || per_level.empty()) {
+    return options.compression;
+  }
+  if (static_cast<size_t>(level) >= per_level.size()) {
+    return per_level.back();
+  }
+  return per_level[level];
+}
+
+// Adaptive compression skips data blocks after this many in a row failed
+// to compress, and tries again after skipping between kMinSkippedBlocks
+// and kMaxSkippedBlocks blocks.
+const int kIncompressibleStreak = 4;
+const int kMinSkippedBlocks = 16;
+const int kMaxSkippedBlocks = 256;
+
+// Compresses "raw" with "compression", using "*compressed" as the output
+// buffer.  Zstd uses "zstd_dictionary" if it is non-null.  Returns the
+// contents to store and sets "*type" to the type they are stored with:
+// kNoCompression if the compressor is unavailable or saves less than
+// 12.5%.
+Slice CompressBlock(const Slice& raw, CompressionType compression,
+                    int zstd_level,
+                    const port::ZstdCompressionDictionary* zstd_dictionary,
+                    std::string* compressed, CompressionType* type) {
+  bool ok = false;
+  // TODO(postrelease): Support more compression options: zlib?
+  switch (compression) {
+    case kNoCompression:
+      break;
+
+    case kSnappyCompression:
+      ok = port::Snappy_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kLZ4Compression:
+      ok = port::Lz4_Compress(raw.data(), raw.size(), compressed);
+      break;
+
+    case kZstdCompression:
+      ok = zstd_dictionary != nullptr
+               ? zstd_dictionary->Compress(raw.data(), raw.size(), compressed)
+               : port::Zstd_Compress(zstd_level, raw.data(), raw.size(),
+                                     compressed);
+      break;
+  }
+  if (ok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+    *type = compression;
+    return *compressed;
+  }
+  // Not compressed, not supported, or compressed less than 12.5%, so just
+  // store uncompressed form
+  *type = kNoCompression;
+  return raw;
+}
+
+// A data block that is written after it has been compressed by the
+// workers, or once the zstd dictionary it is compressed with is trained.
+// 等待压缩线程或 zstd 字典训练完成后才写入的 DataBlock
+struct PendingBlock {
+  std::string raw;
+  CompressionType compression;
+  int zstd_level;
+  const port::ZstdCompressionDictionary* zstd_dictionary;
+
+  // Set once compressed.
+  bool compressed_done;
+  std::string compressed;
+  Slice contents;  // Points into raw or compressed
+  CompressionType type;
+
+  // The keys of the block, which are added to the filter only when the
+  // block is written so that the filter sees the same keys and offsets,
+  // in the same order, as when blocks are written inline.
+  std::string filter_keys;
+  std::vector<size_t> filter_key_sizes;
+
+  // Key of the index entry for the block, known once the next block
+  // starts or the table is finished.
+  bool has_separator;
+  std::string separator;
+};
+
+}  // namespace
+
 struct TableBuilder::Rep {
-  Rep(const Options& opt, WritableFile* f)
+  Rep(const Options& opt, WritableFile* f, int level)
       : options(opt),
         index_block_options(opt),
+        level(level),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, opt.data_block_hash_index,
+                   opt.block_format_version),
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
-                         ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        filter_block(nullptr),
+        full_filter_block(nullptr),
+        pending_index_entry(false),
+        defer_blocks(false),
+        sampling(CompressionForLevel(opt, level) == kZstdCompression &&
+                 opt.zstd_dictionary_size > 0),
+        sampled_bytes(0),
+        zstd_compressor(nullptr),
+        incompressible_streak(0),
+        skip_interval(kMinSkippedBlocks),
+        blocks_to_skip(0),
+        work_cv(&mu),
+        done_cv(&mu),
+        stop_workers(false),
+        pending_raw_bytes(0),
+        written_raw_bytes(0),
+        written_stored_bytes(0) {
     index_block_options.block_restart_interval = 1;
+    if (opt.filter_policy != nullptr) {
+      if (opt.full_filter || opt.partition_index_and_filters) {
+        full_filter_block =
+            new FullFilterBlockBuilder(opt.filter_policy, level);
+      } else {
+        filter_block = new FilterBlockBuilder(opt.filter_policy, level);
+      }
+    }
   }
 
   Options options;
   Options index_block_options;
+  const int level;  // Level the table is written to, or -1
   WritableFile* file; // sstable 文件
   uint64_t offset;  // 下一个要写入的 DataBlock 在 sstable 文件中的 offset
   Status status;
@@ -46,6 +170,16 @@ struct TableBuilder::Rep {
   int64_t num_entries; // 当前 DataBlock 中键值对的个数
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  // Whole-table filter, or the filter partition being built.
+  // 整表过滤器，或者分区模式下正在构建的过滤器分区
+  FullFilterBlockBuilder* full_filter_block;
+
+  // When options.partition_index_and_filters is set, index_block holds the
+  // current index partition.  Finished partitions are kept here until
+  // Finish() writes them out, each paired with a separator key that is >=
+  // every key the partition covers.
+  std::vector<std::pair<std::string, std::string>> index_partitions;
+  std::vector<std::pair<std::string, std::string>> filter_partitions;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -66,18 +200,200 @@ struct TableBuilder::Rep {
   BlockHandle pending_handle;  // Handle to add to index block 
 
   std::string compressed_output; // 压缩时用的输出缓冲区
+
+  // Deferred data blocks.  With parallel compression, i.e. when
+  // options.compression_parallel_threads is more than 1, Flush() hands
+  // each full data block to the workers, and the thread building the
+  // table writes the compressed blocks in order as they become ready.
+  // With a zstd dictionary, the first data blocks are kept uncompressed
+  // until they are enough to train the dictionary on, and are compressed
+  // with it afterwards.  Because the index entry and the filter keys of a
+  // block depend on where it lands in the file, they are only added when
+  // it is written.
+  // 并行压缩：工作线程压缩 DataBlock，构建线程按顺序写入
+  // 字典压缩：先缓存 DataBlock 作为样本，训练出字典后再压缩
+  void StartCompression(PendingBlock* b);
+  void TrainDictionary();
+  void CompressWorker();
+  void StopWorkers();
+
+  bool defer_blocks;  // Whether data blocks go through "pending"
+  bool sampling;      // Whether the dictionary is still to be trained
+  size_t sampled_bytes;
+  std::string zstd_dictionary;  // Empty if none
+  port::ZstdCompressionDictionary* zstd_compressor;  // Null if none
+
+  // Adaptive compression of data blocks, see Options::adaptive_compression.
+  // Decisions only use the blocks written so far, so with workers they lag
+  // behind by the blocks still being compressed.
+  // 自适应压缩：连续多个 DataBlock 压缩失败后跳过压缩，之后定期重试
+  CompressionType NextDataBlockCompression();
+  void RecordDataBlock(CompressionType compression, CompressionType type);
+
+  int incompressible_streak;  // Failed tries in a row
+  int skip_interval;          // Blocks to skip after the next failed try
+  int blocks_to_skip;
+  TableBuilder::CompressionStats compression_stats;
+
+  std::vector<std::thread> workers;
+  port::Mutex mu;
+  port::CondVar work_cv;  // Signalled when a block is queued or on stop
+  port::CondVar done_cv;  // Signalled when a block has been compressed
+  std::deque<PendingBlock*> to_compress GUARDED_BY(mu);
+  bool stop_workers GUARDED_BY(mu);
+
+  // Blocks not yet written, in file order.  Only used by the thread
+  // building the table.
+  std::deque<PendingBlock*> pending;
+  // Filter keys of the data block being built.
+  std::string filter_keys;
+  std::vector<size_t> filter_key_sizes;
+  // Used by FileSize() to estimate the size of the pending blocks.
+  uint64_t pending_raw_bytes;
+  uint64_t written_raw_bytes;
+  uint64_t written_stored_bytes;
 };
 
-TableBuilder::TableBuilder(const Options& options, WritableFile* file)
-    : rep_(new Rep(options, file)) {
+// Compresses "b" on a worker, or right away if there are no workers.
+void TableBuilder::Rep::StartCompression(PendingBlock* b) {
+  if (b->compression == kZstdCompression) {
+    b->zstd_dictionary = zstd_compressor;
+  }
+  if (workers.empty()) {
+    b->contents = CompressBlock(b->raw, b->compression, b->zstd_level,
+                                b->zstd_dictionary, &b->compressed, &b->type);
+    b->compressed_done = true;
+    return;
+  }
+  MutexLock l(&mu);
+  to_compress.push_back(b);
+  work_cv.Signal();
+}
+
+// Trains the zstd dictionary on the data blocks sampled so far and starts
+// compressing them.  If training fails, for example because the table is
+// too small, blocks are compressed without a dictionary.
+void TableBuilder::Rep::TrainDictionary() {
+  assert(sampling);
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (const PendingBlock* b : pending) {
+    samples.append(b->raw);
+    sample_sizes.push_back(b->raw.size());
+  }
+  if (port::Zstd_TrainDictionary(samples.data(), sample_sizes.data(),
+                                 sample_sizes.size(),
+                                 options.zstd_dictionary_size,
+                                 &zstd_dictionary)) {
+    zstd_compressor = new port::ZstdCompressionDictionary(
+        options.zstd_compression_level, zstd_dictionary.data(),
+        zstd_dictionary.size());
+  } else {
+    zstd_dictionary.clear();
+  }
+  sampling = false;
+  for (PendingBlock* b : pending) {
+    StartCompression(b);
+  }
+}
+
+// Returns the compression to use for the next data block, which is none
+// while adaptive compression skips blocks.
+CompressionType TableBuilder::Rep::NextDataBlockCompression() {
+  const CompressionType compression = CompressionForLevel(options, level);
+  if (compression != kNoCompression && blocks_to_skip > 0) {
+    blocks_to_skip--;
+    compression_stats.skipped++;
+    return kNoCompression;
+  }
+  return compression;
+}
+
+// Records that a data block compressed with "compression" was stored as
+// "type".
+void TableBuilder::Rep::RecordDataBlock(CompressionType compression,
+                                        CompressionType type) {
+  if (compression == kNoCompression) {
+    return;
+  }
+  if (type != kNoCompression) {
+    compression_stats.compressed++;
+    incompressible_streak = 0;
+    skip_interval = kMinSkippedBlocks;
+    return;
+  }
+  compression_stats.rejected++;
+  incompressible_streak++;
+  // Once skipping has started, a single failed try skips blocks again.
+  // Failures of blocks queued before the skipping started are ignored.
+  if (options.adaptive_compression && blocks_to_skip == 0 &&
+      incompressible_streak >= kIncompressibleStreak) {
+    blocks_to_skip = skip_interval;
+    skip_interval = std::min(2 * skip_interval, kMaxSkippedBlocks);
+  }
+}
+
+void TableBuilder::Rep::CompressWorker() {
+  mu.Lock();
+  while (true) {
+    while (to_compress.empty() && !stop_workers) {
+      work_cv.Wait();
+    }
+    if (stop_workers) {
+      break;
+    }
+    PendingBlock* b = to_compress.front();
+    to_compress.pop_front();
+    mu.Unlock();
+
+    b->contents =
+        CompressBlock(b->raw, b->compression, b->zstd_level,
+                      b->zstd_dictionary, &b->compressed, &b->type);
+
+    mu.Lock();
+    b->compressed_done = true;
+    done_cv.SignalAll();
+  }
+  mu.Unlock();
+}
+
+// Stops the workers and drops the blocks that have not been written.
+void TableBuilder::Rep::StopWorkers() {
+  mu.Lock();
+  stop_workers = true;
+  work_cv.SignalAll();
+  mu.Unlock();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+  to_compress.clear();
+  for (PendingBlock* b : pending) {
+    delete b;
+  }
+  pending.clear();
+}
+
+TableBuilder::TableBuilder(const Options& options, WritableFile* file,
+                           int level)
+    : rep_(new Rep(options, file, level)) {
   if (rep_->filter_block != nullptr) {
     rep_->filter_block->StartBlock(0);
   }
+  if (options.compression_parallel_threads > 1) {
+    for (int i = 0; i < options.compression_parallel_threads; i++) {
+      rep_->workers.emplace_back(&Rep::CompressWorker, rep_);
+    }
+  }
+  rep_->defer_blocks = !rep_->workers.empty() || rep_->sampling;
 }
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
+  rep_->StopWorkers();
+  delete rep_->zstd_compressor;
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
   delete rep_;
 }
 
@@ -88,6 +404,20 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.full_filter != rep_->options.full_filter ||
+      options.partition_index_and_filters !=
+          rep_->options.partition_index_and_filters ||
+      options.data_block_hash_index != rep_->options.data_block_hash_index ||
+      options.block_format_version != rep_->options.block_format_version) {
+    return Status::InvalidArgument(
+        "changing index or filter layout while building table");
+  }
+  if (options.compression_parallel_threads !=
+          rep_->options.compression_parallel_threads ||
+      options.zstd_dictionary_size != rep_->options.zstd_dictionary_size) {
+    return Status::InvalidArgument(
+        "changing compression threads or dictionary while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -117,15 +447,19 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->data_block.empty());
     // FindShortestSeparator 负责找到介于两个 Block 中间的字符串作为索引值, 并将它写入r->last_key
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    AddPendingIndexEntry(r->last_key);
   }
 
-  if (r->filter_block != nullptr) {
+  if (r->defer_blocks &&
+      (r->filter_block != nullptr || r->full_filter_block != nullptr)) {
+    // Added to the filter when the block is written.
+    r->filter_keys.append(key.data(), key.size());
+    r->filter_key_sizes.push_back(key.size());
+  } else if (r->filter_block != nullptr) {
     // 将 key 加入到 filter block 中
     r->filter_block->AddKey(key);
+  } else if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -138,6 +472,53 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+// Adds the index entry of the last data block, or if data blocks are
+// deferred attaches "separator" to the block so that the entry is added
+// when the block is written.
+void TableBuilder::AddPendingIndexEntry(const std::string& separator) {
+  Rep* r = rep_;
+  assert(r->pending_index_entry);
+  if (!r->defer_blocks) {
+    AddIndexEntry(separator);
+  } else {
+    PendingBlock* b = r->pending.back();
+    b->separator = separator;
+    b->has_separator = true;
+    if (!r->sampling) {
+      WriteReadyBlocks(r->workers.size() * 2);
+    }
+  }
+  r->pending_index_entry = false;
+}
+
+// 为上一个 DataBlock 写入 index entry
+// 分区模式下，当前 index 分区足够大时结束当前的 index 分区和 filter 分区
+void TableBuilder::AddIndexEntry(const std::string& separator) {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  r->pending_handle.EncodeTo(&handle_encoding);
+  r->index_block.Add(separator, Slice(handle_encoding));
+  if (r->options.partition_index_and_filters &&
+      r->index_block.CurrentSizeEstimate() >= r->options.metadata_block_size) {
+    FinishPartition(separator);
+  }
+}
+
+// Closes the current index partition and, if filters are enabled, the
+// current filter partition.  Both cover exactly the data blocks whose index
+// entries have been added so far, so they share "separator" as their key in
+// the top-level indexes.
+void TableBuilder::FinishPartition(const std::string& separator) {
+  Rep* r = rep_;
+  r->index_partitions.emplace_back(separator,
+                                   r->index_block.Finish().ToString());
+  r->index_block.Reset();
+  if (r->full_filter_block != nullptr) {
+    r->filter_partitions.emplace_back(
+        separator, r->full_filter_block->Finish().ToString());
+  }
+}
+
 // 将缓存中的 DataBlock 刷新到磁盘, 此后的加入的键值对会存入新的 DataBlock 中
 void TableBuilder::Flush() {
   Rep* r = rep_;
@@ -145,8 +526,13 @@ void TableBuilder::Flush() {
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
+  if (r->defer_blocks) {
+    QueueBlock();
+    r->pending_index_entry = true;
+    return;
+  }
   // 将 data_block 写入文件，data_block 的指针会被存入 pending_handle 中
-  WriteBlock(&r->data_block, &r->pending_handle);
+  WriteBlock(&r->data_block, &r->pending_handle, true /* data_block */);
   if (ok()) {
     // pending_index_entry = true 说明 data_block 已经写入
     // 但是 index_entry 的 key 要在添加下个 key 的时候才能确定
@@ -162,7 +548,10 @@ void TableBuilder::Flush() {
 
 // 写入一个 Block, 并将它的指针存储在 *handle 中
 // 可能进行压缩，具体的写入过程在 WriteRawBlock 中
-void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+// Data blocks take part in adaptive compression, see
+// Rep::NextDataBlockCompression().
+void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle,
+                              bool data_block) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
@@ -171,46 +560,100 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   Rep* r = rep_;
   Slice raw = block->Finish();
 
-  Slice block_contents;
-  CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
+  const CompressionType compression =
+      data_block ? r->NextDataBlockCompression()
+                 : CompressionForLevel(r->options, r->level);
+  CompressionType type;
+  Slice block_contents =
+      CompressBlock(raw, compression, r->options.zstd_compression_level,
+                    nullptr, &r->compressed_output, &type);
+  WriteRawBlock(block_contents, type, handle);
+  if (data_block) {
+    r->RecordDataBlock(compression, type);
+  }
+  r->compressed_output.clear();
+  block->Reset();
+}
 
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
+// Moves the current data block to the pending blocks and starts its
+// compression, unless it is kept as a sample for the dictionary.
+void TableBuilder::QueueBlock() {
+  Rep* r = rep_;
+  PendingBlock* b = new PendingBlock;
+  Slice raw = r->data_block.Finish();
+  b->raw.assign(raw.data(), raw.size());
+  b->compression = r->NextDataBlockCompression();
+  b->zstd_level = r->options.zstd_compression_level;
+  b->zstd_dictionary = nullptr;
+  b->compressed_done = false;
+  b->type = kNoCompression;
+  b->filter_keys.swap(r->filter_keys);
+  b->filter_key_sizes.swap(r->filter_key_sizes);
+  b->has_separator = false;
+  r->data_block.Reset();
+
+  r->pending.push_back(b);
+  r->pending_raw_bytes += b->raw.size();
+  if (!r->sampling) {
+    r->StartCompression(b);
+    return;
+  }
+  r->sampled_bytes += b->raw.size();
+  if (r->sampled_bytes >= r->options.zstd_dictionary_size * 100) {
+    r->TrainDictionary();
+  }
+}
+
+// Writes the pending blocks at the front of the queue that are compressed
+// and have their index separator, waiting for the workers while more than
+// "max_pending" blocks are queued.
+void TableBuilder::WriteReadyBlocks(size_t max_pending) {
+  Rep* r = rep_;
+  while (!r->pending.empty() && ok()) {
+    PendingBlock* b = r->pending.front();
+    if (!b->has_separator) {
+      assert(max_pending > 0);
       break;
     }
-
-    case kZstdCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Zstd_Compress(r->options.zstd_compression_level, raw.data(),
-                              raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Zstd not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
+    {
+      MutexLock l(&r->mu);
+      while (!b->compressed_done && r->pending.size() > max_pending) {
+        r->done_cv.Wait();
       }
-      break;
+      if (!b->compressed_done) {
+        break;
+      }
+    }
+    r->pending.pop_front();
+    r->pending_raw_bytes -= b->raw.size();
+
+    if (r->filter_block != nullptr || r->full_filter_block != nullptr) {
+      size_t start = 0;
+      for (size_t size : b->filter_key_sizes) {
+        Slice key(b->filter_keys.data() + start, size);
+        if (r->filter_block != nullptr) {
+          r->filter_block->AddKey(key);
+        } else {
+          r->full_filter_block->AddKey(key);
+        }
+        start += size;
+      }
+    }
+    WriteRawBlock(b->contents, b->type, &r->pending_handle);
+    if (ok()) {
+      r->status = r->file->Flush();
     }
+    if (r->filter_block != nullptr) {
+      r->filter_block->StartBlock(r->offset);
+    }
+    if (ok()) {
+      AddIndexEntry(b->separator);
+    }
+    r->RecordDataBlock(b->compression, b->type);
+    r->written_raw_bytes += b->raw.size();
+    r->written_stored_bytes += b->contents.size();
+    delete b;
   }
-  WriteRawBlock(block_contents, type, handle);
-  r->compressed_output.clear();
-  block->Reset();
 }
 
 // 实际写入 Block 的代码
@@ -244,25 +687,85 @@ Status TableBuilder::Finish() {
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle dictionary_handle;
+  const bool partitioned = r->options.partition_index_and_filters;
+
+  // The last index entry is only known now, so the last partition is
+  // completed here as well.
+  if (ok() && r->pending_index_entry) {
+    if (r->sampling) {
+      r->TrainDictionary();
+    }
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddPendingIndexEntry(r->last_key);
+  }
+  if (r->defer_blocks) {
+    WriteReadyBlocks(0);
+    r->StopWorkers();
+  }
+  if (ok() && partitioned && !r->index_block.empty()) {
+    FinishPartition(r->last_key);
+  }
 
   // 构建 filter block
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+  } else if (ok() && r->full_filter_block != nullptr) {
+    if (partitioned) {
+      // 依次写入每个 filter 分区，再写入指向这些分区的顶层 filter 索引
+      BlockBuilder filter_index_block(&r->index_block_options);
+      for (size_t i = 0; i < r->filter_partitions.size() && ok(); i++) {
+        BlockHandle handle;
+        WriteRawBlock(r->filter_partitions[i].second, kNoCompression, &handle);
+        std::string handle_encoding;
+        handle.EncodeTo(&handle_encoding);
+        filter_index_block.Add(r->filter_partitions[i].first, handle_encoding);
+      }
+      if (ok()) {
+        WriteBlock(&filter_index_block, &filter_block_handle);
+      }
+    } else {
+      WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                    &filter_block_handle);
+    }
+  }
+
+  // Write zstd dictionary block
+  if (ok() && !r->zstd_dictionary.empty()) {
+    WriteRawBlock(r->zstd_dictionary, kNoCompression, &dictionary_handle);
   }
 
   // 构建 metaindex block，目前只有一条指向 FilterBlock 的记录
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    if (r->filter_block != nullptr || r->full_filter_block != nullptr) {
+      // Add mapping from "filter.Name" to location of filter data.  Full
+      // and partitioned filters use their own prefixes so that readers
+      // that do not understand them simply ignore them.
+      std::string key = r->filter_block != nullptr ? "filter."
+                        : partitioned              ? "partitionedfilter."
+                                                   : "fullfilter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
+
+      // Record that the filter also holds key prefixes, so that readers
+      // with the same prefix extractor may use it for prefix seeks.  The
+      // key sorts after every filter key above.
+      if (r->options.prefix_extractor != nullptr) {
+        key = "prefixextractor.";
+        key.append(r->options.prefix_extractor->Name());
+        meta_index_block.Add(key, Slice());
+      }
+    }
+    if (!r->zstd_dictionary.empty()) {
+      std::string handle_encoding;
+      dictionary_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kZstdDictionaryMetaKey, handle_encoding);
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -271,14 +774,20 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+    if (partitioned) {
+      // 写入所有 index 分区，index_block 改为存储指向这些分区的顶层索引
+      assert(r->index_block.empty());
+      for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+        BlockHandle handle;
+        WriteRawBlock(r->index_partitions[i].second, kNoCompression, &handle);
+        std::string handle_encoding;
+        handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(r->index_partitions[i].first, handle_encoding);
+      }
+    }
+    if (ok()) {
+      WriteBlock(&r->index_block, &index_block_handle);
     }
-    WriteBlock(&r->index_block, &index_block_handle);
   }
 
   // Write footer
@@ -286,6 +795,20 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    uint32_t features = 0;
+    if (partitioned) {
+      features |= kTableFeaturePartitionedIndex;
+    }
+    if (r->options.data_block_hash_index) {
+      features |= kTableFeatureDataBlockHashIndex;
+    }
+    if (r->options.block_format_version == 2) {
+      features |= kTableFeatureBlockFormatV2;
+    }
+    if (!r->zstd_dictionary.empty()) {
+      features |= kTableFeatureZstdDictionary;
+    }
+    footer.set_features(features);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -300,10 +823,27 @@ void TableBuilder::Abandon() {
   Rep* r = rep_;
   assert(!r->closed);
   r->closed = true;
+  r->StopWorkers();
 }
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::FileSize() const {
+  const Rep* r = rep_;
+  if (r->pending_raw_bytes == 0) {
+    return r->offset;
+  }
+  // Assume the blocks still being compressed compress like those written
+  // so far.
+  double ratio = 1.0;
+  if (r->written_raw_bytes > 0) {
+    ratio = static_cast<double>(r->written_stored_bytes) / r->written_raw_bytes;
+  }
+  return r->offset + static_cast<uint64_t>(r->pending_raw_bytes * ratio);
+}
+
+TableBuilder::CompressionStats TableBuilder::GetCompressionStats() const {
+  return rep_->compression_stats;
+}
 
 }  // namespace leveldb
@@ -4,6 +4,7 @@
 
 #include "leveldb/table.h"
 
+#include <cstdio>
 #include <map>
 #include <string>
 
@@ -11,14 +12,18 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -182,7 +187,8 @@ class BlockConstructor : public Constructor {
   Status FinishImpl(const Options& options, const KVMap& data) override {
     delete block_;
     block_ = nullptr;
-    BlockBuilder builder(&options);
+    BlockBuilder builder(&options, /*hash_index=*/false,
+                         options.block_format_version);
 
     for (const auto& kvp : data) {
       builder.Add(kvp.first, kvp.second);
@@ -371,12 +377,56 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+// Spreads the data over several blocks and merges them back together.
+class MergingConstructor : public Constructor {
+ public:
+  MergingConstructor(const Comparator* cmp, int fan_in)
+      : Constructor(cmp), comparator_(cmp) {
+    for (int i = 0; i < fan_in; i++) {
+      children_.push_back(new BlockConstructor(cmp));
+    }
+  }
+  ~MergingConstructor() override {
+    for (BlockConstructor* child : children_) {
+      delete child;
+    }
+  }
+  Status FinishImpl(const Options& options, const KVMap& data) override {
+    std::vector<KVMap> parts(children_.size(), KVMap(STLLessThan(comparator_)));
+    Random rnd(301);
+    for (const auto& kvp : data) {
+      parts[rnd.Uniform(parts.size())].insert(kvp);
+    }
+    for (size_t i = 0; i < children_.size(); i++) {
+      Status s = children_[i]->FinishImpl(options, parts[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  Iterator* NewIterator() const override {
+    std::vector<Iterator*> iters;
+    for (BlockConstructor* child : children_) {
+      iters.push_back(child->NewIterator());
+    }
+    return NewMergingIterator(comparator_, iters.data(), iters.size());
+  }
+
+ private:
+  const Comparator* const comparator_;
+  std::vector<BlockConstructor*> children_;
+};
+
+enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST, MERGE_TEST };
 
 struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partition_index_and_filters;
+  int merge_fan_in;  // Number of merged blocks for MERGE_TEST
+  int block_format_version;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -386,6 +436,10 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 16},
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 16, true},
+    {TABLE_TEST, false, 16, false, 0, 2},
+    {TABLE_TEST, true, 1, false, 0, 2},
 
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
@@ -393,6 +447,9 @@ static const TestArgs kTestArgList[] = {
     {BLOCK_TEST, true, 16},
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
+    {BLOCK_TEST, false, 16, false, 0, 2},
+    {BLOCK_TEST, false, 1, false, 0, 2},
+    {BLOCK_TEST, true, 1024, false, 0, 2},
 
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
@@ -401,6 +458,13 @@ static const TestArgs kTestArgList[] = {
     // Do not bother with restart interval variations for DB
     {DB_TEST, false, 16},
     {DB_TEST, true, 16},
+    {DB_TEST, false, 16, true},
+
+    // Few children are merged by a linear scan, many through a heap
+    {MERGE_TEST, false, 16, false, 3},
+    {MERGE_TEST, true, 16, false, 3},
+    {MERGE_TEST, false, 16, false, 20},
+    {MERGE_TEST, true, 16, false, 20},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -420,6 +484,14 @@ class Harness : public testing::Test {
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
+    if (args.partition_index_and_filters) {
+      // Tiny partitions so that most tables have several of them.
+      options_.partition_index_and_filters = true;
+      options_.metadata_block_size = 64;
+    }
+    if (args.block_format_version != 0) {
+      options_.block_format_version = args.block_format_version;
+    }
     switch (args.type) {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
@@ -433,6 +505,10 @@ class Harness : public testing::Test {
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
         break;
+      case MERGE_TEST:
+        constructor_ =
+            new MergingConstructor(options_.comparator, args.merge_fan_in);
+        break;
     }
   }
 
@@ -746,6 +822,31 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+TEST(MemTableTest, BloomFilter) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* memtable = new MemTable(cmp, 8 << 10);
+  memtable->Ref();
+  WriteBatch batch;
+  WriteBatchInternal::SetSequence(&batch, 100);
+  batch.Put(std::string("k1"), std::string("v1"));
+  batch.Put(std::string("k2"), std::string("v2"));
+  batch.Delete(std::string("k3"));
+  ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtable).ok());
+
+  std::string value;
+  Status s;
+  ASSERT_TRUE(memtable->Get(LookupKey("k1", 200), &value, &s));
+  ASSERT_EQ("v1", value);
+  ASSERT_TRUE(memtable->Get(LookupKey("k2", 200), &value, &s));
+  ASSERT_EQ("v2", value);
+  ASSERT_TRUE(memtable->Get(LookupKey("k3", 200), &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_FALSE(memtable->Get(LookupKey("k1", 99), &value, &s));
+  ASSERT_FALSE(memtable->Get(LookupKey("k4", 200), &value, &s));
+  ASSERT_FALSE(memtable->Get(LookupKey("", 200), &value, &s));
+  memtable->Unref();
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -785,6 +886,129 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+TEST(TableTest, ApproximateOffsetOfPartitionedIndex) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 1;  // One index entry per partition
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"), 10000, 11000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k05"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
+}
+
+static void TestHashIndexPointLookups(int block_format_version) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 2;  // Versions span restart points
+  BlockBuilder builder(&options, /*hash_index=*/true, block_format_version);
+  char buf[16];
+  for (int i = 0; i < 200; i += 2) {
+    std::snprintf(buf, sizeof(buf), "key%03d", i);
+    for (SequenceNumber seq = 3; seq >= 1; seq--) {
+      builder.Add(InternalKey(buf, seq, kTypeValue).Encode(),
+                  std::string(buf) + "@" + std::to_string(seq));
+    }
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* iter = block.NewIterator(&icmp);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(300, count);
+
+  for (int i = 0; i < 200; i++) {
+    std::snprintf(buf, sizeof(buf), "key%03d", i);
+    for (SequenceNumber snapshot = 0; snapshot <= 4; snapshot++) {
+      InternalKey target(buf, snapshot, kValueTypeForSeek);
+      iter->Seek(target.Encode());
+      Iterator* get_iter = block.NewIteratorForGet(&icmp, target.Encode());
+      if (iter->Valid() && ExtractUserKey(iter->key()) == Slice(buf)) {
+        ASSERT_TRUE(get_iter->Valid()) << buf << "@" << snapshot;
+        ASSERT_EQ(iter->key().ToString(), get_iter->key().ToString());
+        ASSERT_EQ(iter->value().ToString(), get_iter->value().ToString());
+      } else if (get_iter->Valid()) {
+        ASSERT_NE(Slice(buf), ExtractUserKey(get_iter->key()));
+      }
+      ASSERT_LEVELDB_OK(get_iter->status());
+      delete get_iter;
+    }
+  }
+  delete iter;
+}
+
+TEST(BlockTest, HashIndexPointLookups) {
+  TestHashIndexPointLookups(1);
+  TestHashIndexPointLookups(2);
+}
+
+TEST(BlockTest, FormatV2WideFields) {
+  // Values too large for the 16-bit fields of the second format
+  Options options;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options, /*hash_index=*/false, 2);
+  std::map<std::string, std::string> entries;
+  Random rnd(301);
+  for (int i = 0; i < 20; i++) {
+    char key[16];
+    std::snprintf(key, sizeof(key), "k%04d", i);
+    std::string value;
+    test::RandomString(&rnd, i % 3 == 0 ? 40000 : 10, &value);
+    entries[key] = value;
+    builder.Add(key, value);
+  }
+  ASSERT_GT(builder.CurrentSizeEstimate(), 65536);
+  std::string data = builder.Finish().ToString();
+  ASSERT_NE(0, DecodeFixed32(data.data() + data.size() - 4) &
+                   kBlockWideFieldsFlag);
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* iter = block.NewIterator(options.comparator);
+  auto it = entries.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+    ASSERT_TRUE(it != entries.end());
+    ASSERT_EQ(it->first, iter->key().ToString());
+    ASSERT_EQ(it->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(it == entries.end());
+  iter->Seek("k0013");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(entries["k0013"], iter->value().ToString());
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k0012", iter->key().ToString());
+  ASSERT_EQ(entries["k0012"], iter->value().ToString());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+}
+
 static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -792,16 +1016,30 @@ static bool CompressionSupported(CompressionType type) {
     return port::Snappy_Compress(in.data(), in.size(), &out);
   } else if (type == kZstdCompression) {
     return port::Zstd_Compress(/*level=*/1, in.data(), in.size(), &out);
+  } else if (type == kLZ4Compression) {
+    return port::Lz4_Compress(in.data(), in.size(), &out);
   }
   return false;
 }
 
+// Returns a compression supported by this build, or kNoCompression.
+static CompressionType AnySupportedCompression() {
+  for (CompressionType type :
+       {kLZ4Compression, kSnappyCompression, kZstdCompression}) {
+    if (CompressionSupported(type)) {
+      return type;
+    }
+  }
+  return kNoCompression;
+}
+
 class CompressionTableTest
     : public ::testing::TestWithParam<std::tuple<CompressionType>> {};
 
 INSTANTIATE_TEST_SUITE_P(CompressionTests, CompressionTableTest,
                          ::testing::Values(kSnappyCompression,
-                                           kZstdCompression));
+                                           kZstdCompression,
+                                           kLZ4Compression));
 
 TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   CompressionType type = ::testing::get<0>(GetParam());
@@ -839,4 +1077,328 @@ TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Counts the reads that reach the underlying file.
+class CountingStringSource : public StringSource {
+ public:
+  CountingStringSource(const Slice& contents)
+      : StringSource(contents), reads_(0) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    reads_++;
+    return StringSource::Read(offset, n, result, scratch);
+  }
+
+  int reads() const { return reads_; }
+
+ private:
+  mutable int reads_;
+};
+
+TEST_P(CompressionTableTest, CompressedBlockCache) {
+  CompressionType type = ::testing::get<0>(GetParam());
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
+  }
+
+  Random rnd(301);
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  KVMap kvmap((STLLessThan()));
+  std::string tmp;
+  for (int i = 0; i < 200; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%04d", i);
+    kvmap[key] = test::CompressibleString(&rnd, 0.25, 500, &tmp).ToString();
+  }
+  for (const auto& kvp : kvmap) {
+    builder.Add(kvp.first, kvp.second);
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  // An empty primary cache sends every block lookup to the compressed
+  // cache.
+  Cache* block_cache = NewLRUCache(0);
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  CountingStringSource source(sink.contents());
+  Options table_options;
+  table_options.block_cache = block_cache;
+  table_options.compressed_block_cache = compressed_cache;
+  Table* table;
+  ASSERT_LEVELDB_OK(Table::Open(table_options, &source, sink.contents().size(),
+                                &table));
+
+  int reads_after_first_scan = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    auto it = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+      ASSERT_TRUE(it != kvmap.end());
+      ASSERT_EQ(it->first, iter->key().ToString());
+      ASSERT_EQ(it->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(it == kvmap.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+    if (pass == 0) {
+      reads_after_first_scan = source.reads();
+    }
+  }
+
+  // The second scan was served from the compressed blocks.
+  ASSERT_EQ(reads_after_first_scan, source.reads());
+  ASSERT_GT(compressed_cache->TotalCharge(), 0);
+  ASSERT_LT(compressed_cache->TotalCharge(), 200 * 500 / 2);
+
+  delete table;
+  delete compressed_cache;
+  delete block_cache;
+}
+
+// Builds a table of "kvmap" and returns its contents.
+static std::string BuildTable(const Options& options, const KVMap& kvmap,
+                              int level = -1) {
+  StringSink sink;
+  TableBuilder builder(options, &sink, level);
+  for (const auto& kvp : kvmap) {
+    builder.Add(kvp.first, kvp.second);
+  }
+  EXPECT_LEVELDB_OK(builder.Finish());
+  EXPECT_EQ(sink.contents().size(), builder.FileSize());
+  return sink.contents();
+}
+
+TEST(TableTest, ParallelCompressionKeepsLayout) {
+  Random rnd(301);
+  KVMap kvmap((STLLessThan()));
+  std::string tmp;
+  for (int i = 0; i < 500; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%05d", i * 7);
+    kvmap[key] =
+        test::CompressibleString(&rnd, 0.5, rnd.Uniform(600), &tmp).ToString();
+  }
+
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  const CompressionType types[] = {kNoCompression, kSnappyCompression,
+                                   kZstdCompression, kLZ4Compression};
+  for (CompressionType type : types) {
+    if (type != kNoCompression && !CompressionSupported(type)) {
+      continue;
+    }
+    // No filter, per-2KB filters, a full filter and partitions.
+    for (int layout = 0; layout < 4; layout++) {
+      Options options;
+      options.block_size = 512;
+      options.compression = type;
+      options.filter_policy = layout > 0 ? policy : nullptr;
+      options.full_filter = layout == 2;
+      options.partition_index_and_filters = layout == 3;
+      options.metadata_block_size = 128;
+      const std::string expected = BuildTable(options, kvmap);
+
+      options.compression_parallel_threads = 3;
+      ASSERT_EQ(expected, BuildTable(options, kvmap))
+          << "type " << type << " layout " << layout;
+    }
+  }
+  delete policy;
+}
+
+TEST(TableTest, CompressionPerLevel) {
+  const CompressionType type = AnySupportedCompression();
+  if (type == kNoCompression) {
+    GTEST_SKIP() << "skipping compression test: no compressor";
+  }
+
+  Random rnd(301);
+  KVMap kvmap((STLLessThan()));
+  std::string tmp;
+  for (int i = 0; i < 200; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%04d", i);
+    kvmap[key] = test::CompressibleString(&rnd, 0.25, 300, &tmp).ToString();
+  }
+
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  const std::string uncompressed = BuildTable(options, kvmap);
+  options.compression = type;
+  const std::string compressed = BuildTable(options, kvmap);
+  ASSERT_LT(compressed.size(), uncompressed.size() / 2);
+
+  // Level 0 is not compressed, level 1 and every deeper level are.
+  options.compression = kNoCompression;
+  options.compression_per_level = {kNoCompression, type};
+  ASSERT_EQ(uncompressed, BuildTable(options, kvmap, 0));
+  ASSERT_EQ(compressed, BuildTable(options, kvmap, 1));
+  ASSERT_EQ(compressed, BuildTable(options, kvmap, 6));
+  // Tables of unknown level use options.compression.
+  ASSERT_EQ(uncompressed, BuildTable(options, kvmap));
+}
+
+// Bytes that no compressor can shrink, like already compressed data.
+static std::string IncompressibleString(Random* rnd, int len) {
+  std::string result(len, '\0');
+  for (int i = 0; i < len; i++) {
+    result[i] = static_cast<char>(rnd->Uniform(256));
+  }
+  return result;
+}
+
+TEST(TableTest, AdaptiveCompression) {
+  const CompressionType type = AnySupportedCompression();
+  if (type == kNoCompression) {
+    GTEST_SKIP() << "skipping compression test: no compressor";
+  }
+
+  // Two values per block: 200 blocks of incompressible values, then 400
+  // blocks of compressible ones.
+  Random rnd(301);
+  KVMap kvmap((STLLessThan()));
+  std::string tmp;
+  for (int i = 0; i < 1200; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%05d", i);
+    kvmap[key] = i < 400
+                     ? IncompressibleString(&rnd, 600)
+                     : test::CompressibleString(&rnd, 0.25, 600, &tmp)
+                           .ToString();
+  }
+
+  for (int threads = 1; threads <= 2; threads++) {
+    Options options;
+    options.block_size = 1024;
+    options.compression = type;
+    options.adaptive_compression = true;
+    options.compression_parallel_threads = threads;
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    for (const auto& kvp : kvmap) {
+      builder.Add(kvp.first, kvp.second);
+    }
+    ASSERT_LEVELDB_OK(builder.Finish());
+    const TableBuilder::CompressionStats stats =
+        builder.GetCompressionStats();
+    ASSERT_EQ(600, stats.compressed + stats.rejected + stats.skipped);
+    if (threads == 1) {
+      // Four failures, then a failed try after 16, 32 and 64 skipped
+      // blocks.  The try after 128 more finds the compressible values.
+      ASSERT_EQ(7, stats.rejected);
+      ASSERT_EQ(16 + 32 + 64 + 128, stats.skipped);
+      ASSERT_EQ(600 - 7 - 240, stats.compressed);
+    } else {
+      // Decisions lag behind the blocks being compressed.
+      ASSERT_GT(stats.skipped, 100);
+      ASSERT_GT(stats.compressed, 200);
+    }
+
+    // Skipped blocks are stored uncompressed and read back as usual.
+    StringSource* source = new StringSource(sink.contents());
+    Table* table;
+    ASSERT_LEVELDB_OK(Table::Open(options, source, sink.contents().size(),
+                                  &table));
+    Iterator* iter = table->NewIterator(ReadOptions());
+    KVMap::const_iterator expected = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+      ASSERT_EQ(expected->first, iter->key().ToString());
+      ASSERT_EQ(expected->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(expected == kvmap.end());
+    delete iter;
+    delete table;
+    delete source;
+  }
+}
+
+// A small JSON document, similar to its neighbours but not the same.
+static std::string JsonValue(Random* rnd, int i) {
+  static const char* const kCities[] = {"Berlin", "Lisbon", "Osaka",
+                                        "Toronto", "Nairobi"};
+  char buf[400];
+  std::snprintf(
+      buf, sizeof(buf),
+      "{\"id\":%d,\"type\":\"customer\",\"name\":\"user%04u\","
+      "\"address\":{\"city\":\"%s\",\"country\":\"%s\"},\"active\":%s,"
+      "\"preferences\":{\"newsletter\":%s,\"theme\":\"%s\","
+      "\"language\":\"en-US\"},\"score\":%u,"
+      "\"created_at\":\"2024-%02u-%02uT00:00:00Z\"}",
+      i, rnd->Uniform(10000), kCities[rnd->Uniform(5)],
+      rnd->OneIn(2) ? "DE" : "JP", rnd->OneIn(2) ? "true" : "false",
+      rnd->OneIn(2) ? "true" : "false", rnd->OneIn(2) ? "dark" : "light",
+      rnd->Uniform(100), 1 + rnd->Uniform(12), 1 + rnd->Uniform(28));
+  return buf;
+}
+
+TEST(TableTest, ZstdDictionary) {
+  if (!CompressionSupported(kZstdCompression)) {
+    GTEST_SKIP() << "skipping zstd dictionary test";
+  }
+  Random rnd(301);
+  KVMap kvmap((STLLessThan()));
+  for (int i = 0; i < 5000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    kvmap[key] = JsonValue(&rnd, i);
+  }
+
+  Options options;
+  options.compression = kZstdCompression;
+  const std::string plain = BuildTable(options, kvmap);
+  options.zstd_dictionary_size = 4096;
+  const std::string with_dictionary = BuildTable(options, kvmap);
+  ASSERT_LT(with_dictionary.size(), plain.size() * 3 / 4);
+
+  // Blocks are compressed with the same dictionary on worker threads.
+  options.compression_parallel_threads = 2;
+  ASSERT_EQ(with_dictionary, BuildTable(options, kvmap));
+
+  // Read the table back, also through the cache of compressed blocks.
+  Cache* block_cache = NewLRUCache(0);
+  Cache* compressed_cache = NewLRUCache(1 << 20);
+  StringSource source(with_dictionary);
+  Options table_options;
+  table_options.block_cache = block_cache;
+  table_options.compressed_block_cache = compressed_cache;
+  Table* table;
+  ASSERT_LEVELDB_OK(
+      Table::Open(table_options, &source, with_dictionary.size(), &table));
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    auto it = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+      ASSERT_TRUE(it != kvmap.end());
+      ASSERT_EQ(it->first, iter->key().ToString());
+      ASSERT_EQ(it->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(it == kvmap.end());
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  }
+  ASSERT_GT(compressed_cache->TotalCharge(), 0);
+  delete table;
+  delete compressed_cache;
+  delete block_cache;
+
+  // A table too small to train a dictionary on is compressed without one.
+  KVMap small((STLLessThan()));
+  small["a"] = JsonValue(&rnd, 0);
+  Options small_options = options;
+  small_options.compression_parallel_threads = 1;
+  const std::string small_table = BuildTable(small_options, small);
+  StringSource small_source(small_table);
+  ASSERT_LEVELDB_OK(
+      Table::Open(Options(), &small_source, small_table.size(), &table));
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(small["a"], iter->value().ToString());
+  delete iter;
+  delete table;
+}
+
 }  // namespace leveldb
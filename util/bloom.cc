@@ -4,7 +4,17 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "leveldb/slice.h"
+#include "util/coding.h"
 #include "util/hash.h"
 
 namespace leveldb {
@@ -14,6 +24,33 @@ static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
+// Probes a filter built by BloomFilterPolicy::CreateFilter().
+static bool LegacyBloomMayMatch(const Slice& key, const Slice& bloom_filter) {
+  const size_t len = bloom_filter.size();
+  if (len < 2) return false;
+
+  const char* array = bloom_filter.data();
+  const size_t bits = (len - 1) * 8;
+
+  // Use the encoded k so that we can read filters generated by
+  // bloom filters created using different parameters.
+  const size_t k = array[len - 1];
+  if (k > 30) {
+    // Reserved for potentially new encodings for short bloom filters.
+    // Consider it a match.
+    return true;
+  }
+
+  uint32_t h = BloomHash(key);
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (size_t j = 0; j < k; j++) {
+    const uint32_t bitpos = h % bits;
+    if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    h += delta;
+  }
+  return true;
+}
+
 class BloomFilterPolicy : public FilterPolicy {
  public:
   explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
@@ -54,34 +91,450 @@ class BloomFilterPolicy : public FilterPolicy {
   }
 
   bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
-    const size_t len = bloom_filter.size();
-    if (len < 2) return false;
-
-    const char* array = bloom_filter.data();
-    const size_t bits = (len - 1) * 8;
-
-    // Use the encoded k so that we can read filters generated by
-    // bloom filters created using different parameters.
-    const size_t k = array[len - 1];
-    if (k > 30) {
-      // Reserved for potentially new encodings for short bloom filters.
-      // Consider it a match.
-      return true;
+    return LegacyBloomMayMatch(key, bloom_filter);
+  }
+
+ private:
+  size_t bits_per_key_;
+  size_t k_;
+};
+
+// A blocked bloom filter confines all the probes for a key to one 64-byte
+// line of the filter, so a lookup touches a single cache line.  Filter
+// layout:
+//    line[0..num_lines-1]        64 bytes each
+//    reserved                    2 bytes, zero
+//    num_probes                  1 byte
+//    format version              1 byte, kBlockedBloomVersion
+//    kFilterFormatMarker         1 byte
+// The marker takes the place of the probe count of the legacy format.  It
+// is above 30, so readers that only know the legacy format treat these
+// filters as matching every key.  Other formats that end with a version
+// byte and the marker are told apart by the version.
+static const size_t kCacheLineSize = 64;
+static const size_t kBlockedBloomTrailerSize = 5;
+static const char kBlockedBloomVersion = 1;
+static const char kFilterFormatMarker = static_cast<char>(0xff);
+
+// Multiplier used to derive successive probes within a line.
+static const uint32_t kProbeMultiplier = 0x9e3779b9;
+
+static uint32_t BlockedBloomProbeHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0x5bd1e995);
+}
+
+// Returns the line of a filter with "num_lines" lines that "h" maps to.
+static uint32_t LineIndex(uint32_t h, uint32_t num_lines) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+}
+
+// Returns true if all the "num_probes" bits derived from "h" are set in
+// the 64-byte "line".  Probe i tests bit (h * kProbeMultiplier^i) >> 23.
+static bool LineMayMatch(const char* line, uint32_t h, int num_probes) {
+#if defined(__AVX2__)
+  // Eight probes per round: gather the 32-bit word holding each probed bit
+  // and check them all at once.
+  const __m256i multipliers = _mm256_setr_epi32(
+      0x00000001, static_cast<int>(0x9e3779b9), static_cast<int>(0xe35e67b1),
+      0x734297e9, 0x35fbe861, static_cast<int>(0xdeb7c719), 0x0448b211,
+      0x3459b749);
+  const uint32_t round_multiplier = 0xab25f4c1;  // kProbeMultiplier^8
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i ones = _mm256_set1_epi32(1);
+  const __m256i bit_mask = _mm256_set1_epi32(31);
+  for (int remaining = num_probes; remaining > 0; remaining -= 8) {
+    const __m256i hashes =
+        _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(h)), multipliers);
+    const __m256i bitpos = _mm256_srli_epi32(hashes, 23);
+    const __m256i words = _mm256_i32gather_epi32(
+        reinterpret_cast<const int*>(line), _mm256_srli_epi32(bitpos, 5), 4);
+    const __m256i bits =
+        _mm256_sllv_epi32(ones, _mm256_and_si256(bitpos, bit_mask));
+    const __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining),
+                                              lanes);
+    const __m256i missing =
+        _mm256_and_si256(_mm256_andnot_si256(words, bits), active);
+    if (!_mm256_testz_si256(missing, missing)) {
+      return false;
     }
+    h *= round_multiplier;
+  }
+  return true;
+#else
+  for (int i = 0; i < num_probes; i++) {
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos >> 3] & (1 << (bitpos & 7))) == 0) return false;
+    h *= kProbeMultiplier;
+  }
+  return true;
+#endif
+}
+
+static bool BlockedBloomMayMatch(const Slice& key, const Slice& filter) {
+  const size_t len = filter.size();
+  if (len < kCacheLineSize + kBlockedBloomTrailerSize) {
+    return true;  // Corrupt: consider it a match
+  }
+  const char* array = filter.data();
+  const int k = static_cast<unsigned char>(array[len - 3]);
+  const uint32_t num_lines = static_cast<uint32_t>(
+      (len - kBlockedBloomTrailerSize) / kCacheLineSize);
+  const char* line =
+      array + LineIndex(BloomHash(key), num_lines) * kCacheLineSize;
+  return LineMayMatch(line, BlockedBloomProbeHash(key), k);
+}
 
-    uint32_t h = BloomHash(key);
-    const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
-    for (size_t j = 0; j < k; j++) {
-      const uint32_t bitpos = h % bits;
-      if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
-      h += delta;
+// A binary fuse filter [Graf,Lemire 2022] maps each key to three slots in
+// three consecutive segments of the slot array, and stores fingerprints
+// such that the XOR of the three slots of every key is its fingerprint.
+// Filter layout:
+//    slots                       fingerprint_bits each, packed
+//    seed                        fixed32
+//    segment_count               fixed32
+//    segment_length_bits         1 byte
+//    fingerprint_bits            1 byte
+//    format version              1 byte, kFuseFilterVersion
+//    kFilterFormatMarker         1 byte
+// The slot array holds segment_count + 2 segments of 2^segment_length_bits
+// slots.  A filter without keys has segment_count == 0.
+static const size_t kFuseFilterTrailerSize = 12;
+static const char kFuseFilterVersion = 2;
+static const int kMaxFingerprintBits = 16;
+static const int kMaxSegmentLengthBits = 18;
+
+// Number of seeds tried before giving up on building a fuse filter.
+static const int kFuseFilterMaxAttempts = 64;
+
+static uint64_t FuseKeyHash(const Slice& key) {
+  return (static_cast<uint64_t>(BloomHash(key)) << 32) |
+         BlockedBloomProbeHash(key);
+}
+
+// Remixes a key hash for "seed".  Distinct key hashes stay distinct.
+static uint64_t FuseSlotHash(uint64_t key_hash, uint32_t seed) {
+  uint64_t h = key_hash ^ (seed * 0x9e3779b97f4a7c15ull);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+struct FuseLayout {
+  uint32_t segment_length_bits;
+  uint32_t segment_count;
+
+  uint32_t segment_length() const { return 1u << segment_length_bits; }
+  size_t num_slots() const {
+    return static_cast<size_t>(segment_count + 2) << segment_length_bits;
+  }
+
+  void Slots(uint64_t h, uint32_t slots[3]) const {
+    const uint32_t mask = segment_length() - 1;
+    const uint64_t range =
+        static_cast<uint64_t>(segment_count) << segment_length_bits;
+    slots[0] = static_cast<uint32_t>(((h >> 32) * range) >> 32);
+    slots[1] = slots[0] + segment_length();
+    slots[2] = slots[1] + segment_length();
+    slots[1] ^= static_cast<uint32_t>(h >> 18) & mask;
+    slots[2] ^= static_cast<uint32_t>(h) & mask;
+  }
+};
+
+static uint32_t Fingerprint(uint64_t h, int bits) {
+  return static_cast<uint32_t>(h ^ (h >> 32)) & ((1u << bits) - 1);
+}
+
+// Returns the "bits" wide slot "index" of a packed slot array.
+static uint32_t GetSlot(const char* data, size_t index, int bits) {
+  const size_t bitpos = index * bits;
+  const char* p = data + (bitpos >> 3);
+  const int shift = bitpos & 7;
+  const int nbytes = (shift + bits + 7) >> 3;
+  uint32_t v = 0;
+  for (int i = 0; i < nbytes; i++) {
+    v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+  }
+  return (v >> shift) & ((1u << bits) - 1);
+}
+
+// REQUIRES: slot "index" is zero.
+static void SetSlot(char* data, size_t index, int bits, uint32_t value) {
+  const size_t bitpos = index * bits;
+  char* p = data + (bitpos >> 3);
+  const uint32_t v = value << (bitpos & 7);
+  const int nbytes = ((bitpos & 7) + bits + 7) >> 3;
+  for (int i = 0; i < nbytes; i++) {
+    p[i] |= static_cast<char>(v >> (8 * i));
+  }
+}
+
+static FuseLayout ChooseFuseLayout(size_t n) {
+  // Parameters from the reference implementation.  Small sets need
+  // relatively more slots for construction to succeed.
+  FuseLayout layout;
+  int bits = 2;
+  if (n > 1) {
+    bits = static_cast<int>(std::floor(std::log(static_cast<double>(n)) /
+                                       std::log(3.33) +
+                                   2.25));
+  }
+  layout.segment_length_bits = std::min(bits, kMaxSegmentLengthBits);
+  double size_factor = 0;
+  if (n > 1) {
+    size_factor = std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) /
+                                              std::log(static_cast<double>(n)));
+  }
+  const size_t capacity = static_cast<size_t>(std::round(n * size_factor));
+  const size_t segments =
+      (capacity + layout.segment_length() - 1) / layout.segment_length();
+  layout.segment_count =
+      static_cast<uint32_t>(segments > 3 ? segments - 2 : 1);
+  return layout;
+}
+
+// Appends a fuse filter over keys[0,n-1] to *dst.  Returns false and
+// leaves *dst unchanged if no seed gave a filter.
+static bool BuildFuseFilter(const Slice* keys, int n, int fingerprint_bits,
+                            std::string* dst) {
+  // Duplicate keys would never peel, so build over distinct key hashes.
+  std::vector<uint64_t> key_hashes(n);
+  for (int i = 0; i < n; i++) {
+    key_hashes[i] = FuseKeyHash(keys[i]);
+  }
+  std::sort(key_hashes.begin(), key_hashes.end());
+  key_hashes.erase(std::unique(key_hashes.begin(), key_hashes.end()),
+                   key_hashes.end());
+
+  FuseLayout layout;
+  layout.segment_length_bits = 0;
+  layout.segment_count = 0;
+  if (!key_hashes.empty()) {
+    layout = ChooseFuseLayout(key_hashes.size());
+  }
+  const size_t num_slots = key_hashes.empty() ? 0 : layout.num_slots();
+  std::vector<uint32_t> counts;
+  std::vector<uint64_t> xors;
+  std::vector<uint32_t> queue;
+  // Keys in peeling order, each with the slot it owns.
+  std::vector<std::pair<uint64_t, uint32_t>> order;
+  uint32_t seed = 0;
+  for (int attempt = 0; !key_hashes.empty(); attempt++) {
+    if (attempt == kFuseFilterMaxAttempts) {
+      return false;
     }
-    return true;
+    seed = static_cast<uint32_t>(attempt);
+    counts.assign(num_slots, 0);
+    xors.assign(num_slots, 0);
+    queue.clear();
+    order.clear();
+    uint32_t slots[3];
+    for (uint64_t key_hash : key_hashes) {
+      const uint64_t h = FuseSlotHash(key_hash, seed);
+      layout.Slots(h, slots);
+      for (uint32_t slot : slots) {
+        counts[slot]++;
+        xors[slot] ^= h;
+      }
+    }
+    for (size_t i = 0; i < num_slots; i++) {
+      if (counts[i] == 1) queue.push_back(static_cast<uint32_t>(i));
+    }
+    // Repeatedly remove a key that is alone in one of its slots.  That slot
+    // can then be set last to fix up the key's fingerprint.
+    while (!queue.empty()) {
+      const uint32_t slot = queue.back();
+      queue.pop_back();
+      if (counts[slot] != 1) continue;
+      const uint64_t h = xors[slot];
+      order.emplace_back(h, slot);
+      layout.Slots(h, slots);
+      for (uint32_t other : slots) {
+        counts[other]--;
+        xors[other] ^= h;
+        if (counts[other] == 1) queue.push_back(other);
+      }
+    }
+    if (order.size() == key_hashes.size()) {
+      break;
+    }
+  }
+
+  const size_t init_size = dst->size();
+  dst->resize(init_size + (num_slots * fingerprint_bits + 7) / 8, 0);
+  char* array = &(*dst)[init_size];
+  for (size_t i = order.size(); i > 0; i--) {
+    const uint64_t h = order[i - 1].first;
+    uint32_t slots[3];
+    layout.Slots(h, slots);
+    uint32_t value = Fingerprint(h, fingerprint_bits);
+    for (uint32_t slot : slots) {
+      value ^= GetSlot(array, slot, fingerprint_bits);
+    }
+    SetSlot(array, order[i - 1].second, fingerprint_bits, value);
+  }
+  PutFixed32(dst, seed);
+  PutFixed32(dst, layout.segment_count);
+  dst->push_back(static_cast<char>(layout.segment_length_bits));
+  dst->push_back(static_cast<char>(fingerprint_bits));
+  dst->push_back(kFuseFilterVersion);
+  dst->push_back(kFilterFormatMarker);
+  return true;
+}
+
+static bool FuseFilterMayMatch(const Slice& key, const Slice& filter) {
+  const size_t len = filter.size();
+  if (len < kFuseFilterTrailerSize) {
+    return true;  // Corrupt: consider it a match
+  }
+  const char* trailer = filter.data() + len - kFuseFilterTrailerSize;
+  const uint32_t seed = DecodeFixed32(trailer);
+  FuseLayout layout;
+  layout.segment_count = DecodeFixed32(trailer + 4);
+  layout.segment_length_bits = static_cast<unsigned char>(trailer[8]);
+  const int fingerprint_bits = static_cast<unsigned char>(trailer[9]);
+  if (layout.segment_count == 0) {
+    return false;  // No keys
+  }
+  if (layout.segment_length_bits > kMaxSegmentLengthBits ||
+      fingerprint_bits < 1 || fingerprint_bits > kMaxFingerprintBits ||
+      (layout.num_slots() * fingerprint_bits + 7) / 8 !=
+          len - kFuseFilterTrailerSize) {
+    return true;  // Corrupt: consider it a match
+  }
+
+  const uint64_t h = FuseSlotHash(FuseKeyHash(key), seed);
+  uint32_t slots[3];
+  layout.Slots(h, slots);
+  const char* array = filter.data();
+  return (Fingerprint(h, fingerprint_bits) ^
+          GetSlot(array, slots[0], fingerprint_bits) ^
+          GetSlot(array, slots[1], fingerprint_bits) ^
+          GetSlot(array, slots[2], fingerprint_bits)) == 0;
+}
+
+// Probes a filter written by any of the builtin policies.
+static bool BuiltinFilterMayMatch(const Slice& key, const Slice& filter) {
+  const size_t len = filter.size();
+  if (len < 2) return false;
+  const char* array = filter.data();
+  if (array[len - 1] != kFilterFormatMarker) {
+    return LegacyBloomMayMatch(key, filter);
+  }
+  switch (array[len - 2]) {
+    case kBlockedBloomVersion:
+      return BlockedBloomMayMatch(key, filter);
+    case kFuseFilterVersion:
+      return FuseFilterMayMatch(key, filter);
+    default:
+      // Unknown encoding.  Consider it a match.
+      return true;
+  }
+}
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key), k_(ChooseNumProbes(bits_per_key)) {}
+
+  // Shares the name of BloomFilterPolicy: KeyMayMatch() tells the two
+  // formats apart, so tables written with either one stay readable.
+  const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    size_t bits = n * bits_per_key_;
+    const size_t num_lines =
+        std::max<size_t>(1, (bits + kCacheLineSize * 8 - 1) /
+                                (kCacheLineSize * 8));
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kCacheLineSize, 0);
+    dst->append(2, '\0');
+    dst->push_back(static_cast<char>(k_));
+    dst->push_back(kBlockedBloomVersion);
+    dst->push_back(kFilterFormatMarker);
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t line_index =
+          LineIndex(BloomHash(keys[i]), static_cast<uint32_t>(num_lines));
+      char* line = array + line_index * kCacheLineSize;
+      uint32_t h = BlockedBloomProbeHash(keys[i]);
+      for (int j = 0; j < k_; j++) {
+        const uint32_t bitpos = h >> 23;
+        line[bitpos >> 3] |= (1 << (bitpos & 7));
+        h *= kProbeMultiplier;
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    return BuiltinFilterMayMatch(key, bloom_filter);
   }
 
  private:
+  // Blocked filters pay for their locality with a slightly higher false
+  // positive rate, so they do best with fewer probes than a standard bloom
+  // filter of the same size.
+  static int ChooseNumProbes(int bits_per_key) {
+    if (bits_per_key <= 2) return 1;
+    if (bits_per_key <= 3) return 2;
+    if (bits_per_key <= 5) return 3;
+    if (bits_per_key <= 6) return 4;
+    if (bits_per_key <= 8) return 5;
+    if (bits_per_key <= 10) return 6;
+    if (bits_per_key <= 11) return 7;
+    if (bits_per_key <= 14) return 8;
+    if (bits_per_key <= 16) return 9;
+    if (bits_per_key <= 18) return 10;
+    if (bits_per_key <= 22) return 11;
+    if (bits_per_key <= 25) return 12;
+    return std::min(24, bits_per_key / 2 - 1);
+  }
+
   size_t bits_per_key_;
-  size_t k_;
+  int k_;
+};
+
+class BinaryFuseFilterPolicy : public FilterPolicy {
+ public:
+  BinaryFuseFilterPolicy(int bloom_equivalent_bits_per_key,
+                         int bloom_before_level)
+      : bloom_(bloom_equivalent_bits_per_key),
+        bloom_before_level_(bloom_before_level) {
+    // A bloom filter with b bits per key has a false positive rate of
+    // about 0.6185^b = 2^(-0.69 b), and a fuse filter one of 2^-f.
+    fingerprint_bits_ =
+        static_cast<int>(bloom_equivalent_bits_per_key * 0.69 + 0.5);
+    if (fingerprint_bits_ < 1) fingerprint_bits_ = 1;
+    if (fingerprint_bits_ > kMaxFingerprintBits) {
+      fingerprint_bits_ = kMaxFingerprintBits;
+    }
+  }
+
+  // Shares the name of BloomFilterPolicy, see BlockedBloomFilterPolicy.
+  const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    CreateFilterForLevel(-1, keys, n, dst);
+  }
+
+  void CreateFilterForLevel(int level, const Slice* keys, int n,
+                            std::string* dst) const override {
+    if ((level >= 0 && level < bloom_before_level_) ||
+        !BuildFuseFilter(keys, n, fingerprint_bits_, dst)) {
+      bloom_.CreateFilter(keys, n, dst);
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return BuiltinFilterMayMatch(key, filter);
+  }
+
+ private:
+  const BlockedBloomFilterPolicy bloom_;
+  const int bloom_before_level_;
+  int fingerprint_bits_;
 };
 }  // namespace
 
@@ -89,4 +542,14 @@ const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
+const FilterPolicy* NewBinaryFuseFilterPolicy(int bloom_equivalent_bits_per_key,
+                                              int bloom_before_level) {
+  return new BinaryFuseFilterPolicy(bloom_equivalent_bits_per_key,
+                                    bloom_before_level);
+}
+
 }  // namespace leveldb
@@ -19,7 +19,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest() : BloomTest(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -62,6 +63,14 @@ class BloomTest : public testing::Test {
     return policy_->KeyMayMatch(s, filter_);
   }
 
+  // Probes the current filter with a different policy.
+  bool MatchesWith(const FilterPolicy* policy, const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy->KeyMayMatch(s, filter_);
+  }
+
   double FalsePositiveRate() {
     char buffer[sizeof(int)];
     int result = 0;
@@ -151,4 +160,212 @@ TEST_F(BloomTest, VaryingLengths) {
 
 // Different bits-per-byte
 
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST_F(BlockedBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BlockedBloomTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Rounded up to whole cache lines, plus the trailer.
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 64 + 5))
+        << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.02);  // Must not be over 2%
+    if (rate > 0.0125)
+      mediocre_filters++;  // Allowed, but not too often
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+                 mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
+TEST_F(BlockedBloomTest, ReadsLegacyFilters) {
+  char buffer[sizeof(int)];
+  const FilterPolicy* legacy = NewBloomFilterPolicy(10);
+  const FilterPolicy* blocked = NewBlockedBloomFilterPolicy(10);
+  ASSERT_STREQ(legacy->Name(), blocked->Name());
+
+  // A legacy filter is probed as a legacy filter by the blocked policy.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::string filter;
+  legacy->CreateFilter(key_slices.data(), static_cast<int>(key_slices.size()),
+                       &filter);
+  int false_positives = 0;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(blocked->KeyMayMatch(Key(i, buffer), filter));
+    if (blocked->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 20);
+
+  // Legacy readers must not reject keys of a blocked filter.
+  Add("hello");
+  ASSERT_TRUE(MatchesWith(legacy, "hello"));
+  ASSERT_TRUE(MatchesWith(legacy, "x"));
+
+  delete legacy;
+  delete blocked;
+}
+
+class FuseFilterTest : public BloomTest {
+ public:
+  FuseFilterTest() : BloomTest(NewBinaryFuseFilterPolicy(10)) {}
+};
+
+TEST_F(FuseFilterTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(FuseFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(FuseFilterTest, DuplicateKeys) {
+  for (int i = 0; i < 3; i++) {
+    Add("hello");
+    Add("world");
+  }
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+}
+
+TEST_F(FuseFilterTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Small sets need relatively more slots, rounded up to whole segments.
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 128))
+        << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.0125);
+  }
+}
+
+TEST_F(FuseFilterTest, SmallerThanBloom) {
+  const int kNumKeys = 100000;
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < kNumKeys; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  const FilterPolicy* fuse = NewBinaryFuseFilterPolicy(10);
+  std::string bloom_filter, fuse_filter;
+  bloom->CreateFilter(key_slices.data(), kNumKeys, &bloom_filter);
+  fuse->CreateFilter(key_slices.data(), kNumKeys, &fuse_filter);
+
+  int bloom_fp = 0, fuse_fp = 0;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_TRUE(fuse->KeyMayMatch(key_slices[i], fuse_filter));
+    Slice missing = Key(i + 1000000000, buffer);
+    if (bloom->KeyMayMatch(missing, bloom_filter)) bloom_fp++;
+    if (fuse->KeyMayMatch(missing, fuse_filter)) fuse_fp++;
+  }
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "bloom: %d bytes, %d fp; fuse: %d bytes, %d fp\n",
+                 static_cast<int>(bloom_filter.size()), bloom_fp,
+                 static_cast<int>(fuse_filter.size()), fuse_fp);
+  }
+  ASSERT_LE(fuse_filter.size(), bloom_filter.size() * 85 / 100);
+  ASSERT_LE(fuse_fp, bloom_fp * 3 / 2);
+
+  // The bloom policy can read fuse filters, even though it cannot build
+  // them.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(bloom->KeyMayMatch(key_slices[i], fuse_filter));
+  }
+  delete bloom;
+  delete fuse;
+}
+
+TEST_F(FuseFilterTest, BloomBeforeLevel) {
+  const FilterPolicy* policy = NewBinaryFuseFilterPolicy(10, 2);
+  std::vector<Slice> keys = {"hello", "world"};
+  for (int level = -1; level < 4; level++) {
+    std::string filter;
+    policy->CreateFilterForLevel(level, keys.data(), 2, &filter);
+    // The next to last byte is the format version: 1 for blocked bloom
+    // filters, 2 for fuse filters.
+    ASSERT_EQ((level == 0 || level == 1) ? 1 : 2, filter[filter.size() - 2])
+        << level;
+    ASSERT_TRUE(policy->KeyMayMatch("hello", filter));
+    ASSERT_TRUE(policy->KeyMayMatch("world", filter));
+  }
+  delete policy;
+}
+
 }  // namespace leveldb
@@ -5,8 +5,10 @@
 #include "leveldb/cache.h"
 
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <thread>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -33,10 +35,27 @@ namespace {
 //   particular order.  (This list is used for invariant checking.  If we
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
-// - LRU:  contains the items not currently referenced by clients, in LRU order
+// - LRU:  contains the items not currently referenced by clients, in LRU order,
+//   that have not been looked up since they were inserted (probation).
+// - hot LRU:  like LRU, but for items that were looked up at least once
+//   after insertion.  Items are only evicted from this list once the LRU list
+//   is empty.
+// - high-priority LRU:  like LRU, but for items in the high-priority pool.
+//   Items are only evicted from this list once the other two are empty.
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// Items inserted with Cache::kHighPriority join the high-priority pool.  When
+// the charge of the pool exceeds its capacity, its least recently used items
+// that are not in use are moved to the LRU list and leave the pool.
+//
+// Other items are inserted at the midpoint of the eviction order, i.e. at the
+// newest end of the probation list, and only join the hot segment on their
+// second access.  A scan that inserts many blocks once therefore only evicts
+// other items on probation, not the hot ones.  The hot segment is limited to
+// kHotRatio of the capacity outside the high-priority pool; its least
+// recently used items beyond that go back on probation.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -49,6 +68,8 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool in_high_pri_pool;  // Whether entry is in the high-priority pool.
+  bool in_hot;       // Whether entry is in the hot segment.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -147,6 +168,10 @@ class HandleTable {
   }
 };
 
+// Share of the capacity outside the high-priority pool that may be used by
+// hot entries; the rest is left for entries on probation.
+static const double kHotRatio = 0.625;
+
 // A single shard of sharded cache.
 class LRUCache {
  public:
@@ -155,11 +180,16 @@ class LRUCache {
 
   // Separate from constructor so caller can easily make an array of LRUCache
   void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetHighPriPoolCapacity(size_t capacity) {
+    high_pri_capacity_ = capacity;
+  }
+  void SetHotCapacity(size_t capacity) { hot_capacity_ = capacity; }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -168,50 +198,108 @@ class LRUCache {
     MutexLock l(&mutex_);
     return usage_;
   }
+  void GetStats(Cache::ShardStats* stats) const;
 
  private:
+  // Like MutexLock, but adds the time spent waiting for mutex_ to the
+  // statistics of the shard.
+  class SCOPED_LOCKABLE ShardLock {
+   public:
+    explicit ShardLock(LRUCache* shard) EXCLUSIVE_LOCK_FUNCTION(shard->mutex_)
+        : shard_(shard) {
+      shard_->LockMutex();
+    }
+    ~ShardLock() UNLOCK_FUNCTION() { shard_->mutex_.Unlock(); }
+
+    ShardLock(const ShardLock&) = delete;
+    ShardLock& operator=(const ShardLock&) = delete;
+
+   private:
+    LRUCache* const shard_;
+  };
+
+  void LockMutex() EXCLUSIVE_LOCK_FUNCTION(mutex_);
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle* list, LRUHandle* e);
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
+  void MaintainPoolSize() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
+  size_t hot_capacity_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);  // Charge of the pool entries
+  size_t hot_usage_ GUARDED_BY(mutex_);  // Charge of the hot entries
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of hot LRU list.
+  // Entries have refs==1, in_cache==true and in_hot==true.
+  LRUHandle hot_lru_ GUARDED_BY(mutex_);
+
+  // Dummy head of high-priority LRU list.
+  // Entries have refs==1, in_cache==true and in_high_pri_pool==true.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
   HandleTable table_ GUARDED_BY(mutex_);
+
+  // Statistics, see Cache::ShardStats.
+  uint64_t lookups_ GUARDED_BY(mutex_);
+  uint64_t hits_ GUARDED_BY(mutex_);
+  uint64_t inserts_ GUARDED_BY(mutex_);
+  uint64_t evictions_ GUARDED_BY(mutex_);
+  uint64_t lock_waits_ GUARDED_BY(mutex_);
+  uint64_t lock_wait_nanos_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_capacity_(0),
+      hot_capacity_(0),
+      usage_(0),
+      high_pri_usage_(0),
+      hot_usage_(0),
+      lookups_(0),
+      hits_(0),
+      inserts_(0),
+      evictions_(0),
+      lock_waits_(0),
+      lock_wait_nanos_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  hot_lru_.next = &hot_lru_;
+  hot_lru_.prev = &hot_lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &hot_lru_, &high_pri_lru_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ list.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -233,6 +321,29 @@ void LRUCache::Unref(LRUHandle* e) {
   } else if (e->in_cache && e->refs == 1) {
     // No longer in use; move to lru_ list.
     LRU_Remove(e);
+    LRU_Append(e->in_high_pri_pool ? &high_pri_lru_
+               : e->in_hot         ? &hot_lru_
+                                   : &lru_,
+               e);
+  }
+}
+
+// Moves the oldest unused entries of the high-priority pool and of the hot
+// segment to lru_ until both fit in their capacity again.
+void LRUCache::MaintainPoolSize() {
+  while (high_pri_usage_ > high_pri_capacity_ &&
+         high_pri_lru_.next != &high_pri_lru_) {
+    LRUHandle* e = high_pri_lru_.next;
+    LRU_Remove(e);
+    e->in_high_pri_pool = false;
+    high_pri_usage_ -= e->charge;
+    LRU_Append(&lru_, e);
+  }
+  while (hot_usage_ > hot_capacity_ && hot_lru_.next != &hot_lru_) {
+    LRUHandle* e = hot_lru_.next;
+    LRU_Remove(e);
+    e->in_hot = false;
+    hot_usage_ -= e->charge;
     LRU_Append(&lru_, e);
   }
 }
@@ -250,25 +361,61 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
   e->next->prev = e;
 }
 
-Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+void LRUCache::LockMutex() {
+  // Only a contended lock is timed, so that the common case does not pay
+  // for reading the clock.
+  if (mutex_.TryLock()) {
+    return;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  mutex_.Lock();
+  lock_waits_++;
+  lock_wait_nanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+}
+
+void LRUCache::GetStats(Cache::ShardStats* stats) const {
   MutexLock l(&mutex_);
+  stats->capacity = capacity_;
+  stats->usage = usage_;
+  stats->lookups = lookups_;
+  stats->hits = hits_;
+  stats->inserts = inserts_;
+  stats->evictions = evictions_;
+  stats->lock_waits = lock_waits_;
+  stats->lock_wait_nanos = lock_wait_nanos_;
+}
+
+Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+  ShardLock l(this);
+  lookups_++;
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
+    hits_++;
+    if (!e->in_high_pri_pool && !e->in_hot) {
+      // Second access: promote the entry from probation
+      e->in_hot = true;
+      hot_usage_ += e->charge;
+    }
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
 void LRUCache::Release(Cache::Handle* handle) {
-  MutexLock l(&mutex_);
+  ShardLock l(this);
   Unref(reinterpret_cast<LRUHandle*>(handle));
+  MaintainPoolSize();
 }
 
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
-  MutexLock l(&mutex_);
+                                                void* value),
+                                Cache::Priority priority) {
+  ShardLock l(this);
+  inserts_++;
 
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
@@ -278,6 +425,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->in_high_pri_pool = false;
+  e->in_hot = false;
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -286,18 +435,34 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (priority == Cache::kHighPriority && high_pri_capacity_ > 0) {
+      e->in_high_pri_pool = true;
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
+    MaintainPoolSize();
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  // 优先淘汰处于观察期的 lru_ 链表，然后是 hot_lru_，最后才淘汰高优先级池中的条目
+  while (usage_ > capacity_) {
+    LRUHandle* old;
+    if (lru_.next != &lru_) {
+      old = lru_.next;
+    } else if (hot_lru_.next != &hot_lru_) {
+      old = hot_lru_.next;
+    } else if (high_pri_lru_.next != &high_pri_lru_) {
+      old = high_pri_lru_.next;
+    } else {
+      break;
+    }
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
       assert(erased);
     }
+    evictions_++;
   }
 
   return reinterpret_cast<Cache::Handle*>(e);
@@ -311,34 +476,64 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->in_high_pri_pool) {
+      e->in_high_pri_pool = false;
+      high_pri_usage_ -= e->charge;
+    }
+    if (e->in_hot) {
+      e->in_hot = false;
+      hot_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
 }
 
 void LRUCache::Erase(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  ShardLock l(this);
   FinishErase(table_.Remove(key, hash));
 }
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+  for (LRUHandle* list : {&lru_, &hot_lru_, &high_pri_lru_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
     }
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+// Shards are added until there are two per core, but not beyond 64 shards
+// or below kMinShardCapacity per shard.
+static const int kMaxDefaultShardBits = 6;
+static const int kMaxShardBits = 20;
+static const size_t kMinShardCapacity = 512 * 1024;
+
+static int DefaultShardBits(size_t capacity) {
+  const unsigned int cores = std::thread::hardware_concurrency();
+  int bits = 0;
+  if (cores == 0) {
+    bits = 4;  // Unknown core count
+  } else {
+    while (bits < kMaxDefaultShardBits && (1u << bits) < 2 * cores) {
+      bits++;
+    }
+  }
+  while (bits > 0 && (capacity >> bits) < kMinShardCapacity) {
+    bits--;
+  }
+  return bits;
+}
 
 class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  const int shard_bits_;
+  LRUCache* const shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -346,20 +541,40 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t Shard(uint32_t hash) const {
+    return shard_bits_ == 0 ? 0 : hash >> (32 - shard_bits_);
+  }
+
+  int NumShards() const { return 1 << shard_bits_; }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio,
+                  int shard_bits)
+      : shard_bits_(shard_bits),
+        shard_(new LRUCache[1 << shard_bits]),
+        last_id_(0) {
+    const int num_shards = NumShards();
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    const size_t high_pri_per_shard =
+        static_cast<size_t>(per_shard * high_pri_pool_ratio);
+    for (int s = 0; s < num_shards; s++) {
       shard_[s].SetCapacity(per_shard);
+      shard_[s].SetHighPriPoolCapacity(high_pri_per_shard);
+      shard_[s].SetHotCapacity(
+          static_cast<size_t>((per_shard - high_pri_per_shard) * kHotRatio));
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedLRUCache() override { delete[] shard_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -381,21 +596,49 @@ class ShardedLRUCache : public Cache {
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       shard_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < NumShards(); s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
+  void GetShardStats(std::vector<ShardStats>* stats) const override {
+    stats->resize(NumShards());
+    for (int s = 0; s < NumShards(); s++) {
+      shard_[s].GetStats(&(*stats)[s]);
+    }
+  }
 };
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+void Cache::GetShardStats(std::vector<ShardStats>* stats) const {
+  stats->clear();
+}
+
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, 0, -1);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return NewLRUCache(capacity, high_pri_pool_ratio, -1);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                   int num_shard_bits) {
+  if (high_pri_pool_ratio < 0) high_pri_pool_ratio = 0;
+  if (high_pri_pool_ratio > 1) high_pri_pool_ratio = 1;
+  if (num_shard_bits < 0) {
+    num_shard_bits = DefaultShardBits(capacity);
+  } else if (num_shard_bits > kMaxShardBits) {
+    num_shard_bits = kMaxShardBits;
+  }
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, num_shard_bits);
+}
 
 }  // namespace leveldb
@@ -4,6 +4,8 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -54,6 +56,11 @@ class CacheTest : public testing::Test {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &CacheTest::Deleter, Cache::kHighPriority));
+  }
+
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
                           &CacheTest::Deleter);
@@ -63,6 +70,7 @@ class CacheTest : public testing::Test {
   static CacheTest* current_;
 };
 CacheTest* CacheTest::current_;
+constexpr int CacheTest::kCacheSize;
 
 TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
@@ -150,6 +158,72 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
+TEST_F(CacheTest, HighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  InsertHighPriority(100, 101);
+  InsertHighPriority(200, 201);
+  Insert(300, 301);
+
+  // High-priority entries must survive a scan of low-priority ones.
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(-1, Lookup(300));
+}
+
+TEST_F(CacheTest, HighPriorityPoolOverflow) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  // High-priority entries that do not fit in the pool are evicted like
+  // low-priority ones.
+  for (int i = 0; i < kCacheSize; i++) {
+    InsertHighPriority(i, 1000 + i);
+  }
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  int cached = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(i) >= 0) {
+      cached++;
+    }
+  }
+  ASSERT_LE(cached, kCacheSize / 2);
+  ASSERT_GT(cached, kCacheSize / 4);
+}
+
+TEST_F(CacheTest, ScanResistance) {
+  // A working set that is looked up again joins the hot segment
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+
+  // A scan of entries that are inserted once only evicts other such entries
+  for (int i = 0; i < 5 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(10000));
+  ASSERT_EQ(20000 + 5 * kCacheSize - 1, Lookup(10000 + 5 * kCacheSize - 1));
+
+  // The hot segment leaves room for new entries to get their second hit
+  for (int i = 0; i < kCacheSize / 4; i++) {
+    Insert(50000 + i, 60000 + i);
+  }
+  for (int i = 0; i < kCacheSize / 4; i++) {
+    ASSERT_EQ(60000 + i, Lookup(50000 + i));
+  }
+}
+
 TEST_F(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
@@ -221,4 +295,217 @@ TEST_F(CacheTest, ZeroSizeCache) {
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_F(CacheTest, ShardStats) {
+  std::vector<Cache::ShardStats> stats;
+  cache_->GetShardStats(&stats);
+  ASSERT_EQ(1, stats.size());  // Small caches are not split
+
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, 2);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(i, 1000 + i);
+    Lookup(i);
+    Lookup(i + 2 * kCacheSize);
+  }
+  cache_->GetShardStats(&stats);
+  ASSERT_EQ(4, stats.size());
+  Cache::ShardStats total;
+  for (const Cache::ShardStats& s : stats) {
+    ASSERT_EQ(kCacheSize / 4, s.capacity);
+    ASSERT_LE(s.usage, s.capacity);
+    total.usage += s.usage;
+    total.lookups += s.lookups;
+    total.hits += s.hits;
+    total.inserts += s.inserts;
+    total.evictions += s.evictions;
+    total.lock_waits += s.lock_waits;
+  }
+  ASSERT_EQ(cache_->TotalCharge(), total.usage);
+  ASSERT_EQ(4 * kCacheSize, total.lookups);
+  ASSERT_EQ(2 * kCacheSize, total.hits);
+  ASSERT_EQ(2 * kCacheSize, total.inserts);
+  ASSERT_EQ(2 * kCacheSize - total.usage, total.evictions);
+  ASSERT_EQ(0, total.lock_waits);
+}
+
+TEST_F(CacheTest, ClockHitMissAndErase) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 1);
+
+  ASSERT_EQ(-1, Lookup(100));
+  Insert(100, 101);
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(-1, Lookup(300));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+  ASSERT_EQ(1, cache_->TotalCharge());
+}
+
+TEST_F(CacheTest, ClockEntriesArePinned) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 1);
+
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(1, deleted_keys_.size());
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+
+  // Entries beyond the capacity stay valid while they are referenced
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    h.push_back(InsertAndReturnHandle(1000 + i, 2000 + i));
+  }
+  for (int i = 0; i < h.size(); i++) {
+    ASSERT_EQ(2000 + i, DecodeValue(cache_->Value(h[i])));
+    cache_->Release(h[i]);
+  }
+  // Like the LRU cache, the next insertion evicts the released entries
+  Insert(1, 1);
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize);
+}
+
+TEST_F(CacheTest, ClockEvictionPolicy) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 1);
+
+  Insert(100, 101);
+  InsertHighPriority(200, 201);
+  Insert(250, 251);
+  Cache::Handle* h = InsertAndReturnHandle(300, 301);
+
+  // Entries that are looked up or pinned must survive a scan, and
+  // high-priority entries must outlive low-priority ones.
+  auto deleted = [this](int key) {
+    for (int k : deleted_keys_) {
+      if (k == key) return true;
+    }
+    return false;
+  };
+  int i = 0;
+  for (; !deleted(250); i++) {
+    ASSERT_LT(i, 10 * kCacheSize);
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_FALSE(deleted(200));
+  for (int j = 0; j < 2 * kCacheSize; j++, i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(301, DecodeValue(cache_->Value(h)));
+  ASSERT_EQ(301, Lookup(300));
+  ASSERT_EQ(-1, Lookup(1000));
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize);
+  cache_->Release(h);
+
+  cache_->Prune();
+  ASSERT_EQ(0, cache_->TotalCharge());
+  ASSERT_EQ(-1, Lookup(100));
+}
+
+TEST_F(CacheTest, ClockHeavyEntries) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 5);
+
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2 * kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000 + index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000 + i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize);
+  ASSERT_GT(cached_weight, kCacheSize / 2);
+}
+
+TEST_F(CacheTest, ClockZeroSizeCache) {
+  delete cache_;
+  cache_ = NewClockCache(0);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+static std::atomic<int> clock_deleted(0);
+static void CountingDeleter(const Slice& key, void* value) {
+  ASSERT_EQ(DecodeKey(key), DecodeValue(value));
+  clock_deleted.fetch_add(1);
+}
+
+TEST(ClockCacheTest, ConcurrentAccess) {
+  const int kThreads = 8;
+  const int kKeys = 2000;
+  const int kOpsPerThread = 50000;
+  Cache* cache = NewClockCache(kKeys / 2, 1);
+  std::atomic<int> inserted(0);
+  clock_deleted.store(0);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      uint32_t state = 301 + t;
+      for (int i = 0; i < kOpsPerThread; i++) {
+        state = state * 1103515245 + 12345;
+        const int key = (state >> 8) % kKeys;
+        Cache::Handle* h = cache->Lookup(EncodeKey(key));
+        if (h == nullptr) {
+          if ((state & 7) == 0) {
+            cache->Erase(EncodeKey(key));
+            continue;
+          }
+          h = cache->Insert(EncodeKey(key), EncodeValue(key), 1,
+                            &CountingDeleter);
+          inserted.fetch_add(1);
+        }
+        ASSERT_EQ(key, DecodeValue(cache->Value(h)));
+        cache->Release(h);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(cache->TotalCharge(), kKeys / 2);
+  delete cache;
+  ASSERT_EQ(inserted.load(), clock_deleted.load());
+}
+
 }  // namespace leveldb
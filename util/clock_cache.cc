@@ -0,0 +1,387 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Entries live in a fixed-size open-addressing hash table that is probed
+// with double hashing.  All the state that readers need to synchronize on
+// is packed into one atomic word per slot, so that Lookup() and Release()
+// only ever perform atomic operations on the slot of the entry and never
+// take a lock.
+//
+// A slot goes through the following states:
+// - empty:  the slot holds no entry.  Its meta word is zero.
+// - construction:  the slot is reserved by a thread that fills it in or
+//   frees its entry.  No other thread reads or writes the entry.
+// - visible:  the entry can be found by Lookup().  Readers take a reference
+//   with a compare-and-swap that only succeeds in this state, and then
+//   check the key of the entry.
+// - invisible:  the entry was erased or replaced, but is still referenced.
+//   The thread that drops the last reference frees it.
+//
+// Eviction sweeps a clock hand over the table.  Each visible entry has a
+// small countdown that is refilled when the entry is looked up and
+// decremented when the hand passes over it; the hand evicts unreferenced
+// entries whose countdown is zero.  Entries inserted with
+// Cache::kHighPriority start with a full countdown, so they survive more
+// sweeps than a scan of entries that are never looked up again.
+//
+// To tell when a probe sequence can stop, every slot counts the entries
+// whose probe sequence passed over it on insertion ("displacements").  A
+// lookup that reaches a slot with no displacements can stop there.
+//
+// Entries that do not fit in the table, because the cache has no capacity
+// or every slot is in use, are returned as detached handles: they are
+// valid until released but can never be found by Lookup().
+
+// Layout of the meta word of a slot.
+static const uint64_t kRefMask = 0xffffffffu;  // Number of references
+static const int kCountdownShift = 32;
+static const uint64_t kMaxCountdown = 3;
+static const uint64_t kCountdownMask = kMaxCountdown << kCountdownShift;
+static const int kStateShift = 34;
+
+enum SlotState : uint64_t {
+  kStateEmpty = 0,
+  kStateConstruction = 1,
+  kStateVisible = 2,
+  kStateInvisible = 3,
+};
+
+inline uint64_t MetaState(uint64_t meta) { return meta >> kStateShift; }
+inline uint64_t MetaRefs(uint64_t meta) { return meta & kRefMask; }
+inline uint64_t MetaCountdown(uint64_t meta) {
+  return (meta & kCountdownMask) >> kCountdownShift;
+}
+inline uint64_t MakeMeta(uint64_t state, uint64_t countdown, uint64_t refs) {
+  return (state << kStateShift) | (countdown << kCountdownShift) | refs;
+}
+
+struct ClockHandle {
+  ClockHandle() : meta(0), displacements(0) {}
+
+  std::atomic<uint64_t> meta;
+  std::atomic<uint32_t> displacements;
+  uint32_t hash;
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  size_t key_length;
+  char* key_data;
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+class ClockCache : public Cache {
+ public:
+  ClockCache(size_t capacity, size_t estimated_entry_charge);
+  ~ClockCache() override;
+
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override;
+  Handle* Lookup(const Slice& key) override;
+  void Release(Handle* handle) override {
+    Unref(reinterpret_cast<ClockHandle*>(handle));
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  void Erase(const Slice& key) override;
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  void Prune() override;
+  size_t TotalCharge() const override {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  // Index of the "probe"th slot in the probe sequence of "hash".  The step
+  // is odd, so the sequence visits every slot of the table.
+  size_t ProbeSlot(uint32_t hash, size_t probe) const {
+    const uint32_t step = ((hash >> 16) | (hash << 16)) | 1;
+    return (hash + probe * step) & mask_;
+  }
+
+  bool IsDetached(const ClockHandle* h) const {
+    return h < slots_ || h >= slots_ + num_slots_;
+  }
+
+  // Takes a reference on "h" if it is visible.
+  bool Acquire(ClockHandle* h);
+  void Unref(ClockHandle* h);
+  // Frees the entry of "h", which nobody else may be able to reach.
+  void Free(ClockHandle* h);
+  // Evicts entries until "charge" more fits in the cache, or until the
+  // clock hand has passed every slot often enough to empty the countdowns.
+  void EvictFor(size_t charge);
+  Handle* InsertDetached(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value));
+
+  const size_t capacity_;
+  size_t num_slots_;
+  size_t mask_;
+  size_t occupancy_limit_;  // Maximum number of occupied slots
+  ClockHandle* slots_;
+
+  std::atomic<size_t> usage_;
+  std::atomic<size_t> occupancy_;  // Number of occupied slots
+  std::atomic<size_t> clock_hand_;
+  std::atomic<uint64_t> last_id_;
+};
+
+ClockCache::ClockCache(size_t capacity, size_t estimated_entry_charge)
+    : capacity_(capacity),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0),
+      last_id_(0) {
+  // Size the table for a load factor of at most 0.7 when the cache is full
+  // of entries of the estimated charge.
+  if (estimated_entry_charge == 0) {
+    estimated_entry_charge = 1;
+  }
+  const size_t num_entries = capacity / estimated_entry_charge;
+  num_slots_ = 16;
+  while (num_slots_ * 7 / 10 < num_entries) {
+    num_slots_ *= 2;
+  }
+  mask_ = num_slots_ - 1;
+  occupancy_limit_ = num_slots_ * 9 / 10;
+  slots_ = new ClockHandle[num_slots_];
+}
+
+ClockCache::~ClockCache() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (MetaState(meta) != kStateEmpty) {
+      assert(MetaRefs(meta) == 0);  // Error if caller has an unreleased handle
+      (*h->deleter)(h->key(), h->value);
+      delete[] h->key_data;
+    }
+  }
+  delete[] slots_;
+}
+
+bool ClockCache::Acquire(ClockHandle* h) {
+  uint64_t meta = h->meta.load(std::memory_order_relaxed);
+  uint64_t new_meta;
+  do {
+    if (MetaState(meta) != kStateVisible) {
+      return false;
+    }
+    // 访问时重置 countdown, 近期被访问过的条目可以躲过几轮扫描
+    new_meta = (meta & ~kCountdownMask) |
+               (kMaxCountdown << kCountdownShift);
+    new_meta += 1;
+  } while (!h->meta.compare_exchange_weak(meta, new_meta,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed));
+  return true;
+}
+
+void ClockCache::Unref(ClockHandle* h) {
+  const uint64_t old_meta = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert(MetaRefs(old_meta) > 0);
+  if (MetaRefs(old_meta) == 1 && MetaState(old_meta) == kStateInvisible) {
+    // An invisible entry cannot gain references, so this was the last one
+    Free(h);
+  }
+}
+
+void ClockCache::Free(ClockHandle* h) {
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+  if (IsDetached(h)) {
+    delete h;
+    return;
+  }
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  const size_t index = h - slots_;
+  for (size_t probe = 0; ProbeSlot(h->hash, probe) != index; probe++) {
+    slots_[ProbeSlot(h->hash, probe)].displacements.fetch_sub(
+        1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  h->meta.store(0, std::memory_order_release);
+}
+
+void ClockCache::EvictFor(size_t charge) {
+  const size_t max_steps = (kMaxCountdown + 1) * num_slots_;
+  for (size_t step = 0; step < max_steps; step++) {
+    if (usage_.load(std::memory_order_relaxed) + charge <= capacity_ &&
+        occupancy_.load(std::memory_order_relaxed) < occupancy_limit_) {
+      return;
+    }
+    ClockHandle* h =
+        &slots_[clock_hand_.fetch_add(1, std::memory_order_relaxed) & mask_];
+    uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (MetaState(meta) != kStateVisible || MetaRefs(meta) != 0) {
+      continue;
+    }
+    if (MetaCountdown(meta) > 0) {
+      h->meta.compare_exchange_strong(meta, meta - (1ull << kCountdownShift),
+                                      std::memory_order_relaxed);
+    } else if (h->meta.compare_exchange_strong(
+                   meta, MakeMeta(kStateConstruction, 0, 0),
+                   std::memory_order_acquire)) {
+      Free(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCache::InsertDetached(
+    const Slice& key, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value)) {
+  ClockHandle* h = new ClockHandle;
+  h->hash = HashSlice(key);
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+  h->meta.store(MakeMeta(kStateInvisible, 0, 1), std::memory_order_relaxed);
+  return reinterpret_cast<Handle*>(h);
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, void* value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value),
+                                  Priority priority) {
+  if (capacity_ == 0) {
+    // Turn off caching
+    return InsertDetached(key, value, charge, deleter);
+  }
+
+  // Like the LRU cache, an entry replaces older ones with its key.  Two
+  // concurrent insertions of one key may leave both in the table until
+  // one of them is evicted; lookups return either.
+  Erase(key);
+  EvictFor(charge);
+  if (occupancy_.fetch_add(1, std::memory_order_relaxed) >=
+      occupancy_limit_) {
+    occupancy_.fetch_sub(1, std::memory_order_relaxed);
+    return InsertDetached(key, value, charge, deleter);
+  }
+
+  const uint32_t hash = HashSlice(key);
+  for (size_t probe = 0; probe < num_slots_; probe++) {
+    ClockHandle* h = &slots_[ProbeSlot(hash, probe)];
+    uint64_t expected = 0;
+    if (h->meta.compare_exchange_strong(expected,
+                                        MakeMeta(kStateConstruction, 0, 0),
+                                        std::memory_order_acquire)) {
+      h->hash = hash;
+      h->value = value;
+      h->deleter = deleter;
+      h->charge = charge;
+      h->key_length = key.size();
+      h->key_data = new char[key.size()];
+      std::memcpy(h->key_data, key.data(), key.size());
+      usage_.fetch_add(charge, std::memory_order_relaxed);
+      const uint64_t countdown = priority == kHighPriority ? kMaxCountdown : 1;
+      h->meta.store(MakeMeta(kStateVisible, countdown, 1),
+                    std::memory_order_release);
+      return reinterpret_cast<Handle*>(h);
+    }
+    h->displacements.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Concurrent insertions took every free slot; undo the displacements.
+  for (size_t probe = 0; probe < num_slots_; probe++) {
+    slots_[ProbeSlot(hash, probe)].displacements.fetch_sub(
+        1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  return InsertDetached(key, value, charge, deleter);
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key) {
+  const uint32_t hash = HashSlice(key);
+  for (size_t probe = 0; probe < num_slots_; probe++) {
+    ClockHandle* h = &slots_[ProbeSlot(hash, probe)];
+    if (Acquire(h)) {
+      if (h->hash == hash && h->key() == key) {
+        return reinterpret_cast<Handle*>(h);
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ClockCache::Erase(const Slice& key) {
+  const uint32_t hash = HashSlice(key);
+  for (size_t probe = 0; probe < num_slots_; probe++) {
+    ClockHandle* h = &slots_[ProbeSlot(hash, probe)];
+    if (Acquire(h)) {
+      if (h->hash == hash && h->key() == key) {
+        // Hide the entry; whoever drops the last reference frees it
+        uint64_t meta = h->meta.load(std::memory_order_relaxed);
+        while (MetaState(meta) == kStateVisible &&
+               !h->meta.compare_exchange_weak(
+                   meta,
+                   (meta & ~(uint64_t{3} << kStateShift)) |
+                       (uint64_t{kStateInvisible} << kStateShift),
+                   std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        }
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+  }
+}
+
+void ClockCache::Prune() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    ClockHandle* h = &slots_[i];
+    uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    if (MetaState(meta) == kStateVisible && MetaRefs(meta) == 0 &&
+        h->meta.compare_exchange_strong(meta,
+                                        MakeMeta(kStateConstruction, 0, 0),
+                                        std::memory_order_acquire)) {
+      Free(h);
+    }
+  }
+}
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity) {
+  return new ClockCache(capacity, 4 * 1024);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ClockCache(capacity, estimated_entry_charge);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include <new>
+
+#include "util/arena.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+// Hashing follows the blocked filters of util/bloom.cc: one hash picks
+// the line, a second one the bits within it.
+static uint32_t LineHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+static uint32_t ProbeHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0x5bd1e995);
+}
+
+// Multiplier used to derive successive probes within a line.
+static const uint32_t kProbeMultiplier = 0x9e3779b9;
+
+DynamicBloom::DynamicBloom(Arena* arena, uint32_t total_bits, int num_probes)
+    : num_lines_((total_bits + kLineBits - 1) / kLineBits),
+      num_probes_(num_probes) {
+  if (num_lines_ == 0) {
+    num_lines_ = 1;
+  }
+  const size_t words = num_lines_ * (kLineBits / 32);
+  // Over-allocate so that the filter can start on a cache line boundary.
+  char* raw = arena->AllocateAligned(words * sizeof(uint32_t) + 63);
+  char* aligned = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(raw) + 63) & ~uintptr_t{63});
+  data_ = reinterpret_cast<std::atomic<uint32_t>*>(aligned);
+  for (size_t i = 0; i < words; i++) {
+    new (&data_[i]) std::atomic<uint32_t>(0);
+  }
+}
+
+std::atomic<uint32_t>* DynamicBloom::Line(const Slice& key) const {
+  const uint32_t line = static_cast<uint32_t>(
+      (static_cast<uint64_t>(LineHash(key)) * num_lines_) >> 32);
+  return data_ + line * (kLineBits / 32);
+}
+
+void DynamicBloom::Add(const Slice& key) {
+  std::atomic<uint32_t>* line = Line(key);
+  uint32_t h = ProbeHash(key);
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h >> 23;
+    line[bitpos >> 5].fetch_or(uint32_t{1} << (bitpos & 31),
+                               std::memory_order_relaxed);
+    h *= kProbeMultiplier;
+  }
+}
+
+bool DynamicBloom::MayContain(const Slice& key) const {
+  const std::atomic<uint32_t>* line = Line(key);
+  uint32_t h = ProbeHash(key);
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos >> 5].load(std::memory_order_relaxed) &
+         (uint32_t{1} << (bitpos & 31))) == 0) {
+      return false;
+    }
+    h *= kProbeMultiplier;
+  }
+  return true;
+}
+
+}  // namespace leveldb
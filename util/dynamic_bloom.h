@@ -0,0 +1,54 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+#define STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+
+// A Bloom filter that is built incrementally, as keys are added, in a
+// fixed amount of memory.  Unlike the filters of FilterPolicy it needs
+// no list of keys up front, which suits a memtable.
+//
+// All the probes of a key fall in one 64-byte cache line, so a lookup
+// touches a single line of memory.
+//
+// Add() may run concurrently with MayContain(), but not with another
+// Add().
+// 增量构建的布隆过滤器，一个 key 的所有探测位都在同一个 cache line 中
+class DynamicBloom {
+ public:
+  // Allocates a filter of at least "total_bits" bits (rounded up to whole
+  // cache lines) from "arena", which must outlive the filter.
+  DynamicBloom(Arena* arena, uint32_t total_bits, int num_probes = 6);
+
+  DynamicBloom(const DynamicBloom&) = delete;
+  DynamicBloom& operator=(const DynamicBloom&) = delete;
+
+  void Add(const Slice& key);
+
+  // Returns false if "key" was certainly never added.
+  bool MayContain(const Slice& key) const;
+
+ private:
+  static const uint32_t kLineBits = 512;
+
+  // Returns the cache line that holds the bits of "key".
+  std::atomic<uint32_t>* Line(const Slice& key) const;
+
+  uint32_t num_lines_;
+  const int num_probes_;
+  std::atomic<uint32_t>* data_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
@@ -0,0 +1,88 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include <atomic>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+TEST(DynamicBloomTest, EmptyFilter) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 1000);
+  ASSERT_FALSE(bloom.MayContain("hello"));
+  ASSERT_FALSE(bloom.MayContain("world"));
+}
+
+TEST(DynamicBloomTest, Small) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 1000);
+  bloom.Add("hello");
+  bloom.Add("world");
+  ASSERT_TRUE(bloom.MayContain("hello"));
+  ASSERT_TRUE(bloom.MayContain("world"));
+  ASSERT_FALSE(bloom.MayContain("x"));
+  ASSERT_FALSE(bloom.MayContain("foo"));
+}
+
+TEST(DynamicBloomTest, FalsePositiveRate) {
+  // About ten bits per key, like NewBloomFilterPolicy(10).
+  for (int n = 1000; n <= 100000; n *= 10) {
+    Arena arena;
+    DynamicBloom bloom(&arena, n * 10);
+    char buffer[sizeof(int)];
+    for (int i = 0; i < n; i++) {
+      bloom.Add(Key(i, buffer));
+    }
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << i;
+    }
+    int false_positives = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (bloom.MayContain(Key(i + 1000000000, buffer))) {
+        false_positives++;
+      }
+    }
+    // Confining the probes to a cache line costs a little accuracy.
+    ASSERT_LE(false_positives, 300) << n;
+  }
+}
+
+TEST(DynamicBloomTest, ConcurrentReaders) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 100000);
+  const int kNum = 10000;
+  std::atomic<int> added(0);
+  std::atomic<bool> failed(false);
+  std::thread reader([&]() {
+    char buffer[sizeof(int)];
+    while (added.load(std::memory_order_acquire) < kNum) {
+      const int limit = added.load(std::memory_order_acquire);
+      for (int i = 0; i < limit; i++) {
+        if (!bloom.MayContain(Key(i, buffer))) {
+          failed.store(true);
+        }
+      }
+    }
+  });
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kNum; i++) {
+    bloom.Add(Key(i, buffer));
+    added.store(i + 1, std::memory_order_release);
+  }
+  reader.join();
+  ASSERT_FALSE(failed.load());
+}
+
+}  // namespace leveldb
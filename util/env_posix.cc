@@ -331,6 +331,19 @@ class PosixWritableFile final : public WritableFile {
 
   Status Flush() override { return FlushBuffer(); }
 
+  Status Preallocate(uint64_t length) override {
+#if HAVE_FALLOCATE
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0,
+                    static_cast<off_t>(length)) != 0) {
+      return PosixError(filename_, errno);
+    }
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)length;
+#endif  // HAVE_FALLOCATE
+    return Status::OK();
+  }
+
   Status Sync() override {
     // Ensure new files referred to by the manifest are in the filesystem.
     //
@@ -596,6 +609,24 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& filename,
+                           const std::string& old_filename,
+                           WritableFile** result) override {
+    if (std::rename(old_filename.c_str(), filename.c_str()) != 0) {
+      *result = nullptr;
+      return PosixError(old_filename, errno);
+    }
+    // No O_TRUNC: writes go over the blocks the file already has.
+    int fd = ::open(filename.c_str(), O_WRONLY | kOpenBaseFlags);
+    if (fd < 0) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixWritableFile(filename, fd);
+    return Status::OK();
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
@@ -653,6 +684,16 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status LinkFile(const std::string& from, const std::string& to) override {
+    if (::link(from.c_str(), to.c_str()) != 0) {
+      if (errno == EXDEV || errno == EPERM || errno == EMLINK) {
+        return Status::NotSupported(from, std::strerror(errno));
+      }
+      return PosixError(from, errno);
+    }
+    return Status::OK();
+  }
+
   Status LockFile(const std::string& filename, FileLock** lock) override {
     *lock = nullptr;
 
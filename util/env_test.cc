@@ -245,4 +245,29 @@ TEST_F(EnvTest, ReopenAppendableFile) {
   env_->RemoveFile(test_file_name);
 }
 
+TEST_F(EnvTest, LinkFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string src_name = test_dir + "/link_file_src.txt";
+  std::string target_name = test_dir + "/link_file_target.txt";
+  env_->RemoveFile(src_name);
+  env_->RemoveFile(target_name);
+
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "hello world!", src_name));
+  Status s = env_->LinkFile(src_name, target_name);
+  if (s.IsNotSupportedError()) {
+    env_->RemoveFile(src_name);
+    return;
+  }
+  ASSERT_LEVELDB_OK(s);
+  ASSERT_TRUE(!env_->LinkFile(src_name, target_name).ok());
+
+  // The link outlives the original name.
+  ASSERT_LEVELDB_OK(env_->RemoveFile(src_name));
+  std::string data;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, target_name, &data));
+  ASSERT_EQ(std::string("hello world!"), data);
+  env_->RemoveFile(target_name);
+}
+
 }  // namespace leveldb
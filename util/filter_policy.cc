@@ -8,4 +8,9 @@ namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+void FilterPolicy::CreateFilterForLevel(int level, const Slice* keys, int n,
+                                        std::string* dst) const {
+  CreateFilter(keys, n, dst);
+}
+
 }  // namespace leveldb
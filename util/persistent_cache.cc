@@ -0,0 +1,376 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() {}
+
+namespace {
+
+// Persistent cache implementation
+//
+// Entries are appended to a write buffer in memory.  When the buffer is
+// full it is written out as a new cache file in one go, and the file is
+// never modified again.  Each file is a sequence of records:
+//
+//    masked crc32c of the rest of the record: fixed32
+//    key size:                                fixed32
+//    data size:                               fixed32
+//    key:                                     char[key size]
+//    data:                                    char[data size]
+//
+// An index in memory maps every key to the file and offset of its
+// record.  When the cache outgrows its capacity the oldest file is
+// deleted together with its entries, so the cache behaves like a FIFO
+// of files.  Opening a cache reads all its files to rebuild the index;
+// records that fail their checksum end the scan of a file.
+//
+// Lookups read the record from the file without holding the mutex.  Each
+// file is reference counted so that a file evicted during such a read is
+// only deleted once the read is done.
+// 写缓冲满后整体写成一个只读的缓存文件，按文件先进先出淘汰
+
+const size_t kHeaderSize = 12;
+
+// Bounds of the size of a cache file, and so of the write buffer.
+const uint64_t kMinFileSize = 64 << 10;
+const uint64_t kMaxFileSize = 32 << 20;
+
+struct CacheFile {
+  uint64_t number;
+  uint64_t size;
+  RandomAccessFile* reader;
+  int refs;  // One for the cache while the file is live, plus readers
+  std::vector<std::string> keys;
+};
+
+// Where the record of an entry is.  A null file means the write buffer.
+struct Location {
+  CacheFile* file;
+  uint64_t offset;
+  uint32_t size;
+};
+
+void EncodeRecord(const Slice& key, const Slice& data, std::string* dst) {
+  const size_t start = dst->size();
+  dst->resize(start + kHeaderSize);  // The crc is filled in last
+  EncodeFixed32(&(*dst)[start + 4], static_cast<uint32_t>(key.size()));
+  EncodeFixed32(&(*dst)[start + 8], static_cast<uint32_t>(data.size()));
+  dst->append(key.data(), key.size());
+  dst->append(data.data(), data.size());
+  const uint32_t crc =
+      crc32c::Value(dst->data() + start + 4, dst->size() - start - 4);
+  EncodeFixed32(&(*dst)[start], crc32c::Mask(crc));
+}
+
+// Decodes the record at the start of "input".  On success stores its key
+// and data, which point into "input", and the size of the record, and
+// returns true.  Returns false if the record is truncated or corrupt.
+bool DecodeRecord(const Slice& input, Slice* key, Slice* data,
+                  size_t* record_size) {
+  if (input.size() < kHeaderSize) {
+    return false;
+  }
+  const char* p = input.data();
+  const uint32_t key_size = DecodeFixed32(p + 4);
+  const uint32_t data_size = DecodeFixed32(p + 8);
+  const uint64_t size = kHeaderSize + uint64_t{key_size} + data_size;
+  if (size > input.size()) {
+    return false;
+  }
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(p));
+  if (crc32c::Value(p + 4, size - 4) != crc) {
+    return false;
+  }
+  *key = Slice(p + kHeaderSize, key_size);
+  *data = Slice(p + kHeaderSize + key_size, data_size);
+  *record_size = static_cast<size_t>(size);
+  return true;
+}
+
+class PersistentCacheImpl : public PersistentCache {
+ public:
+  PersistentCacheImpl(Env* env, const std::string& dir, uint64_t capacity)
+      : env_(env),
+        dir_(dir),
+        capacity_(capacity),
+        file_size_(std::min(std::max(capacity / 16, kMinFileSize),
+                            kMaxFileSize)),
+        next_file_number_(1),
+        total_size_(0) {}
+
+  ~PersistentCacheImpl() override {
+    MutexLock l(&mutex_);
+    WriteBuffer();
+    for (CacheFile* f : files_) {
+      assert(f->refs == 1);
+      delete f->reader;
+      delete f;
+    }
+  }
+
+  // Reads the files left in dir_ by an earlier instance.
+  Status Recover();
+
+  void Insert(const Slice& key, const Slice& data) override;
+  bool Lookup(const Slice& key, std::string* data) override;
+
+  uint64_t TotalSize() const override {
+    MutexLock l(&mutex_);
+    return total_size_;
+  }
+
+ private:
+  std::string FileName(uint64_t number) const {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu.pcache",
+                  static_cast<unsigned long long>(number));
+    return dir_ + buf;
+  }
+
+  // Turns the write buffer into a new cache file.
+  void WriteBuffer() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Deletes the oldest files until the cache fits its capacity.
+  void Evict() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void Unref(CacheFile* f) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  Env* const env_;
+  const std::string dir_;
+  const uint64_t capacity_;
+  const uint64_t file_size_;
+
+  mutable port::Mutex mutex_;
+  uint64_t next_file_number_ GUARDED_BY(mutex_);
+  uint64_t total_size_ GUARDED_BY(mutex_);
+  std::unordered_map<std::string, Location> index_ GUARDED_BY(mutex_);
+  std::deque<CacheFile*> files_ GUARDED_BY(mutex_);  // Oldest first
+  std::string buffer_ GUARDED_BY(mutex_);
+  std::vector<std::string> buffer_keys_ GUARDED_BY(mutex_);
+};
+
+Status PersistentCacheImpl::Recover() {
+  env_->CreateDir(dir_);  // Ignore error, the directory may exist
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(dir_, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (const std::string& child : children) {
+    const size_t dot = child.find('.');
+    if (dot == std::string::npos || child.substr(dot) != ".pcache") {
+      continue;
+    }
+    Slice digits(child.data(), dot);
+    uint64_t number = 0;
+    while (!digits.empty() && digits[0] >= '0' && digits[0] <= '9') {
+      number = number * 10 + (digits[0] - '0');
+      digits.remove_prefix(1);
+    }
+    if (digits.empty() && number > 0) {
+      numbers.push_back(number);
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  MutexLock l(&mutex_);
+  for (uint64_t number : numbers) {
+    next_file_number_ = number + 1;
+    const std::string fname = FileName(number);
+    std::string contents;
+    RandomAccessFile* reader = nullptr;
+    if (!ReadFileToString(env_, fname, &contents).ok() ||
+        !env_->NewRandomAccessFile(fname, &reader).ok()) {
+      env_->RemoveFile(fname);
+      continue;
+    }
+    CacheFile* f = new CacheFile;
+    f->number = number;
+    f->size = contents.size();
+    f->reader = reader;
+    f->refs = 1;
+    Slice input(contents);
+    Slice key, data;
+    size_t record_size;
+    while (DecodeRecord(input, &key, &data, &record_size)) {
+      Location loc;
+      loc.file = f;
+      loc.offset = contents.size() - input.size();
+      loc.size = static_cast<uint32_t>(record_size);
+      if (index_.emplace(key.ToString(), loc).second) {
+        f->keys.push_back(key.ToString());
+      }
+      input.remove_prefix(record_size);
+    }
+    files_.push_back(f);
+    total_size_ += f->size;
+  }
+  Evict();
+  return Status::OK();
+}
+
+void PersistentCacheImpl::Insert(const Slice& key, const Slice& data) {
+  const uint64_t record_size = kHeaderSize + key.size() + data.size();
+  if (record_size > file_size_) {
+    return;  // Would not fit a cache file
+  }
+  MutexLock l(&mutex_);
+  std::string k = key.ToString();
+  if (index_.find(k) != index_.end()) {
+    return;
+  }
+  Location loc;
+  loc.file = nullptr;
+  loc.offset = buffer_.size();
+  loc.size = static_cast<uint32_t>(record_size);
+  EncodeRecord(key, data, &buffer_);
+  index_.emplace(k, loc);
+  buffer_keys_.push_back(std::move(k));
+  total_size_ += record_size;
+  if (buffer_.size() >= file_size_) {
+    WriteBuffer();
+  }
+  Evict();
+}
+
+bool PersistentCacheImpl::Lookup(const Slice& key, std::string* data) {
+  Location loc;
+  {
+    MutexLock l(&mutex_);
+    auto iter = index_.find(key.ToString());
+    if (iter == index_.end()) {
+      return false;
+    }
+    loc = iter->second;
+    if (loc.file == nullptr) {
+      Slice record_key, record_data;
+      size_t record_size;
+      if (!DecodeRecord(Slice(buffer_.data() + loc.offset, loc.size),
+                        &record_key, &record_data, &record_size)) {
+        return false;
+      }
+      data->assign(record_data.data(), record_data.size());
+      return true;
+    }
+    loc.file->refs++;
+  }
+
+  char* scratch = new char[loc.size];
+  Slice record, record_key, record_data;
+  size_t record_size;
+  bool found =
+      loc.file->reader->Read(loc.offset, loc.size, &record, scratch).ok() &&
+      DecodeRecord(record, &record_key, &record_data, &record_size) &&
+      record_key == key;
+  if (found) {
+    data->assign(record_data.data(), record_data.size());
+  }
+  delete[] scratch;
+
+  MutexLock l(&mutex_);
+  Unref(loc.file);
+  return found;
+}
+
+void PersistentCacheImpl::WriteBuffer() {
+  if (buffer_.empty()) {
+    return;
+  }
+  CacheFile* f = new CacheFile;
+  f->number = next_file_number_++;
+  f->size = buffer_.size();
+  f->reader = nullptr;
+  f->refs = 1;
+  f->keys.swap(buffer_keys_);
+
+  const std::string fname = FileName(f->number);
+  WritableFile* file;
+  Status s = env_->NewWritableFile(fname, &file);
+  if (s.ok()) {
+    s = file->Append(buffer_);
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+  }
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &f->reader);
+  }
+  buffer_.clear();
+
+  if (!s.ok()) {
+    // Drop the buffered entries.
+    for (const std::string& k : f->keys) {
+      index_.erase(k);
+    }
+    total_size_ -= f->size;
+    env_->RemoveFile(fname);
+    delete f;
+    return;
+  }
+  for (const std::string& k : f->keys) {
+    index_[k].file = f;
+  }
+  files_.push_back(f);
+}
+
+void PersistentCacheImpl::Evict() {
+  while (total_size_ > capacity_ && !files_.empty()) {
+    CacheFile* f = files_.front();
+    files_.pop_front();
+    for (const std::string& k : f->keys) {
+      auto iter = index_.find(k);
+      if (iter != index_.end() && iter->second.file == f) {
+        index_.erase(iter);
+      }
+    }
+    total_size_ -= f->size;
+    Unref(f);
+  }
+}
+
+void PersistentCacheImpl::Unref(CacheFile* f) {
+  assert(f->refs > 0);
+  if (--f->refs == 0) {
+    delete f->reader;
+    env_->RemoveFile(FileName(f->number));
+    delete f;
+  }
+}
+
+}  // namespace
+
+Status NewPersistentCache(Env* env, const std::string& dir, uint64_t capacity,
+                          PersistentCache** result) {
+  *result = nullptr;
+  PersistentCacheImpl* cache = new PersistentCacheImpl(env, dir, capacity);
+  Status s = cache->Recover();
+  if (!s.ok()) {
+    delete cache;
+    return s;
+  }
+  *result = cache;
+  return s;
+}
+
+}  // namespace leveldb
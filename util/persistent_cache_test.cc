@@ -0,0 +1,172 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int k) {
+  std::string result;
+  PutFixed32(&result, k);
+  return result;
+}
+
+// A value of "size" bytes that depends on "k".
+static std::string Value(int k, size_t size) {
+  std::string result;
+  while (result.size() < size) {
+    result.append(std::to_string(k));
+    result.push_back('.');
+  }
+  result.resize(size);
+  return result;
+}
+
+class PersistentCacheTest : public testing::Test {
+ public:
+  PersistentCacheTest() : env_(Env::Default()), cache_(nullptr) {
+    EXPECT_LEVELDB_OK(env_->GetTestDirectory(&dir_));
+    dir_ += "/persistent_cache_test";
+    DestroyFiles();
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    DestroyFiles();
+  }
+
+  void Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = nullptr;
+    ASSERT_LEVELDB_OK(NewPersistentCache(env_, dir_, capacity, &cache_));
+  }
+
+  bool Lookup(int k, std::string* data) {
+    return cache_->Lookup(Key(k), data);
+  }
+
+  std::vector<std::string> Files() {
+    std::vector<std::string> children, files;
+    env_->GetChildren(dir_, &children);
+    for (const std::string& child : children) {
+      if (child != "." && child != "..") {
+        files.push_back(dir_ + "/" + child);
+      }
+    }
+    return files;
+  }
+
+  void DestroyFiles() {
+    for (const std::string& f : Files()) {
+      env_->RemoveFile(f);
+    }
+    env_->RemoveDir(dir_);
+  }
+
+  Env* env_;
+  std::string dir_;
+  PersistentCache* cache_;
+};
+
+TEST_F(PersistentCacheTest, InsertAndLookup) {
+  Open(1 << 20);
+  std::string data;
+  ASSERT_FALSE(Lookup(1, &data));
+  for (int i = 0; i < 100; i++) {
+    cache_->Insert(Key(i), Value(i, 100));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(Lookup(i, &data));
+    ASSERT_EQ(Value(i, 100), data);
+  }
+  ASSERT_FALSE(Lookup(100, &data));
+
+  // Entries are immutable.
+  cache_->Insert(Key(5), "other");
+  ASSERT_TRUE(Lookup(5, &data));
+  ASSERT_EQ(Value(5, 100), data);
+}
+
+TEST_F(PersistentCacheTest, SurvivesReopen) {
+  Open(1 << 20);
+  // Enough data for several cache files plus a partly filled buffer.
+  const int kNum = 500;
+  for (int i = 0; i < kNum; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+  }
+  const uint64_t size = cache_->TotalSize();
+  ASSERT_GE(size, kNum * 1000);
+
+  Open(1 << 20);
+  ASSERT_EQ(size, cache_->TotalSize());
+  std::string data;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_TRUE(Lookup(i, &data)) << i;
+    ASSERT_EQ(Value(i, 1000), data);
+  }
+}
+
+TEST_F(PersistentCacheTest, EvictsOldestEntries) {
+  const uint64_t kCapacity = 256 << 10;
+  Open(kCapacity);
+  const int kNum = 2000;
+  for (int i = 0; i < kNum; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+    ASSERT_LE(cache_->TotalSize(), 2 * kCapacity);
+  }
+  std::string data;
+  ASSERT_FALSE(Lookup(0, &data));
+  ASSERT_TRUE(Lookup(kNum - 1, &data));
+  ASSERT_EQ(Value(kNum - 1, 1000), data);
+  ASSERT_LE(Files().size(), 8);
+
+  // A smaller capacity on reopen drops more of the oldest entries.
+  Open(kCapacity / 2);
+  ASSERT_LE(cache_->TotalSize(), kCapacity / 2);
+  ASSERT_TRUE(Lookup(kNum - 1, &data));
+}
+
+TEST_F(PersistentCacheTest, CorruptRecordsAreDropped) {
+  Open(1 << 20);
+  const int kNum = 200;
+  for (int i = 0; i < kNum; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+  }
+  delete cache_;
+  cache_ = nullptr;
+
+  // Overwrite the last file with its first half plus a damaged byte.
+  std::vector<std::string> files = Files();
+  ASSERT_FALSE(files.empty());
+  std::sort(files.begin(), files.end());
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, files.back(), &contents));
+  contents.resize(contents.size() / 2);
+  contents[contents.size() - 10] ^= 0x80;
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, files.back()));
+
+  Open(1 << 20);
+  std::string data;
+  int found = 0;
+  for (int i = 0; i < kNum; i++) {
+    if (Lookup(i, &data)) {
+      ASSERT_EQ(Value(i, 1000), data);
+      found++;
+    }
+  }
+  ASSERT_GT(found, 0);
+  ASSERT_LT(found, kNum);
+  ASSERT_FALSE(Lookup(kNum - 1, &data));
+}
+
+}  // namespace leveldb